@@ -0,0 +1,257 @@
+#ifndef IO_SAMURAI_PROTO_H
+#define IO_SAMURAI_PROTO_H
+
+/*
+ * io-samurai protocol core, header-only, shared by the firmware, the HAL driver,
+ * the C++ client and the utilities. Usable from C99 and C++.
+ *
+ * Host to board (TX, 3 bytes): outputs, flags, checksum
+ * Board to host (RX, 5 bytes): inputs 0-7, inputs 8-15, ADC bits 0-7,
+ *                              ADC bits 8-11 | status bits, checksum
+ *
+ * Each direction has its own checksum chain: the chain index advances by the
+ * sum of the payload bytes plus one (modulo 256) and the checksum is the jump
+ * table entry at the new index. Both chains start at IOS_CHAIN_START and the
+ * board restarts them after its timeout.
+ *
+ * A lost or reordered frame puts the receiver's index out of step with the
+ * sender's. The table is a permutation, so a received checksum names the one
+ * index the sender reached (ios_jump_index): ios_check_tx()/ios_check_rx() take
+ * it over on a mismatch and the next frame confirms it, so the chain relocks
+ * after one rejected frame instead of failing until the board timeout.
+ *
+ * All functions are static inline and branch-free, so the codec is inlined
+ * into every hot path. The state lives in the caller's ios_link_t, nothing is
+ * global.
+ */
+
+#include <stdint.h>
+
+#define IOS_TX_FRAME_SIZE       3
+#define IOS_RX_FRAME_SIZE       5
+#define IOS_CHAIN_START         1
+
+// Board UDP port (config.c). The firmware latches the IP address and port of the first frame
+// it gets after boot and answers only there until it is power-cycled, so hosts send from a
+// fixed port, this one unless configured otherwise, never from a random one.
+#define IOS_DEFAULT_PORT        8888
+
+// Flags in byte 1 of the TX frame
+#define IOS_FLAG_LOWPASS        0x01    // Board side low-pass filter on the ADC
+#define IOS_FLAG_OLED_OFF       0x02    // Switch the OLED display off
+
+// Status bits in the upper nibble of RX byte 3
+#define IOS_STATUS_OUTPUTS      0x80    // MCP23008 found
+#define IOS_STATUS_INPUTS       0x40    // MCP23017 found
+#define IOS_STATUS_OLED         0x20    // SH1106 found
+#define IOS_STATUS_MASK         0xe0
+#define IOS_ADC_MASK            0x0fff
+
+#if defined(__cplusplus)
+#define IOS_JUMP_TABLE_DECL static constexpr uint8_t
+#elif defined(IOS_JUMP_TABLE_IN_RAM)
+#define IOS_JUMP_TABLE_DECL static uint8_t      // Writable, so it is placed in RAM (firmware, no flash wait states)
+#else
+#define IOS_JUMP_TABLE_DECL static const uint8_t
+#endif
+
+// Checksum lookup table, a permutation of 0-255
+IOS_JUMP_TABLE_DECL ios_jump_table[256] = {
+    0x04, 0x7d, 0x84, 0x9c, 0x49, 0x92, 0xec, 0xbb, 0xeb, 0x22, 0x74, 0xd3, 0x3e, 0xa4, 0xdd, 0x28,
+    0xc9, 0xf2, 0x25, 0xc8, 0x63, 0x26, 0x27, 0xdc, 0x18, 0xf0, 0x4a, 0xad, 0xe7, 0x6c, 0x10, 0x83,
+    0x37, 0x46, 0x0b, 0xb3, 0x86, 0xa6, 0x48, 0x69, 0x43, 0xa0, 0xd9, 0x01, 0x17, 0x38, 0x1b, 0xbd,
+    0x99, 0xb7, 0x2a, 0xba, 0x4f, 0xd7, 0x07, 0x39, 0x7a, 0xdf, 0x6f, 0x44, 0x54, 0xe4, 0x6b, 0x9d,
+    0xfd, 0x1d, 0x41, 0x1c, 0x2d, 0x76, 0x81, 0x5d, 0x55, 0x2b, 0xe2, 0x3c, 0x71, 0xcc, 0xd2, 0x61,
+    0x8f, 0x4c, 0x21, 0xf7, 0xc5, 0xd4, 0x5b, 0xc7, 0x15, 0xb6, 0x0d, 0x19, 0xe8, 0xe0, 0x29, 0x2f,
+    0xf6, 0x56, 0x8c, 0x5a, 0x45, 0x9b, 0xb2, 0x93, 0x96, 0x31, 0x08, 0xb5, 0xab, 0xbc, 0x7b, 0xda,
+    0x79, 0xe3, 0x7e, 0x6d, 0x1e, 0x13, 0xe5, 0x5c, 0xc3, 0x65, 0xfb, 0x33, 0xa2, 0x0a, 0x53, 0x78,
+    0x14, 0xd6, 0xf8, 0x2e, 0x98, 0x16, 0xc6, 0xa8, 0x00, 0x73, 0x97, 0x9f, 0xb1, 0x42, 0x3d, 0xd1,
+    0x64, 0xef, 0x24, 0xde, 0xac, 0xe9, 0x50, 0xd8, 0x03, 0xea, 0x3a, 0x34, 0xa1, 0x20, 0xfa, 0x6e,
+    0x7c, 0xc1, 0x7f, 0x80, 0xc2, 0xe6, 0xa5, 0x05, 0x23, 0x06, 0x3b, 0xe1, 0x88, 0x36, 0x12, 0x95,
+    0xcf, 0x68, 0x85, 0x94, 0x66, 0xb8, 0xfc, 0xc4, 0x75, 0x67, 0x0e, 0xf4, 0xae, 0x47, 0x5f, 0xfe,
+    0xc0, 0xff, 0x4b, 0x51, 0x5e, 0x30, 0x62, 0xf5, 0xcb, 0x60, 0xed, 0x1a, 0xd5, 0x87, 0x89, 0xee,
+    0x32, 0x09, 0xa9, 0x82, 0x02, 0x58, 0xa7, 0x8a, 0x3f, 0xbe, 0x11, 0xcd, 0x6a, 0x40, 0x0c, 0xa3,
+    0x9a, 0x8e, 0xca, 0x2c, 0xb0, 0x57, 0x77, 0x59, 0xaa, 0xb9, 0xf1, 0xb4, 0x90, 0x0f, 0xaf, 0x8b,
+    0xd0, 0xf9, 0x1f, 0x4e, 0x72, 0x52, 0xce, 0x70, 0x91, 0x35, 0xf3, 0x8d, 0xbf, 0xdb, 0x4d, 0x9e,
+};
+
+// Chain index at which each checksum is produced, the inverse of ios_jump_table
+IOS_JUMP_TABLE_DECL ios_jump_index[256] = {
+    0x88, 0x2b, 0xd4, 0x98, 0x00, 0xa7, 0xa9, 0x36, 0x6a, 0xd1, 0x7d, 0x22, 0xde, 0x5a, 0xba, 0xed,
+    0x1e, 0xda, 0xae, 0x75, 0x80, 0x58, 0x85, 0x2c, 0x18, 0x5b, 0xcb, 0x2e, 0x43, 0x41, 0x74, 0xf2,
+    0x9d, 0x52, 0x09, 0xa8, 0x92, 0x12, 0x15, 0x16, 0x0f, 0x5e, 0x32, 0x49, 0xe3, 0x44, 0x83, 0x5f,
+    0xc5, 0x69, 0xd0, 0x7b, 0x9b, 0xf9, 0xad, 0x20, 0x2d, 0x37, 0x9a, 0xaa, 0x4b, 0x8e, 0x0c, 0xd8,
+    0xdd, 0x42, 0x8d, 0x28, 0x3b, 0x64, 0x21, 0xbd, 0x26, 0x04, 0x1a, 0xc2, 0x51, 0xfe, 0xf3, 0x34,
+    0x96, 0xc3, 0xf5, 0x7e, 0x3c, 0x48, 0x61, 0xe5, 0xd5, 0xe7, 0x63, 0x56, 0x77, 0x47, 0xc4, 0xbe,
+    0xc9, 0x4f, 0xc6, 0x14, 0x90, 0x79, 0xb4, 0xb9, 0xb1, 0x27, 0xdc, 0x3e, 0x1d, 0x73, 0x9f, 0x3a,
+    0xf7, 0x4c, 0xf4, 0x89, 0x0a, 0xb8, 0x45, 0xe6, 0x7f, 0x70, 0x38, 0x6e, 0xa0, 0x01, 0x72, 0xa2,
+    0xa3, 0x46, 0xd3, 0x1f, 0x02, 0xb2, 0x24, 0xcd, 0xac, 0xce, 0xd7, 0xef, 0x62, 0xfb, 0xe1, 0x50,
+    0xec, 0xf8, 0x05, 0x67, 0xb3, 0xaf, 0x68, 0x8a, 0x84, 0x30, 0xe0, 0x65, 0x03, 0x3f, 0xff, 0x8b,
+    0x29, 0x9c, 0x7c, 0xdf, 0x0d, 0xa6, 0x25, 0xd6, 0x87, 0xd2, 0xe8, 0x6c, 0x94, 0x1b, 0xbc, 0xee,
+    0xe4, 0x8c, 0x66, 0x23, 0xeb, 0x6b, 0x59, 0x31, 0xb5, 0xe9, 0x33, 0x07, 0x6d, 0x2f, 0xd9, 0xfc,
+    0xc0, 0xa1, 0xa4, 0x78, 0xb7, 0x54, 0x86, 0x57, 0x13, 0x10, 0xe2, 0xc8, 0x4d, 0xdb, 0xf6, 0xb0,
+    0xf0, 0x8f, 0x4e, 0x0b, 0x55, 0xcc, 0x81, 0x35, 0x97, 0x2a, 0x6f, 0xfd, 0x17, 0x0e, 0x93, 0x39,
+    0x5d, 0xab, 0x4a, 0x71, 0x3d, 0x76, 0xa5, 0x1c, 0x5c, 0x95, 0x99, 0x08, 0x06, 0xca, 0xcf, 0x91,
+    0x19, 0xea, 0x11, 0xfa, 0xbb, 0xc7, 0x60, 0x53, 0x82, 0xf1, 0x9e, 0x7a, 0xb6, 0x40, 0xbf, 0xc1,
+};
+
+// Host to board frame
+typedef struct {
+    uint8_t outputs;        // Output bits 0-7
+    uint8_t flags;          // IOS_FLAG_*
+    uint8_t checksum;
+} ios_tx_frame_t;
+
+// Board to host frame
+typedef struct {
+    uint8_t inputs_lo;      // Input bits 0-7
+    uint8_t inputs_hi;      // Input bits 8-15
+    uint8_t adc_lo;         // ADC bits 0-7
+    uint8_t adc_hi_status;  // ADC bits 8-11 in the lower nibble, IOS_STATUS_* in the upper
+    uint8_t checksum;
+} ios_rx_frame_t;
+
+// One checksum chain
+typedef struct {
+    uint8_t index;
+    uint8_t resync;         // Index taken over from a mismatching frame, not confirmed yet
+} ios_chain_t;
+
+// Results of ios_check_tx() and ios_check_rx(), non-zero when the frame is accepted
+#define IOS_CHAIN_MISMATCH      0       // Wrong checksum, the chain resynchronized to the sender
+#define IOS_CHAIN_OK            1
+#define IOS_CHAIN_RELOCKED      2       // First matching frame after a resynchronization
+
+// Checksum state of one host-board link, the same layout on both ends
+typedef struct {
+    ios_chain_t tx;         // Host to board chain
+    ios_chain_t rx;         // Board to host chain
+} ios_link_t;
+
+#ifdef __cplusplus
+static_assert(sizeof(ios_tx_frame_t) == IOS_TX_FRAME_SIZE, "TX frame must be 3 bytes");
+static_assert(sizeof(ios_rx_frame_t) == IOS_RX_FRAME_SIZE, "RX frame must be 5 bytes");
+
+namespace ios_detail {
+constexpr bool jump_table_is_permutation() {
+    bool seen[256] = {};
+    for (int i = 0; i < 256; i++) {
+        if (seen[ios_jump_table[i]]) {
+            return false;
+        }
+        seen[ios_jump_table[i]] = true;
+    }
+    return true;
+}
+}
+static_assert(ios_detail::jump_table_is_permutation(), "jump table must be a permutation of 0-255");
+
+namespace ios_detail {
+constexpr bool jump_index_is_inverse() {
+    for (int i = 0; i < 256; i++) {
+        if (ios_jump_index[ios_jump_table[i]] != i) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+static_assert(ios_detail::jump_index_is_inverse(), "jump index must be the inverse of the jump table");
+#endif
+
+static inline void ios_chain_reset(ios_chain_t *chain) {
+    chain->index = IOS_CHAIN_START;
+    chain->resync = 0;
+}
+
+static inline void ios_link_reset(ios_link_t *link) {
+    ios_chain_reset(&link->tx);
+    ios_chain_reset(&link->rx);
+}
+
+// Advance a chain over a payload sum and return the checksum it expects
+static inline uint8_t ios_chain_next(ios_chain_t *chain, uint8_t payload_sum) {
+    chain->index = (uint8_t)(chain->index + payload_sum + 1);
+    return ios_jump_table[chain->index];
+}
+
+static inline uint8_t ios_tx_sum(const ios_tx_frame_t *frame) {
+    return (uint8_t)(frame->outputs + frame->flags);
+}
+
+static inline uint8_t ios_rx_sum(const ios_rx_frame_t *frame) {
+    return (uint8_t)(frame->inputs_lo + frame->inputs_hi + frame->adc_lo + frame->adc_hi_status);
+}
+
+// Host: build the next TX frame
+static inline void ios_encode_tx(ios_chain_t *chain, ios_tx_frame_t *frame, uint8_t outputs, uint8_t flags) {
+    frame->outputs = outputs;
+    frame->flags = flags;
+    frame->checksum = ios_chain_next(chain, ios_tx_sum(frame));
+}
+
+// Board: check a received TX frame, returns 1 if the checksum matches
+static inline int ios_verify_tx(ios_chain_t *chain, const ios_tx_frame_t *frame) {
+    return ios_chain_next(chain, ios_tx_sum(frame)) == frame->checksum;
+}
+
+// Board: set the checksum of an RX frame whose payload is already filled in
+static inline void ios_seal_rx(ios_chain_t *chain, ios_rx_frame_t *frame) {
+    frame->checksum = ios_chain_next(chain, ios_rx_sum(frame));
+}
+
+// Board: build the next RX frame
+static inline void ios_encode_rx(ios_chain_t *chain, ios_rx_frame_t *frame, uint16_t inputs, uint16_t adc,
+                                 uint8_t status) {
+    frame->inputs_lo = (uint8_t)(inputs & 0xff);
+    frame->inputs_hi = (uint8_t)(inputs >> 8);
+    frame->adc_lo = (uint8_t)(adc & 0xff);
+    frame->adc_hi_status = (uint8_t)(((adc >> 8) & 0x0f) | (status & IOS_STATUS_MASK));
+    ios_seal_rx(chain, frame);
+}
+
+// Host: check a received RX frame, returns 1 if the checksum matches
+static inline int ios_verify_rx(ios_chain_t *chain, const ios_rx_frame_t *frame) {
+    return ios_chain_next(chain, ios_rx_sum(frame)) == frame->checksum;
+}
+
+// Check a checksum and take over the sender's index on a mismatch (IOS_CHAIN_*).
+// Constant time, one table lookup: of the 256 possible indexes only the one the
+// sender is at produces this checksum. A random frame confirms a wrong index with
+// probability 1/256; the following frames then fail and resynchronize again.
+static inline int ios_chain_check(ios_chain_t *chain, uint8_t payload_sum, uint8_t checksum) {
+    int match = ios_chain_next(chain, payload_sum) == checksum;
+    int result = match + (match & chain->resync);
+    chain->index = match ? chain->index : ios_jump_index[checksum];
+    chain->resync = (uint8_t)!match;
+    return result;
+}
+
+// Board: check a received TX frame, resynchronizing the chain on a mismatch (IOS_CHAIN_*)
+static inline int ios_check_tx(ios_chain_t *chain, const ios_tx_frame_t *frame) {
+    return ios_chain_check(chain, ios_tx_sum(frame), frame->checksum);
+}
+
+// Host: check a received RX frame, resynchronizing the chain on a mismatch (IOS_CHAIN_*)
+static inline int ios_check_rx(ios_chain_t *chain, const ios_rx_frame_t *frame) {
+    return ios_chain_check(chain, ios_rx_sum(frame), frame->checksum);
+}
+
+// Host: advance the chain over a frame whose data is not used (late reply)
+static inline void ios_skip_rx(ios_chain_t *chain, const ios_rx_frame_t *frame) {
+    ios_chain_next(chain, ios_rx_sum(frame));
+}
+
+static inline uint16_t ios_rx_inputs(const ios_rx_frame_t *frame) {
+    return (uint16_t)(frame->inputs_hi << 8 | frame->inputs_lo);
+}
+
+static inline uint16_t ios_rx_adc(const ios_rx_frame_t *frame) {
+    return (uint16_t)((frame->adc_hi_status << 8 | frame->adc_lo) & IOS_ADC_MASK);
+}
+
+static inline uint8_t ios_rx_status(const ios_rx_frame_t *frame) {
+    return (uint8_t)(frame->adc_hi_status & IOS_STATUS_MASK);
+}
+
+#endif // IO_SAMURAI_PROTO_H
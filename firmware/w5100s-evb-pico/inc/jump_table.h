@@ -1,28 +0,0 @@
-#ifndef JUMP_TABLE_H
-#define JUMP_TABLE_H
-
-#include <stdint.h>
-
-uint8_t checksum_index = 1;
-uint8_t checksum_index_in = 1;
-
-static uint8_t jump_table[256] = {
-    0x04, 0x7d, 0x84, 0x9c, 0x49, 0x92, 0xec, 0xbb, 0xeb, 0x22, 0x74, 0xd3, 0x3e, 0xa4, 0xdd, 0x28,
-    0xc9, 0xf2, 0x25, 0xc8, 0x63, 0x26, 0x27, 0xdc, 0x18, 0xf0, 0x4a, 0xad, 0xe7, 0x6c, 0x10, 0x83,
-    0x37, 0x46, 0x0b, 0xb3, 0x86, 0xa6, 0x48, 0x69, 0x43, 0xa0, 0xd9, 0x01, 0x17, 0x38, 0x1b, 0xbd,
-    0x99, 0xb7, 0x2a, 0xba, 0x4f, 0xd7, 0x07, 0x39, 0x7a, 0xdf, 0x6f, 0x44, 0x54, 0xe4, 0x6b, 0x9d,
-    0xfd, 0x1d, 0x41, 0x1c, 0x2d, 0x76, 0x81, 0x5d, 0x55, 0x2b, 0xe2, 0x3c, 0x71, 0xcc, 0xd2, 0x61,
-    0x8f, 0x4c, 0x21, 0xf7, 0xc5, 0xd4, 0x5b, 0xc7, 0x15, 0xb6, 0x0d, 0x19, 0xe8, 0xe0, 0x29, 0x2f,
-    0xf6, 0x56, 0x8c, 0x5a, 0x45, 0x9b, 0xb2, 0x93, 0x96, 0x31, 0x08, 0xb5, 0xab, 0xbc, 0x7b, 0xda,
-    0x79, 0xe3, 0x7e, 0x6d, 0x1e, 0x13, 0xe5, 0x5c, 0xc3, 0x65, 0xfb, 0x33, 0xa2, 0x0a, 0x53, 0x78,
-    0x14, 0xd6, 0xf8, 0x2e, 0x98, 0x16, 0xc6, 0xa8, 0x00, 0x73, 0x97, 0x9f, 0xb1, 0x42, 0x3d, 0xd1,
-    0x64, 0xef, 0x24, 0xde, 0xac, 0xe9, 0x50, 0xd8, 0x03, 0xea, 0x3a, 0x34, 0xa1, 0x20, 0xfa, 0x6e,
-    0x7c, 0xc1, 0x7f, 0x80, 0xc2, 0xe6, 0xa5, 0x05, 0x23, 0x06, 0x3b, 0xe1, 0x88, 0x36, 0x12, 0x95,
-    0xcf, 0x68, 0x85, 0x94, 0x66, 0xb8, 0xfc, 0xc4, 0x75, 0x67, 0x0e, 0xf4, 0xae, 0x47, 0x5f, 0xfe,
-    0xc0, 0xff, 0x4b, 0x51, 0x5e, 0x30, 0x62, 0xf5, 0xcb, 0x60, 0xed, 0x1a, 0xd5, 0x87, 0x89, 0xee,
-    0x32, 0x09, 0xa9, 0x82, 0x02, 0x58, 0xa7, 0x8a, 0x3f, 0xbe, 0x11, 0xcd, 0x6a, 0x40, 0x0c, 0xa3,
-    0x9a, 0x8e, 0xca, 0x2c, 0xb0, 0x57, 0x77, 0x59, 0xaa, 0xb9, 0xf1, 0xb4, 0x90, 0x0f, 0xaf, 0x8b,
-    0xd0, 0xf9, 0x1f, 0x4e, 0x72, 0x52, 0xce, 0x70, 0x91, 0x35, 0xf3, 0x8d, 0xbf, 0xdb, 0x4d, 0x9e,
-};
-
-#endif // JUMP_TABLE_H
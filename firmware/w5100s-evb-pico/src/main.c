@@ -15,7 +15,8 @@
 #include "wizchip_conf.h"
 #include "socket.h"
 #include "sh1106.h"
-#include "jump_table.h"
+#define IOS_JUMP_TABLE_IN_RAM
+#include "io_samurai_proto.h"
 #include "main.h"
 #include "config.h"
 
@@ -62,7 +63,9 @@ static dma_channel_config dma_channel_config_rx;
 uint8_t src_ip[4];
 uint16_t src_port;
 
+static ios_link_t board_link = {{IOS_CHAIN_START}, {IOS_CHAIN_START}};
 uint8_t checksum_error = 0;
+uint32_t checksum_resyncs = 0;
 uint8_t timeout_error = 0;
 uint32_t last_time = 0;
 static absolute_time_t last_packet_time;
@@ -126,8 +129,7 @@ void core1_entry() {
         gpio_put(LED_PIN, !timeout_error);
 
         if (time_diff > TIMEOUT_US) {
-            checksum_index = 1;
-            checksum_index_in = 1;
+            ios_link_reset(&board_link);
             timeout_error = 1;
             checksum_error = 0;
             src_ip[0] = 0;
@@ -349,19 +351,18 @@ void __time_critical_func(calculate_checksum)(uint8_t *data, uint8_t len) {
     data[len] = sum;
 }
 
+// A frame with a wrong checksum switches the outputs off and the chain takes over the
+// host's index, so the next good frame clears the error (lost or reordered frame)
 void __time_critical_func(jump_table_checksum)() {
-    if (checksum_error == 0) {
-        checksum_index += (uint8_t)(rx_buffer[0] + rx_buffer[1] + 1);
-        uint8_t checksum = jump_table[checksum_index];
-        if (checksum != rx_buffer[2]) {
-            checksum_error = 1;
-        }
+    int check = ios_check_tx(&board_link.tx, (const ios_tx_frame_t *)rx_buffer);
+    if (check == IOS_CHAIN_RELOCKED) {
+        checksum_resyncs++;
     }
+    checksum_error = check == IOS_CHAIN_MISMATCH;
 }
 
 void __time_critical_func(jump_table_checksum_in)() {
-    checksum_index_in += (uint8_t)(tx_buffer[0] + tx_buffer[1] + tx_buffer[2] + tx_buffer[3] + 1);
-    tx_buffer[4] = jump_table[checksum_index_in];
+    ios_seal_rx(&board_link.rx, (ios_rx_frame_t *)tx_buffer);
 }
 
 
@@ -10,6 +10,7 @@ char buffer[64];
 int buffer_pos = 0;
 extern wiz_NetInfo net_info;
 extern uint32_t TIMEOUT_US;
+extern uint32_t checksum_resyncs;
 extern configuration_t *flash_config;
 extern uint16_t port;
 extern void reset_with_watchdog();
@@ -90,6 +91,7 @@ void process_command(char* command) {
         printf("Timeout: %d\n", TIMEOUT_US);
         printf("ADC min: %d\n", adc_min);
         printf("ADC max: %d\n", adc_max);
+        printf("Checksum resyncs: %lu\n", (unsigned long)checksum_resyncs);
         printf("Ready.\n");
     }
     else if (strcmp(command, "reboot") == 0) {
@@ -1,17 +1,29 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* sendmmsg, recvmmsg */
+#endif
 #include "rtapi.h"              /* RTAPI realtime OS API */
 #include "rtapi_app.h"          /* RTAPI realtime module decls */
 #include "rtapi_errno.h"        /* EINVAL etc */
 #include "hal.h"                /* HAL public API decls */
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <ifaddrs.h>
+#include <time.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <math.h>
 #include <stdlib.h>
-#include "../firmware/w5100s-evb-pico/inc/jump_table.h"
+#include "../firmware/w5100s-evb-pico/inc/io_samurai_proto.h"
 
 /* module information */
 MODULE_AUTHOR("Viola Zsolt");
@@ -21,16 +33,57 @@ MODULE_LICENSE("MIT");
 // to parse the modparam
 char *ip_address[128] = {0,};
 RTAPI_MP_ARRAY_STRING(ip_address, 128, "Ip address");
+char *transport = "udp";
+RTAPI_MP_STRING(transport, "udp, or packet for AF_PACKET with mmap rings (needs CAP_NET_RAW)");
 
 #define ALPHA 0.1f  // Low-pass filter constant (EMA)
 #define ADC_MAX 4095.0f // Maximum ADC value (12-bit resolution)
 #define MAX_CHAN 8
+#define RESYNC_LIMIT 2  // Replies in a row that may fail the checksum while the chain relocks, more break io-ready-out
+#define LATE_LIMIT 2    // Periods in a row read-all may find no reply, more break io-ready-out...
+#define LATE_MIN_NS 1000000LL // ...once they also add up to 1 ms (short servo periods)
+#define WATCHDOG_TIMEOUT_NS 10000000LL // 10 ms without a valid reply expires the watchdog
+#define RECOVERY_HEARTBEAT_NS 2000000LL // Resync frames at most every 2 ms while the board is silent
+#define RECOVERY_GOOD_REPLIES 8         // Accepted replies in a row that verify a relocked link
+#define SENT_FRAMES 8    // Frames remembered for matching replies to them
+#define STAMP_SPACE CMSG_SPACE(sizeof(struct timespec)) // SO_TIMESTAMPNS control message
+#define JITTER_GAIN 16   // Smoothing of the round trip jitter estimate (RFC 3550)
+#define EXEC_AVG_GAIN 64 // Smoothing of the rolling average execution time
+#define EXEC_LOG_INTERVAL_NS 1000000000LL // At most one exec-limit message per funct and second
+
+// AF_PACKET transport: Ethernet + IPv4 + UDP headers, rings of 64 frames of 256 bytes
+#define PKT_HEADERS 42
+#define PKT_MIN_FRAME 60
+#define PKT_FRAME_SIZE 256
+#define PKT_BLOCK_SIZE 4096
+#define PKT_FRAMES 64
+#define PKT_TX_DATA TPACKET_ALIGN(sizeof(struct tpacket2_hdr))
 
 typedef struct {
     char ip[16]; // Holds IPv4 address (max 15 characters)
     int port;
 } IpPort;
 
+// Link recovery after a watchdog expiry, the value of the recovery-state pin
+enum {
+    RECOVERY_LINKED = 0,       // Normal operation
+    RECOVERY_RESYNC = 1,       // Watchdog expired, throttled heartbeats until the board answers
+    RECOVERY_VERIFY = 2,       // Chain relocked, waiting for RECOVERY_GOOD_REPLIES good replies
+    RECOVERY_WAIT_READY = 3,   // Link verified, io-ready-out stays low until io-ready-in toggles
+};
+
+
+// Execution time of one exported funct in rtapi_get_clocks() ticks
+typedef struct {
+    hal_s32_t *last;
+    hal_s32_t *max;                // HAL_IO, setp to 0 to restart
+    hal_s32_t *avg;                // Rolling average
+    hal_s32_t limit;               // Parameter: log runs that take longer, 0 = off
+    long long average;
+    long long last_log;            // rtapi_get_time() of the last message
+    int over;                      // Runs over the limit since the last message
+    char name[48];
+} exec_timing_t;
 
 typedef struct {
     hal_float_t *analog_in;
@@ -47,25 +100,97 @@ typedef struct {
     hal_bit_t *io_ready_in;  
     hal_bit_t *io_ready_out;
     hal_bit_t *oled_off; 
+    hal_s32_t *resync_count;       // Checksum chain relocks after lost or reordered replies
+    hal_s32_t *reply_age;          // Periods since the decoded inputs arrived, 0 within the last period
+    hal_s32_t *rtt;                // Last round trip in ns, from the send to the funct that read the reply
+    hal_s32_t *rtt_max;            // Longest round trip since the last reset
+    hal_s32_t *rtt_jitter;         // Smoothed difference between consecutive round trips
+    hal_s32_t *missed_replies;     // Frames without a reply within the late limit
+    hal_s32_t *checksum_errors;    // Replies rejected by the checksum chain
+    hal_s32_t *short_packets;      // Replies with the wrong length
+    hal_s32_t *watchdog_trips;     // Watchdog expiries
+    hal_s32_t *recovery_state;     // RECOVERY_*
+    hal_s32_t *recovery_time;      // ms from the watchdog expiry to the verified link
+    hal_bit_t *reset_stats;        // Rising edge clears the counters and rtt-max
+    bool reset_stats_last;
+    exec_timing_t watchdog_exec;
+    exec_timing_t send_exec;
+    exec_timing_t recv_exec;
     IpPort *ip_address; 
-    int sockfd;
+    int sockfd;                    // -1 when an earlier instance holds the port or the setup failed
     struct sockaddr_in local_addr, remote_addr;
-    uint8_t rx_buffer[5];
-    uint8_t tx_buffer[3];
+    bool address_valid;            // remote_addr holds the board address
+    int batch_socket;              // Index in batch.sockets, -1 if process-all cannot reach the board
+    ios_rx_frame_t rx_frame;
+    ios_tx_frame_t tx_frame;
     long long last_received_time;
-    long long watchdog_timeout;
-    int watchdog_expired; 
+    long long input_arrival;       // rtapi_get_time() the reply behind the input pins arrived
+    long long watchdog_timeout;    // ns
+    int recovery;                  // RECOVERY_*
+    int recovery_good;             // Accepted replies in a row while verifying
+    bool ready_seen_low;           // io-ready-in was low since the link was verified
+    long long recovery_start;      // rtapi_get_time() of the watchdog expiry
+    long long last_heartbeat;      // rtapi_get_time() of the last resync frame
     long long current_time;
     int index;
-    uint8_t checksum_index;
-    uint8_t checksum_index_in;
+    ios_link_t link;
+    int resync_rejected;           // Replies rejected since the chain lost step
+    long long sent_time[SENT_FRAMES];  // rtapi_get_time() of the recent frames, oldest first
+    bool sent_answered[SENT_FRAMES];
+    int sent_first;
+    int sent_count;
+    long long last_rtt;
+    long long jitter;
+    long long last_reply_ns;       // rtapi_get_time() of the last valid reply
     bool watchdog_running;
     bool error_triggered;
+    int packet_fd;                 // AF_PACKET socket, -1 when the UDP socket is used
+    uint8_t *ring;                 // RX ring followed by the TX ring
+    size_t ring_size;
+    unsigned rx_index;
+    unsigned tx_index;
+    uint8_t header_template[PKT_HEADERS];
 } io_samurai_data_t;
 
+// process-all: the frames of every instance go out with one sendmmsg() per board port and the
+// replies come back with one recvmmsg() per port, routed to the instances by source address.
+// A board answers the host port it heard from first, so each port is served by the socket of
+// the first instance bound to it, the same socket its per-instance functs use.
+#define BATCH_QUEUE 4               // Replies of one instance waiting for their period
+#define BATCH_FRAMES (MAX_CHAN * BATCH_QUEUE) // Replies read per period
+
+typedef struct {
+    int sockets[MAX_CHAN];          // One per board port, borrowed from the instances
+    int socket_count;
+    struct mmsghdr tx_msgs[MAX_CHAN];
+    struct iovec tx_iov[MAX_CHAN];
+    struct mmsghdr rx_msgs[BATCH_FRAMES];
+    struct iovec rx_iov[BATCH_FRAMES];
+    struct sockaddr_in rx_addrs[BATCH_FRAMES];
+    char rx_stamps[BATCH_FRAMES][STAMP_SPACE];  // SO_TIMESTAMPNS of each reply
+    ios_rx_frame_t rx_frames[BATCH_FRAMES];
+    // Replies are handed to an instance one per period, like the per-instance socket queue
+    // does, so a reply that comes in early does not leave the next period empty
+    struct {
+        ios_rx_frame_t frame;
+        int len;
+        long long arrival;         // rtapi_get_time()
+    } queue[MAX_CHAN][BATCH_QUEUE];
+    int queued[MAX_CHAN];
+} io_samurai_batch_t;
+
 static int instances = 0; // Példányok száma
 static int comp_id = -1; // HAL komponens azonosító
 static io_samurai_data_t *hal_data; // Pointer a megosztott memóriában lévő adatra
+static io_samurai_batch_t batch;
+
+typedef struct {
+    exec_timing_t process_all;
+    exec_timing_t read_all;
+    exec_timing_t write_all;
+} batch_exec_t;
+
+static batch_exec_t *batch_exec; // In HAL memory for the exec-limit parameters
 
 // Low-pass filter function (EMA)
 float low_pass_filter(float new_sample, float previous_filtered, bool *first_sample) {
@@ -104,29 +229,56 @@ float scale_adc(uint16_t adc_in, float min_value, float max_value) {
  * @arg: Pointer to an io_samurai_data_t structure containing socket configuration data.
  *
  * Description:
- *   - Creates a UDP socket and binds it to the local address and port specified in the ip_address field.
- *   - Sets the socket to non-blocking mode.
- *   - Configures the remote address for communication using the provided IP and port.
+ *   - Sets up the remote address from the ip_address field first, so process-all can reach the
+ *     board even without a socket of its own.
+ *   - Creates a UDP socket and binds it to the board port on INADDR_ANY, the port the board
+ *     latches on the first frame it answers.
+ *   - Sets the socket to non-blocking mode with kernel receive timestamps.
  *   - Logs errors using rtapi_print_msg and closes the socket on failure.
  *
  * Notes:
- *   - The socket is bound to INADDR_ANY to accept packets from any interface.
- *   - If socket creation, binding, or IP address parsing fails, the socket is closed, and sockfd is set to -1.
- *   - The function assumes the ip_address field in the io_samurai_data_t structure is valid.
+ *   - A board on the port of an earlier instance (boards on separate addresses all on 8888)
+ *     gets no socket: only one socket can be bound to the port, and process-all or
+ *     read-all/write-all drive the board over the earlier instance's socket.
+ *   - If the IP address is invalid, socket creation or binding fails, sockfd is -1.
  */
 static void init_socket(io_samurai_data_t *arg) {
     io_samurai_data_t *d = arg;
 
-    if ((d->sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: socket creation failed: %s\n", 
-                       d->index, strerror(errno));
+    d->sockfd = -1;
+    d->address_valid = false;
+
+    memset(&d->remote_addr, 0, sizeof(d->remote_addr));
+    d->remote_addr.sin_family = AF_INET;
+    d->remote_addr.sin_port = htons(d->ip_address->port);
+    if (inet_pton(AF_INET, d->ip_address->ip, &d->remote_addr.sin_addr) <= 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: invalid IP address: %s\n",
+                       d->index, d->ip_address->ip);
         return;
     }
+    d->address_valid = true;
 
+    memset(&d->local_addr, 0, sizeof(d->local_addr));
     d->local_addr.sin_family = AF_INET;
     d->local_addr.sin_port = htons(d->ip_address->port);
     d->local_addr.sin_addr.s_addr = INADDR_ANY;
 
+    for (int j = 0; j < d->index; j++) {
+        if (hal_data[j].sockfd >= 0 && hal_data[j].local_addr.sin_port == d->local_addr.sin_port) {
+            rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: port %d is bound by io-samurai.%d, "
+                            "drive this board with process-all or read-all/write-all\n",
+                            d->index, d->ip_address->port, j);
+            return;
+        }
+    }
+
+    if ((d->sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: socket creation failed: %s\n", 
+                       d->index, strerror(errno));
+        d->sockfd = -1;
+        return;
+    }
+
     rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: binding to %s:%d\n",
                    d->index, d->ip_address->ip, d->ip_address->port);
 
@@ -141,21 +293,484 @@ static void init_socket(io_samurai_data_t *arg) {
     // Set non-blocking
     int flags = fcntl(d->sockfd, F_GETFL, 0);
     fcntl(d->sockfd, F_SETFL, flags | O_NONBLOCK);
-    
-    // Setup remote address
-    d->remote_addr.sin_family = AF_INET;
-    d->remote_addr.sin_port = htons(d->ip_address->port);
-    if (inet_pton(AF_INET, d->ip_address->ip, &d->remote_addr.sin_addr) <= 0) {
-        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: invalid IP address: %s\n",
-                       d->index, d->ip_address->ip);
-        close(d->sockfd);
-        d->sockfd = -1;
+
+    // Kernel receive timestamps for the round trip pins
+    int on = 1;
+    setsockopt(d->sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+}
+
+/*
+ * init_batch_sockets - Picks the sockets process-all drives the instances with.
+ *
+ * Description:
+ *   - Every instance with a valid address gets the UDP socket bound to its board port: its own,
+ *     or that of the first instance on the same port. Frames therefore leave from the port the
+ *     board latched, whichever of the functs sent the first one, and switching between the
+ *     per-instance functs and process-all keeps the boards answering.
+ *   - Points every receive slot at its own reply buffer and source address, the send slots
+ *     get the frame and remote address of an instance in every period.
+ *
+ * Notes:
+ *   - Instances on the packet transport keep their rings. Their UDP socket drops everything,
+ *     so a board sharing its port without a ring of its own cannot be reached (logged).
+ *   - An instance without a socket is left out of the batch, its watchdog keeps io-ready-out low.
+ */
+static void init_batch_sockets(void) {
+    batch.socket_count = 0;
+    for (int j = 0; j < instances; j++) {
+        io_samurai_data_t *d = &hal_data[j];
+        d->batch_socket = -1;
+        if (!d->address_valid || d->ring) {
+            continue;
+        }
+        int owner = -1;
+        for (int k = 0; k <= j && owner < 0; k++) {
+            if (hal_data[k].sockfd >= 0 && hal_data[k].local_addr.sin_port == d->remote_addr.sin_port) {
+                owner = k;
+            }
+        }
+        if (owner < 0 || hal_data[owner].ring) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: no UDP socket on port %d for process-all\n",
+                            j, d->ip_address->port);
+            continue;
+        }
+        int s = 0;
+        while (s < batch.socket_count && batch.sockets[s] != hal_data[owner].sockfd) {
+            s++;
+        }
+        if (s == batch.socket_count) {
+            batch.sockets[batch.socket_count++] = hal_data[owner].sockfd;
+        }
+        d->batch_socket = s;
+    }
+
+    memset(batch.tx_msgs, 0, sizeof(batch.tx_msgs));
+    for (int i = 0; i < MAX_CHAN; i++) {
+        batch.tx_iov[i].iov_len = IOS_TX_FRAME_SIZE;
+        batch.tx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        batch.tx_msgs[i].msg_hdr.msg_iov = &batch.tx_iov[i];
+        batch.tx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    memset(batch.rx_msgs, 0, sizeof(batch.rx_msgs));
+    for (int i = 0; i < BATCH_FRAMES; i++) {
+        batch.rx_iov[i].iov_base = &batch.rx_frames[i];
+        batch.rx_iov[i].iov_len = IOS_RX_FRAME_SIZE;
+        batch.rx_msgs[i].msg_hdr.msg_name = &batch.rx_addrs[i];
+        batch.rx_msgs[i].msg_hdr.msg_iov = &batch.rx_iov[i];
+        batch.rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        batch.rx_msgs[i].msg_hdr.msg_control = batch.rx_stamps[i];
+    }
+    rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai: process-all uses %d socket(s)\n", batch.socket_count);
+}
+
+/*
+ * resolve_link - Finds the interface, the source address and both MAC addresses for a board.
+ *
+ * @d: Instance with remote_addr set up.
+ * @ifindex: Receives the interface index.
+ * @local_ip: Receives the source IPv4 address the route to the board uses.
+ * @local_mac, @remote_mac: Receive the MAC addresses (6 bytes each).
+ *
+ * Returns:
+ *   - 0 on success, -1 if the board is not on a directly connected Ethernet network
+ *     or its MAC address is not resolved within one second.
+ *
+ * Notes:
+ *   - An empty datagram to the discard port (9) starts the ARP request, the board's
+ *     protocol port and checksum chains are not touched.
+ */
+static int resolve_link(io_samurai_data_t *d, int *ifindex, struct in_addr *local_ip,
+                        uint8_t *local_mac, uint8_t *remote_mac) {
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probe < 0) {
+        return -1;
+    }
+    struct sockaddr_in probe_addr = d->remote_addr;
+    probe_addr.sin_port = htons(9);
+    struct sockaddr_in source;
+    socklen_t source_len = sizeof(source);
+    if (connect(probe, (struct sockaddr *)&probe_addr, sizeof(probe_addr)) < 0 ||
+        getsockname(probe, (struct sockaddr *)&source, &source_len) < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: no route to %s\n", d->index, d->ip_address->ip);
+        close(probe);
+        return -1;
+    }
+    *local_ip = source.sin_addr;
+
+    char ifname[IF_NAMESIZE] = {0};
+    struct ifaddrs *list = NULL;
+    if (getifaddrs(&list) == 0) {
+        for (struct ifaddrs *entry = list; entry; entry = entry->ifa_next) {
+            if (entry->ifa_addr && entry->ifa_addr->sa_family == AF_INET &&
+                ((struct sockaddr_in *)entry->ifa_addr)->sin_addr.s_addr == local_ip->s_addr) {
+                snprintf(ifname, sizeof(ifname), "%s", entry->ifa_name);
+                break;
+            }
+        }
+        freeifaddrs(list);
+    }
+    *ifindex = ifname[0] ? (int)if_nametoindex(ifname) : 0;
+
+    struct ifreq request;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.ifr_name, sizeof(request.ifr_name), "%s", ifname);
+    if (*ifindex == 0 || ioctl(probe, SIOCGIFHWADDR, &request) < 0 ||
+        request.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: no Ethernet interface to %s\n", d->index, d->ip_address->ip);
+        close(probe);
+        return -1;
     }
+    memcpy(local_mac, request.ifr_hwaddr.sa_data, 6);
+
+    for (int attempt = 0; attempt < 100; attempt++) {
+        struct arpreq entry;
+        memset(&entry, 0, sizeof(entry));
+        memcpy(&entry.arp_pa, &d->remote_addr, sizeof(d->remote_addr));
+        ((struct sockaddr_in *)&entry.arp_pa)->sin_port = 0;
+        snprintf(entry.arp_dev, sizeof(entry.arp_dev), "%s", ifname);
+        if (ioctl(probe, SIOCGARP, &entry) == 0 && (entry.arp_flags & ATF_COM)) {
+            memcpy(remote_mac, entry.arp_ha.sa_data, 6);
+            rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: %s is %02x:%02x:%02x:%02x:%02x:%02x on %s\n",
+                            d->index, d->ip_address->ip, remote_mac[0], remote_mac[1], remote_mac[2],
+                            remote_mac[3], remote_mac[4], remote_mac[5], ifname);
+            close(probe);
+            return 0;
+        }
+        if (attempt == 0) {
+            send(probe, "", 0, MSG_DONTWAIT);
+        }
+        usleep(10000);
+    }
+    rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: MAC address of %s not resolved\n", d->index, d->ip_address->ip);
+    close(probe);
+    return -1;
+}
+
+/*
+ * init_packet_socket - Switches an instance from its UDP socket to an AF_PACKET socket with mmap rings.
+ *
+ * @d: Instance whose UDP socket is already set up by init_socket().
+ *
+ * Description:
+ *   - Opens a TPACKET_V2 socket with a 64 frame RX ring and a 64 frame TX ring in one mapping.
+ *   - A BPF filter passes only UDP from the board's address and port to the local port.
+ *   - The Ethernet, IPv4 and UDP headers of outgoing frames are precomputed, sending is a
+ *     header copy plus the 3 byte frame and receiving reads the reply in place from the ring.
+ *   - The UDP socket stays bound to the port with a drop-all filter, so the kernel answers
+ *     the replies with no ICMP port unreachable and queues nothing.
+ *
+ * Notes:
+ *   - TPACKET_V3 is not used: it hands over whole blocks, only when a block is full or its
+ *     timeout (milliseconds) expires, which would delay every tiny reply by up to a cycle.
+ *   - On failure the instance keeps using the UDP socket.
+ */
+static int init_packet_socket(io_samurai_data_t *d) {
+    int ifindex;
+    struct in_addr local_ip;
+    uint8_t local_mac[6], remote_mac[6];
+    if (resolve_link(d, &ifindex, &local_ip, local_mac, remote_mac) < 0) {
+        return -1;
+    }
+
+    // Protocol 0 receives nothing until bind(), so no frame gets into the ring before the filter
+    int fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: packet socket creation failed: %s\n",
+                        d->index, strerror(errno));
+        return -1;
+    }
+
+    int version = TPACKET_V2;
+    struct tpacket_req req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = PKT_BLOCK_SIZE;
+    req.tp_frame_size = PKT_FRAME_SIZE;
+    req.tp_frame_nr = PKT_FRAMES;
+    req.tp_block_nr = PKT_FRAMES / (PKT_BLOCK_SIZE / PKT_FRAME_SIZE);
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+        setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 ||
+        setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: packet ring setup failed: %s\n", d->index, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    // IPv4, UDP, not a fragment, from the board's address and port to our port
+    uint32_t ports = (uint32_t)ntohs(d->remote_addr.sin_port) << 16 | (uint16_t)d->ip_address->port;
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 10),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 8),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 26),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(d->remote_addr.sin_addr.s_addr), 0, 6),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+        BPF_STMT(BPF_LD | BPF_W | BPF_IND, 14),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ports, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xffff),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog program = { sizeof(code) / sizeof(code[0]), code };
+    struct sock_filter drop_all[] = { BPF_STMT(BPF_RET | BPF_K, 0) };
+    struct sock_fprog drop_program = { 1, drop_all };
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: packet filter failed: %s\n", d->index, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    size_t ring_size = 2 * (size_t)req.tp_block_size * req.tp_block_nr;
+    void *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE | MAP_LOCKED, fd, 0);
+    if (ring == MAP_FAILED) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: packet ring mapping failed: %s\n", d->index, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_ll link_addr;
+    memset(&link_addr, 0, sizeof(link_addr));
+    link_addr.sll_family = AF_PACKET;
+    link_addr.sll_protocol = htons(ETH_P_IP);
+    link_addr.sll_ifindex = ifindex;
+    if (bind(fd, (struct sockaddr *)&link_addr, sizeof(link_addr)) < 0 ||
+        setsockopt(d->sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &drop_program, sizeof(drop_program)) < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: packet socket bind failed: %s\n", d->index, strerror(errno));
+        munmap(ring, ring_size);
+        close(fd);
+        return -1;
+    }
+
+    // Header template, the lengths and the IP checksum are filled in per frame
+    uint8_t *h = d->header_template;
+    memset(h, 0, PKT_HEADERS);
+    memcpy(h, remote_mac, 6);
+    memcpy(h + 6, local_mac, 6);
+    h[12] = ETH_P_IP >> 8;
+    h[13] = ETH_P_IP & 0xff;
+    h[14] = 0x45;                  // IPv4, no options
+    h[20] = 0x40;                  // Don't fragment, identification stays 0
+    h[22] = 64;                    // TTL
+    h[23] = IPPROTO_UDP;
+    memcpy(h + 26, &local_ip.s_addr, 4);
+    memcpy(h + 30, &d->remote_addr.sin_addr.s_addr, 4);
+    h[34] = (uint8_t)(d->ip_address->port >> 8);
+    h[35] = (uint8_t)(d->ip_address->port & 0xff);
+    memcpy(h + 36, &d->remote_addr.sin_port, 2);   // UDP checksum stays 0 (optional over IPv4)
+
+    d->packet_fd = fd;
+    d->ring = ring;
+    d->ring_size = ring_size;
+    d->rx_index = 0;
+    d->tx_index = 0;
+    return 0;
+}
+
+// Send one datagram through the TX ring, returns -1 if the slot is still owned by the kernel
+static int packet_send(io_samurai_data_t *d, const void *payload, size_t len) {
+    uint8_t *slot = d->ring + (size_t)(PKT_FRAMES + d->tx_index) * PKT_FRAME_SIZE;
+    struct tpacket2_hdr *hdr = (struct tpacket2_hdr *)slot;
+    if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+        return -1;
+    }
+    uint8_t *frame = slot + PKT_TX_DATA;
+    memcpy(frame, d->header_template, PKT_HEADERS);
+    uint16_t ip_len = (uint16_t)(28 + len);
+    frame[16] = (uint8_t)(ip_len >> 8);
+    frame[17] = (uint8_t)(ip_len & 0xff);
+    uint32_t sum = 0;
+    for (int i = 14; i < 34; i += 2) {
+        sum += (uint32_t)(frame[i] << 8 | frame[i + 1]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    frame[24] = (uint8_t)(~sum >> 8);
+    frame[25] = (uint8_t)(~sum & 0xff);
+    frame[38] = (uint8_t)((8 + len) >> 8);
+    frame[39] = (uint8_t)((8 + len) & 0xff);
+    memcpy(frame + PKT_HEADERS, payload, len);
+    size_t frame_len = PKT_HEADERS + len;
+    if (frame_len < PKT_MIN_FRAME) {
+        memset(frame + frame_len, 0, PKT_MIN_FRAME - frame_len);
+        frame_len = PKT_MIN_FRAME;
+    }
+    hdr->tp_len = (uint32_t)frame_len;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    d->tx_index = (d->tx_index + 1) % PKT_FRAMES;
+    return (int)send(d->packet_fd, NULL, 0, MSG_DONTWAIT);
+}
+
+// Next reply in the RX ring, *payload points into the ring until packet_release(); -1 if none arrived.
+// *realtime receives the kernel receive timestamp (CLOCK_REALTIME ns).
+static int packet_recv(io_samurai_data_t *d, const uint8_t **payload, long long *realtime) {
+    while (1) {
+        struct tpacket2_hdr *hdr = (struct tpacket2_hdr *)(d->ring + (size_t)d->rx_index * PKT_FRAME_SIZE);
+        if (!(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            return -1;
+        }
+        const uint8_t *frame = (const uint8_t *)hdr + hdr->tp_mac;
+        size_t ip_len = (frame[14] & 0x0f) * 4u;
+        if (ip_len >= 20 && hdr->tp_snaplen >= 14 + ip_len + 8) {
+            const uint8_t *udp = frame + 14 + ip_len;
+            size_t udp_len = (size_t)(udp[4] << 8 | udp[5]);
+            if (udp_len >= 8 && 14 + ip_len + udp_len <= hdr->tp_snaplen) {
+                *payload = udp + 8;
+                *realtime = (long long)hdr->tp_sec * 1000000000LL + hdr->tp_nsec;
+                return (int)(udp_len - 8);
+            }
+        }
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE); // Malformed, skip it
+        d->rx_index = (d->rx_index + 1) % PKT_FRAMES;
+    }
+}
+
+// Give the frame returned by packet_recv() back to the kernel
+static void packet_release(io_samurai_data_t *d) {
+    struct tpacket2_hdr *hdr = (struct tpacket2_hdr *)(d->ring + (size_t)d->rx_index * PKT_FRAME_SIZE);
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    d->rx_index = (d->rx_index + 1) % PKT_FRAMES;
+}
+
+// Saturate a nanosecond value to an s32 pin
+static int32_t ns_pin(long long ns) {
+    return ns > INT32_MAX ? INT32_MAX : (int32_t)ns;
+}
+
+// Offset from CLOCK_REALTIME (socket receive timestamps) to rtapi_get_time()
+static long long realtime_offset(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return rtapi_get_time() - ((long long)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+// Arrival of a datagram in rtapi_get_time() from its SO_TIMESTAMPNS, fallback if it has none
+static long long arrival_time(struct msghdr *msg, long long offset, long long fallback) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec + offset;
+        }
+    }
+    return fallback;
+}
+
+// Remember the send time of a frame, the oldest one counts as missed if it has no reply yet
+static void frame_sent(io_samurai_data_t *d, long long now) {
+    if (d->sent_count == SENT_FRAMES) {
+        if (!d->sent_answered[d->sent_first]) {
+            *d->missed_replies += 1;
+        }
+        d->sent_first = (d->sent_first + 1) % SENT_FRAMES;
+        d->sent_count--;
+    }
+    int slot = (d->sent_first + d->sent_count) % SENT_FRAMES;
+    d->sent_time[slot] = now;
+    d->sent_answered[slot] = false;
+    d->sent_count++;
+}
+
+// A reply that arrived at the given time belongs to the newest frame sent before it (the boards
+// answer within a fraction of a period); round trip statistics come from valid replies only
+static void reply_arrived(io_samurai_data_t *d, long long arrival, int valid) {
+    int slot = -1;
+    for (int i = d->sent_count - 1; i >= 0; i--) {
+        int candidate = (d->sent_first + i) % SENT_FRAMES;
+        if (d->sent_time[candidate] <= arrival) {
+            slot = candidate;
+            break;
+        }
+    }
+    if (slot < 0 || d->sent_answered[slot]) {
+        return;  // A late reply, its frame is already matched or forgotten
+    }
+    d->sent_answered[slot] = true;
+    if (!valid) {
+        return;
+    }
+    long long rtt = arrival - d->sent_time[slot];
+    if (d->last_rtt > 0) {
+        long long diff = rtt > d->last_rtt ? rtt - d->last_rtt : d->last_rtt - rtt;
+        d->jitter += (diff - d->jitter) / JITTER_GAIN;
+    }
+    d->last_rtt = rtt;
+    d->last_reply_ns = arrival;
+    *d->rtt = ns_pin(rtt);
+    if (*d->rtt > *d->rtt_max) {
+        *d->rtt_max = *d->rtt;
+    }
+    *d->rtt_jitter = ns_pin(d->jitter);
+}
+
+// Forget the frames older than read-all tolerates, the unanswered ones count as missed
+static void expire_frames(io_samurai_data_t *d, long long now, long period) {
+    long long timeout = (LATE_LIMIT + 1) * (long long)period;
+    if (timeout < LATE_MIN_NS) {
+        timeout = LATE_MIN_NS;
+    }
+    while (d->sent_count > 0 && now - d->sent_time[d->sent_first] > timeout) {
+        if (!d->sent_answered[d->sent_first]) {
+            *d->missed_replies += 1;
+        }
+        d->sent_first = (d->sent_first + 1) % SENT_FRAMES;
+        d->sent_count--;
+    }
+}
+
+// Clear the counters and rtt-max on a rising edge of reset-stats
+static void check_reset_stats(io_samurai_data_t *d) {
+    if (*d->reset_stats && !d->reset_stats_last) {
+        *d->rtt_max = 0;
+        *d->missed_replies = 0;
+        *d->checksum_errors = 0;
+        *d->short_packets = 0;
+        *d->watchdog_trips = 0;
+        *d->resync_count = 0;
+        *d->watchdog_exec.max = 0;
+        *d->send_exec.max = 0;
+        *d->recv_exec.max = 0;
+    }
+    d->reset_stats_last = *d->reset_stats;
+}
+
+// Record the run of a funct that started at the given rtapi_get_clocks() value
+static void exec_time(exec_timing_t *t, long long start) {
+    long long clocks = rtapi_get_clocks() - start;
+    *t->last = clocks > INT32_MAX ? INT32_MAX : (int32_t)clocks;
+    if (*t->last > *t->max) {
+        *t->max = *t->last;
+    }
+    t->average += (clocks - t->average) / EXEC_AVG_GAIN;
+    *t->avg = (int32_t)t->average;
+    if (t->limit > 0 && clocks > t->limit) {
+        t->over++;
+        long long now = rtapi_get_time();
+        if (now - t->last_log >= EXEC_LOG_INTERVAL_NS) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "%s: took %lld clocks, exec-limit %d exceeded %d times\n",
+                            t->name, clocks, (int)t->limit, t->over);
+            t->last_log = now;
+            t->over = 0;
+        }
+    }
+}
+
+// The link is down or not verified yet: inputs are held, outputs sent as 0, io-ready-out low
+static int recovering(const io_samurai_data_t *d) {
+    return d->recovery == RECOVERY_RESYNC || d->recovery == RECOVERY_VERIFY;
 }
 
 // Watchdog process
-void watchdog_process(void *arg, long period) {
-    io_samurai_data_t *d = arg;
+static void run_watchdog(io_samurai_data_t *d, long period) {
+    long long now = rtapi_get_time();
+    check_reset_stats(d);
+    expire_frames(d, now, period);
+    // From the arrival of the reply, a queued one decoded a few periods late shows its real age
+    *d->reply_age = ns_pin((now - d->input_arrival) / period);
+    *d->current_tm = ns_pin(now - d->last_reply_ns);
     d->current_time += 1; 
     d->watchdog_running = 1; 
     
@@ -163,40 +778,101 @@ void watchdog_process(void *arg, long period) {
     if (elapsed < 0) {
         elapsed = 0; 
     }
-    if (elapsed > d->watchdog_timeout) {
-        if (d->watchdog_expired == 0) {
-            rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: watchdog timeout error, please restart Linuxcnc\n", d->index);
-            d->checksum_index_in = 1;  // Reset checksum index
-            d->checksum_index = 1;     // Reset checksum index
+    // Periods times the period, so the timeout stays 10 ms for any servo period
+    if (elapsed * period > d->watchdog_timeout) {
+        if (d->recovery == RECOVERY_LINKED || d->recovery == RECOVERY_WAIT_READY) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: watchdog timeout error, resynchronizing the link\n", d->index);
+            ios_link_reset(&d->link);  // Reset checksum indexes
+            d->resync_rejected = 0;
+            d->sent_count = 0;
+            d->recovery_start = now;
+            d->last_heartbeat = now - RECOVERY_HEARTBEAT_NS;  // First heartbeat in the next send
+            *d->watchdog_trips += 1;
         }
-        d->watchdog_expired = 1; 
-    } else {
-        d->watchdog_expired = 0; 
+        d->recovery = RECOVERY_RESYNC;
+        d->recovery_good = 0;
     }
-    
-}
 
-// parse inputs
-void udp_io_process_recv(void *arg, long period) {
-    io_samurai_data_t *d = arg;
-    if (d->watchdog_expired) {
+    if (recovering(d)) {
         *d->io_ready_out = 0;
+        *d->connected = 0;
+        *d->recovery_time = ns_pin((now - d->recovery_start) / 1000000);
+    } else if (d->recovery == RECOVERY_WAIT_READY) {
+        // A falling and a rising edge of io-ready-in, so the estop loop has to be reset on purpose
+        if (!*d->io_ready_in) {
+            d->ready_seen_low = true;
+        } else if (d->ready_seen_low) {
+            rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: io-ready-in toggled, link back in operation\n", d->index);
+            d->recovery = RECOVERY_LINKED;
+        }
+    }
+    *d->recovery_state = d->recovery;
+}
+
+// An accepted (valid) or rejected reply while the link recovers: the first accepted one starts
+// the verification, accepted replies in RECOVERY_GOOD_REPLIES periods in a row verify the link
+// and a rejected one restarts it
+static void recovery_reply(io_samurai_data_t *d, int valid) {
+    if (!valid) {
+        d->recovery_good = 0;
         return;
     }
-    int len = recvfrom(d->sockfd, d->rx_buffer, 5, 0, NULL, NULL);
-    if (len == 5) {
-        d->checksum_index_in += (uint8_t)(d->rx_buffer[0] + d->rx_buffer[1] + d->rx_buffer[2] + d->rx_buffer[3] + 1);
-        uint8_t calcChecksum = jump_table[d->checksum_index_in];
-        if (calcChecksum == d->rx_buffer[4]) {
+    if (d->recovery == RECOVERY_VERIFY && d->last_received_time == d->current_time) {
+        return;  // One per period, a burst of queued replies does not verify the link
+    }
+    d->last_received_time = d->current_time;
+    d->recovery = RECOVERY_VERIFY;
+    d->recovery_good++;
+    if (d->recovery_good >= RECOVERY_GOOD_REPLIES) {
+        d->recovery = RECOVERY_WAIT_READY;
+        d->ready_seen_low = false;
+        *d->recovery_time = ns_pin((rtapi_get_time() - d->recovery_start) / 1000000);
+        rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: link recovered in %d ms, toggle io-ready-in to enable io-ready-out\n",
+                        d->index, (int)*d->recovery_time);
+    }
+}
+
+// Returns 0 if no frame may go out in this period: while the board is silent the resync
+// heartbeats are throttled to one per RECOVERY_HEARTBEAT_NS
+static int recovery_heartbeat(io_samurai_data_t *d, long long now) {
+    if (d->recovery != RECOVERY_RESYNC) {
+        return 1;
+    }
+    if (now - d->last_heartbeat < RECOVERY_HEARTBEAT_NS) {
+        return 0;
+    }
+    d->last_heartbeat = now;
+    return 1;
+}
+
+// Check one reply (len < 0 when none arrived) that arrived at the given time and update the input pins
+static void decode_reply(io_samurai_data_t *d, const ios_rx_frame_t *frame, int len, long long arrival) {
+    if (len == IOS_RX_FRAME_SIZE) {
+        uint8_t index = d->link.rx.index;
+        int check = ios_check_rx(&d->link.rx, frame);
+        reply_arrived(d, arrival, check != IOS_CHAIN_MISMATCH);
+        if (recovering(d)) {
+            // The inputs are held until the relocked chain is verified
+            *d->checksum_errors += check == IOS_CHAIN_MISMATCH;
+            recovery_reply(d, check != IOS_CHAIN_MISMATCH);
+            return;
+        }
+        if (check != IOS_CHAIN_MISMATCH) {
+            if (check == IOS_CHAIN_RELOCKED) {
+                *d->resync_count += 1;
+                rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: checksum chain relocked after %d rejected replies\n",
+                                d->index, d->resync_rejected);
+            }
+            d->resync_rejected = 0;
             *d->connected = 1;
             d->last_received_time = d->current_time;
-            for (int i = 0; i < 8; i++) {
-                *d->input_data[i] = (d->rx_buffer[0] >> i) & 0x01;
+            d->input_arrival = arrival;
+            uint16_t inputs = ios_rx_inputs(frame);
+            for (int i = 0; i < 16; i++) {
+                *d->input_data[i] = (inputs >> i) & 0x01;
                 *d->input_data_not[i] = 1 - *d->input_data[i];
-                *d->input_data[i + 8] = (d->rx_buffer[1] >> i) & 0x01;
-                *d->input_data_not[i + 8] = 1 - *d->input_data[i + 8];
             }
-            uint16_t raw_adc = (d->rx_buffer[3] << 8 | d->rx_buffer[2]) & 0xfff;
+            uint16_t raw_adc = ios_rx_adc(frame);
             float scaled_adc = scale_adc(raw_adc, *d->analog_min, *d->analog_max);
             if (*d->analog_rounding == 1) {
                 scaled_adc = roundf(scaled_adc);
@@ -204,71 +880,98 @@ void udp_io_process_recv(void *arg, long period) {
             *d->analog_in_s32 = (int32_t)scaled_adc;
             *d->analog_in = scaled_adc;
         } else {
-            rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: checksum error: %02x != %02x\n", d->index, d->rx_buffer[4], calcChecksum);
-            *d->io_ready_out = 0;
+            // The chain took over the board's index and the next reply confirms it. A lost or
+            // reordered reply costs a cycle with the inputs held; only a chain that does not
+            // relock within RESYNC_LIMIT replies breaks the estop loop.
+            if (d->resync_rejected == 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: checksum error: %02x != %02x, resynchronizing\n",
+                                d->index, frame->checksum, ios_jump_table[(uint8_t)(index + ios_rx_sum(frame) + 1)]);
+            }
+            *d->checksum_errors += 1;
+            d->resync_rejected++;
+            if (d->resync_rejected > RESYNC_LIMIT) {
+                *d->io_ready_out = 0;
+            }
             *d->connected = 0;
         }
     } else {
+        if (len >= 0) {
+            *d->short_packets += 1;
+            if (recovering(d)) {
+                recovery_reply(d, 0);
+            }
+        }
         *d->io_ready_out = 0;
         *d->connected = 0;
     }
 }
 
-/*
- * set_bit - Sets or clears a specific bit in an 8-bit buffer.
- *
- * @buffer: The 8-bit value to modify.
- * @bit_position: The position of the bit to set or clear (0 to 7).
- * @value: The value to set the bit to (0 to clear, non-zero to set).
- *
- * Returns:
- *   - The modified 8-bit buffer with the specified bit set or cleared.
- *   - The original buffer if bit_position is out of range (< 0 or >= 8).
- *
- * Notes:
- *   - Bit positions are zero-based (0 is the least significant bit).
- *   - The function uses bitwise operations to set or clear the bit.
- */
-uint8_t set_bit(uint8_t buffer, int bit_position, int value) {
-    if (bit_position < 0 || bit_position >= 8) {
-        return buffer;
-    }
-    if (value) {
-        buffer |= (1 << bit_position);
+// Read and check one reply, returns its length or -1 if none is queued
+static int receive_one(io_samurai_data_t *d) {
+    const ios_rx_frame_t *frame = &d->rx_frame;
+    long long now = rtapi_get_time();
+    long long arrival = now;
+    int len;
+    if (d->ring) {
+        long long realtime;
+        len = packet_recv(d, (const uint8_t **)&frame, &realtime);
+        if (len >= 0) {
+            arrival = realtime + realtime_offset();
+        }
     } else {
-        buffer &= ~(1 << bit_position);
+        struct iovec iov = { &d->rx_frame, IOS_RX_FRAME_SIZE };
+        char control[STAMP_SPACE];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        len = recvmsg(d->sockfd, &msg, 0);
+        if (len >= 0) {
+            arrival = arrival_time(&msg, realtime_offset(), now);
+        }
+    }
+    decode_reply(d, frame, len, arrival);
+    if (d->ring && len >= 0) {
+        packet_release(d);
     }
-    return buffer;
+    return len;
 }
 
-// parse outputs
-void udp_io_process_send(void *arg, long period) {
-    io_samurai_data_t *d = arg;
-    // if watchdog expired, do not send data
-    if (d->watchdog_expired) {
-        *d->io_ready_out = 0;  // turn off io-ready-out (breaking estop-loop)
-        return;
-    }
+// parse inputs
+static void receive_reply(io_samurai_data_t *d) {
+    // While the link recovers every queued reply is read, so the replies to heartbeats that
+    // piled up in a stalled board or switch do not stay queued behind the current one
+    int len;
+    do {
+        len = receive_one(d);
+    } while (len >= 0 && recovering(d));
+}
+
+// Build the next frame from the output pins, returns 0 if nothing may be sent in this period
+static int encode_frame(io_samurai_data_t *d) {
     if (d->watchdog_running == 1) {
+        uint8_t outputs = 0;
         for (int i = 0; i < 8; i++) {
-            d->tx_buffer[0] |= (*d->output_data[i]) << i;
+            outputs |= (*d->output_data[i]) << i;
         }
-       
-        if (*d->oled_off){
-            d->tx_buffer[1] = set_bit(d->tx_buffer[1], 1, 1);
+        if (recovering(d)) {
+            outputs = 0;  // The board only gets the outputs back over a verified link
         }
 
+        uint8_t flags = 0;
+        if (*d->oled_off) {
+            flags |= IOS_FLAG_OLED_OFF;
+        }
         if (*d->analog_lowpass == 1) {
-            d->tx_buffer[1] = set_bit(d->tx_buffer[1], 0, 1);
-        } else {
-            d->tx_buffer[1] = set_bit(d->tx_buffer[1], 0, 0);
+            flags |= IOS_FLAG_LOWPASS;
         }
-        
-        // calculate next checksum
-        d->checksum_index += d->tx_buffer[0] + d->tx_buffer[1] + 1;
-        d->tx_buffer[2] = jump_table[d->checksum_index];
 
-        if (*d->io_ready_in == 1) {
+        // build the frame and calculate next checksum
+        ios_encode_tx(&d->link.tx, &d->tx_frame, outputs, flags);
+
+        if (*d->io_ready_in == 1 && d->recovery == RECOVERY_LINKED) {
             *d->io_ready_out = *d->io_ready_in;  // Seems to be all ok so pass the io-ready-in to io-ready-out
         } else {
             *d->io_ready_out = 0;  // no io-ready-in, no io-ready-out
@@ -281,14 +984,247 @@ void udp_io_process_send(void *arg, long period) {
             d->error_triggered = true; // Set the error triggered flag to prevent multiple messages
             *d->io_ready_out = 0;      // set the io-ready-out pin to 0 to break the estop-loop
             rtapi_print_msg(RTAPI_MSG_ERR ,"io-samurai.%d: watchdog not running\n", d->index);
-            return;  // No data to send (generate io-samurai side timeout error)
+            return 0;  // No data to send (generate io-samurai side timeout error)
         }
     }
-    sendto(d->sockfd, &d->tx_buffer, sizeof(d->tx_buffer), 0, &d->remote_addr, sizeof(d->remote_addr));
-    memset(d->tx_buffer, 0, 3);
+    return 1;
+}
+
+// parse outputs
+static void send_frame(io_samurai_data_t *d) {
+    long long now = rtapi_get_time();
+    // after a watchdog expiry only the throttled resync heartbeats go out
+    if (!recovery_heartbeat(d, now)) {
+        *d->io_ready_out = 0;  // turn off io-ready-out (breaking estop-loop)
+        return;
+    }
+    if (!encode_frame(d)) {
+        return;
+    }
+    frame_sent(d, now);
+    if (d->ring) {
+        packet_send(d, &d->tx_frame, IOS_TX_FRAME_SIZE);
+    } else {
+        sendto(d->sockfd, &d->tx_frame, IOS_TX_FRAME_SIZE, 0, &d->remote_addr, sizeof(d->remote_addr));
+    }
+    memset(&d->tx_frame, 0, sizeof(d->tx_frame));
 
 }
 
+// Instance a reply came from, NULL for unknown sources
+static io_samurai_data_t *find_instance(const struct sockaddr_in *addr) {
+    for (int j = 0; j < instances; j++) {
+        if (hal_data[j].batch_socket >= 0 &&
+            hal_data[j].remote_addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            hal_data[j].remote_addr.sin_port == addr->sin_port) {
+            return &hal_data[j];
+        }
+    }
+    return NULL;
+}
+
+// Decode the oldest reply queued for an instance by process-all and drop it from the queue
+static void decode_queued(io_samurai_data_t *d) {
+    int j = d->index;
+    decode_reply(d, &batch.queue[j][0].frame, batch.queue[j][0].len, batch.queue[j][0].arrival);
+    batch.queued[j]--;
+    memmove(&batch.queue[j][0], &batch.queue[j][1], batch.queued[j] * sizeof(batch.queue[j][0]));
+}
+
+// No reply for a pipelined instance in this period: it may still be on the way and reply-age
+// shows how old the inputs are; only a reply more than LATE_LIMIT periods and LATE_MIN_NS
+// overdue clears connected and breaks the estop loop
+static void late_reply(io_samurai_data_t *d, long period) {
+    long long late = d->current_time - d->last_received_time;
+    if (late > LATE_LIMIT && late * period > LATE_MIN_NS) {
+        *d->connected = 0;
+        *d->io_ready_out = 0;
+    }
+}
+
+// Send the first count frames of tx_msgs. sendmmsg() stops at a frame the kernel refuses
+// (full buffer, no route) and reports it on the next call, that frame is skipped so the
+// boards after it still get theirs; the missing reply shows up on the board's pins.
+static void batch_flush(int fd, int count) {
+    int sent = 0;
+    while (sent < count) {
+        int r = sendmmsg(fd, &batch.tx_msgs[sent], count - sent, MSG_DONTWAIT);
+        sent += r > 0 ? r : 1;
+    }
+}
+
+// Encode the frames of every instance and send them with one sendmmsg() per board port
+static void batch_send(long period) {
+    long long now = rtapi_get_time();
+    for (int j = 0; j < instances; j++) {
+        io_samurai_data_t *d = &hal_data[j];
+        d->watchdog_running = 1;   // The watchdog runs in process-all or read-all
+        if (d->ring) {
+            send_frame(d);
+        }
+    }
+    for (int s = 0; s < batch.socket_count; s++) {
+        int count = 0;
+        for (int j = 0; j < instances; j++) {
+            io_samurai_data_t *d = &hal_data[j];
+            if (d->ring || d->batch_socket != s) {
+                continue;
+            }
+            if (!recovery_heartbeat(d, now)) {
+                *d->io_ready_out = 0;  // turn off io-ready-out (breaking estop-loop)
+                continue;
+            }
+            if (encode_frame(d)) {
+                batch.tx_iov[count].iov_base = &d->tx_frame;
+                batch.tx_msgs[count].msg_hdr.msg_name = &d->remote_addr;
+                frame_sent(d, now);
+                count++;
+            }
+        }
+        batch_flush(batch.sockets[s], count);
+    }
+}
+
+/*
+ * batch_receive - Reads every queued reply with one recvmmsg() per socket and hands them to the instances.
+ *
+ * @pipelined: 0 for process-all, 1 for read-all.
+ *
+ * Description:
+ *   - Queues each reply for the instance its source address belongs to.
+ *   - process-all takes the oldest reply of every instance, an instance without one is handled
+ *     like an empty read of process-recv.
+ *   - read-all decodes all queued replies, so the pins hold the newest one; an instance without
+ *     a reply goes through late_reply().
+ */
+static void batch_receive(long period, int pipelined) {
+    long long now = rtapi_get_time();
+    long long offset = realtime_offset();
+    for (int s = 0; s < batch.socket_count; s++) {
+        for (int i = 0; i < BATCH_FRAMES; i++) {
+            batch.rx_msgs[i].msg_hdr.msg_namelen = sizeof(batch.rx_addrs[i]);
+            batch.rx_msgs[i].msg_hdr.msg_controllen = STAMP_SPACE;
+        }
+        int received = recvmmsg(batch.sockets[s], batch.rx_msgs, BATCH_FRAMES, MSG_DONTWAIT, NULL);
+        now = rtapi_get_time();
+        for (int i = 0; i < received; i++) {
+            io_samurai_data_t *d = find_instance(&batch.rx_addrs[i]);
+            if (d == NULL || d->ring) {
+                continue;
+            }
+            int j = d->index;
+            if (batch.queued[j] == BATCH_QUEUE) {
+                decode_queued(d);      // Full, the oldest reply still moves the checksum chain on
+            }
+            batch.queue[j][batch.queued[j]].frame = batch.rx_frames[i];
+            batch.queue[j][batch.queued[j]].len = (int)batch.rx_msgs[i].msg_len;
+            batch.queue[j][batch.queued[j]].arrival = arrival_time(&batch.rx_msgs[i].msg_hdr, offset, now);
+            batch.queued[j]++;
+        }
+    }
+    for (int j = 0; j < instances; j++) {
+        io_samurai_data_t *d = &hal_data[j];
+        if (d->ring && !pipelined) {
+            receive_reply(d);
+        } else if (d->ring) {
+            const uint8_t *payload;
+            long long realtime;
+            int len, replies = 0;
+            while ((len = packet_recv(d, &payload, &realtime)) >= 0) {
+                decode_reply(d, (const ios_rx_frame_t *)payload, len, realtime + offset);
+                packet_release(d);
+                replies++;
+            }
+            if (replies == 0) {
+                late_reply(d, period);
+            }
+        } else if (batch.queued[j] == 0) {
+            if (pipelined) {
+                late_reply(d, period);
+            } else {
+                decode_reply(d, NULL, -1, now);
+            }
+        } else {
+            int drain = pipelined || recovering(d);
+            decode_queued(d);
+            while (drain && batch.queued[j] > 0) {
+                decode_queued(d);
+            }
+        }
+    }
+}
+
+/*
+ * process_all - Runs every instance in one funct: send, receive and watchdog.
+ *
+ * Description:
+ *   - Encodes the frames of all instances and sends them with one sendmmsg() per board port.
+ *   - Reads the replies with one recvmmsg() per board port, see batch_receive().
+ *   - Runs the watchdog of every instance last, like the per-instance functs in io-samurai.hal.
+ *
+ * Notes:
+ *   - Instances on the packet transport keep their rings and are driven one by one.
+ *   - Use either process-all, read-all/write-all or the per-instance functs in one thread.
+ *     They send over the same sockets, so a board keeps answering when the configuration
+ *     changes between them; boards sharing a port only work with process-all and read-all/write-all.
+ */
+void process_all(void *arg, long period) {
+    long long start = rtapi_get_clocks();
+    batch_send(period);
+    batch_receive(period, 0);
+    for (int j = 0; j < instances; j++) {
+        run_watchdog(&hal_data[j], period);
+    }
+    exec_time(&batch_exec->process_all, start);
+}
+
+/*
+ * read_all, write_all - Pipelined process-all, split across the servo period.
+ *
+ * Description:
+ *   - read-all goes first in the thread: it takes the replies to the frames write-all sent at
+ *     the end of the previous period and runs the watchdogs.
+ *   - write-all goes last: it sends the outputs the other functs of this period produced.
+ *   - The boards get a whole period to answer instead of the few microseconds between the
+ *     send and the receive of process-all.
+ */
+void read_all(void *arg, long period) {
+    long long start = rtapi_get_clocks();
+    batch_receive(period, 1);
+    for (int j = 0; j < instances; j++) {
+        run_watchdog(&hal_data[j], period);
+    }
+    exec_time(&batch_exec->read_all, start);
+}
+
+void write_all(void *arg, long period) {
+    long long start = rtapi_get_clocks();
+    batch_send(period);
+    exec_time(&batch_exec->write_all, start);
+}
+
+// Per-instance functs, each timed on its own
+void watchdog_process(void *arg, long period) {
+    io_samurai_data_t *d = arg;
+    long long start = rtapi_get_clocks();
+    run_watchdog(d, period);
+    exec_time(&d->watchdog_exec, start);
+}
+
+void udp_io_process_recv(void *arg, long period) {
+    io_samurai_data_t *d = arg;
+    long long start = rtapi_get_clocks();
+    receive_reply(d);
+    exec_time(&d->recv_exec, start);
+}
+
+void udp_io_process_send(void *arg, long period) {
+    io_samurai_data_t *d = arg;
+    long long start = rtapi_get_clocks();
+    send_frame(d);
+    exec_time(&d->send_exec, start);
+}
+
 /*
  * parse_ip_port - Parses a string containing IP:port pairs separated by semicolons.
  *
@@ -353,6 +1289,61 @@ int parse_ip_port(const char *input, IpPort *output, int max_count) {
     return count; // Return the number of valid entries parsed
 }
 
+/*
+ * export_exec_timing - Exports the execution time pins and the exec-limit parameter of a funct.
+ *
+ * @t: Timing record in HAL memory.
+ * @funct: Name of the funct, the pins are <funct>.exec-last, .exec-max and .exec-avg.
+ *
+ * Returns:
+ *   - 0 on success, the negative HAL error code otherwise (already logged).
+ *
+ * Notes:
+ *   - All values are rtapi_get_clocks() ticks, like the .time and .tmax of the funct itself.
+ */
+static int export_exec_timing(exec_timing_t *t, const char *funct) {
+    char name[48];
+    int r;
+
+    snprintf(t->name, sizeof(t->name), "%s", funct);
+    t->average = 0;
+    t->last_log = 0;
+    t->over = 0;
+
+    snprintf(name, sizeof(name), "%s.exec-last", funct);
+    r = hal_pin_s32_newf(HAL_OUT, &t->last, comp_id, "%s", name);
+    if (r < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin %s export failed with err=%i\n", name, r);
+        return r;
+    }
+    *t->last = 0;
+
+    snprintf(name, sizeof(name), "%s.exec-max", funct);
+    r = hal_pin_s32_newf(HAL_IO, &t->max, comp_id, "%s", name);
+    if (r < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin %s export failed with err=%i\n", name, r);
+        return r;
+    }
+    *t->max = 0;
+
+    snprintf(name, sizeof(name), "%s.exec-avg", funct);
+    r = hal_pin_s32_newf(HAL_OUT, &t->avg, comp_id, "%s", name);
+    if (r < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin %s export failed with err=%i\n", name, r);
+        return r;
+    }
+    *t->avg = 0;
+
+    t->limit = 0;
+    snprintf(name, sizeof(name), "%s.exec-limit", funct);
+    r = hal_param_s32_newf(HAL_RW, &t->limit, comp_id, "%s", name);
+    if (r < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: param %s export failed with err=%i\n", name, r);
+        return r;
+    }
+    return 0;
+}
+
 int rtapi_app_main(void) {
     int r;
 
@@ -386,19 +1377,39 @@ int rtapi_app_main(void) {
         for (int j = 0; j< instances; j++) {
 
             rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: hal_data allocated at %p\n", j, &hal_data[j]);
-            hal_data[j].checksum_index = 1;
-            hal_data[j].checksum_index_in = 1;
+            ios_link_reset(&hal_data[j].link);
             hal_data[j].index = j; 
-            hal_data[j].watchdog_timeout = 10; // ~10 ms timeout
+            hal_data[j].watchdog_timeout = WATCHDOG_TIMEOUT_NS;
             hal_data[j].current_time = 0;
             hal_data[j].last_received_time = 0;
-            hal_data[j].watchdog_expired = 0;
+            hal_data[j].input_arrival = rtapi_get_time();
+            hal_data[j].recovery = RECOVERY_LINKED;
+            hal_data[j].recovery_good = 0;
+            hal_data[j].ready_seen_low = false;
+            hal_data[j].recovery_start = 0;
+            hal_data[j].last_heartbeat = 0;
             hal_data[j].watchdog_running = 0;
             hal_data[j].ip_address = &results[j];
             hal_data[j].error_triggered = false;
+            hal_data[j].packet_fd = -1;
+            hal_data[j].resync_rejected = 0;
+            hal_data[j].ring = NULL;
+            hal_data[j].sent_first = 0;
+            hal_data[j].sent_count = 0;
+            hal_data[j].last_rtt = 0;
+            hal_data[j].jitter = 0;
+            hal_data[j].last_reply_ns = rtapi_get_time();
+            hal_data[j].reset_stats_last = false;
 
             rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: init_socket\n", j);
             init_socket(&hal_data[j]);
+            if (hal_data[j].sockfd >= 0 && transport && strcmp(transport, "packet") == 0) {
+                if (init_packet_socket(&hal_data[j]) < 0) {
+                    rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai.%d: packet transport failed, using UDP\n", j);
+                } else {
+                    rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: packet transport ready\n", j);
+                }
+            }
             rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: init_socket ready..\n", j);
 
             memset(name, 0, sizeof(name));
@@ -557,6 +1568,138 @@ int rtapi_app_main(void) {
             }
             *hal_data[j].oled_off = 0;
 
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.resync-count", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].resync_count, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin resync-count export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].resync_count = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.reply-age", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].reply_age, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin reply-age export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].reply_age = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.rtt-ns", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].rtt, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin rtt-ns export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].rtt = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.rtt-max-ns", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].rtt_max, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin rtt-max-ns export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].rtt_max = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.rtt-jitter-ns", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].rtt_jitter, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin rtt-jitter-ns export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].rtt_jitter = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.missed-replies", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].missed_replies, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin missed-replies export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].missed_replies = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.checksum-errors", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].checksum_errors, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin checksum-errors export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].checksum_errors = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.short-packets", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].short_packets, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin short-packets export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].short_packets = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.watchdog-trips", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].watchdog_trips, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin watchdog-trips export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].watchdog_trips = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.recovery-state", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].recovery_state, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin recovery-state export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].recovery_state = RECOVERY_LINKED;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.recovery-time-ms", j);
+
+            r = hal_pin_s32_newf(HAL_OUT, &hal_data[j].recovery_time, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin recovery-time-ms export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].recovery_time = 0;
+
+            memset(name, 0, sizeof(name));
+            snprintf(name, sizeof(name), "io-samurai.%d.reset-stats", j);
+
+            r = hal_pin_bit_newf(HAL_IN, &hal_data[j].reset_stats, comp_id, name, j);
+            if (r < 0) {
+                rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: ERROR: pin reset-stats export failed with err=%i\n", r);
+                hal_exit(comp_id);
+                return r;
+            }
+            *hal_data[j].reset_stats = 0;
+
             char watchdog_name[48] = {0};
             snprintf(watchdog_name, sizeof(watchdog_name),"io-samurai.%d.watchdog-process", j);
             r = hal_export_funct(watchdog_name, watchdog_process, &hal_data[j], 1, 0, comp_id);
@@ -566,6 +1709,11 @@ int rtapi_app_main(void) {
                 return r;
             }
             rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: hal_export_funct for watchdog-process: %d\n", j, r);
+            r = export_exec_timing(&hal_data[j].watchdog_exec, watchdog_name);
+            if (r < 0) {
+                hal_exit(comp_id);
+                return r;
+            }
 
             char process_send[48] = {0};
             snprintf(process_send, sizeof(process_send), "io-samurai.%d.process-send", j);
@@ -576,6 +1724,11 @@ int rtapi_app_main(void) {
                 return r;
             }
             rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: hal_export_funct for process_send: %d\n", j, r);
+            r = export_exec_timing(&hal_data[j].send_exec, process_send);
+            if (r < 0) {
+                hal_exit(comp_id);
+                return r;
+            }
 
             char process_recv[48] = {0};
             snprintf(process_recv, sizeof(process_recv), "io-samurai.%d.process-recv", j);
@@ -586,6 +1739,57 @@ int rtapi_app_main(void) {
                 return r;
             }
             rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: hal_export_funct for process_recv: %d\n", j, r);
+            r = export_exec_timing(&hal_data[j].recv_exec, process_recv);
+            if (r < 0) {
+                hal_exit(comp_id);
+                return r;
+            }
+        }
+
+        init_batch_sockets();
+        batch_exec = hal_malloc(sizeof(batch_exec_t));
+        if (batch_exec == NULL) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: batch_exec allocation failed\n");
+            hal_exit(comp_id);
+            return -1;
+        }
+        r = hal_export_funct("io-samurai.process-all", process_all, hal_data, 1, 0, comp_id);
+        if (r < 0) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: hal_export_funct failed for process-all: %d\n", r);
+            hal_exit(comp_id);
+            return r;
+        }
+        rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai: hal_export_funct for process_all: %d\n", r);
+        r = export_exec_timing(&batch_exec->process_all, "io-samurai.process-all");
+        if (r < 0) {
+            hal_exit(comp_id);
+            return r;
+        }
+
+        r = hal_export_funct("io-samurai.read-all", read_all, hal_data, 1, 0, comp_id);
+        if (r < 0) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: hal_export_funct failed for read-all: %d\n", r);
+            hal_exit(comp_id);
+            return r;
+        }
+        rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai: hal_export_funct for read_all: %d\n", r);
+        r = export_exec_timing(&batch_exec->read_all, "io-samurai.read-all");
+        if (r < 0) {
+            hal_exit(comp_id);
+            return r;
+        }
+
+        r = hal_export_funct("io-samurai.write-all", write_all, hal_data, 1, 0, comp_id);
+        if (r < 0) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "io-samurai: hal_export_funct failed for write-all: %d\n", r);
+            hal_exit(comp_id);
+            return r;
+        }
+        rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai: hal_export_funct for write_all: %d\n", r);
+        r = export_exec_timing(&batch_exec->write_all, "io-samurai.write-all");
+        if (r < 0) {
+            hal_exit(comp_id);
+            return r;
         }
         r = hal_ready(comp_id);
         if (r < 0) {
@@ -602,7 +1806,13 @@ int rtapi_app_main(void) {
 void rtapi_app_exit(void) {
     for (int i = 0; i < instances; i++) {
         rtapi_print_msg(RTAPI_MSG_INFO, "io-samurai.%d: Exiting component\n", i);
-        close(hal_data[i].sockfd);
+        if (hal_data[i].ring) {
+            munmap(hal_data[i].ring, hal_data[i].ring_size);
+            close(hal_data[i].packet_fd);
+        }
+        if (hal_data[i].sockfd >= 0) {
+            close(hal_data[i].sockfd);
+        }
     }
     hal_exit(comp_id);
 }
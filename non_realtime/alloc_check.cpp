@@ -0,0 +1,276 @@
+#include "io-samurai.h"
+#include "io-samurai-group.h"
+#include "event-log.h"
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+
+// Checks that the cycle path never allocates: counts operator new calls made by the calling
+// thread during IoSamurai::update() in each RoundTripMode and during IoSamuraiGroup::update(),
+// together with setting the outputs and reading the snapshots and counters. Exits with 1 when
+// any count is non-zero or a run got no replies at all.
+// Board i is expected at address:port+i. A single IoSamurai binds the board port, so run the
+// boards in the namespace of ../utility/virtual_board_netns.sh, for example
+//   virtual_board_netns.sh run 1 -n 4 -I &                 (10.77.1.1:8888..8891)
+//   virtual_board_netns.sh run 1 -n 4 -I -p 8988 -l 5 &    (a second set, 5% of the requests unanswered)
+//   alloc_check --address 10.77.1.1 --lossy-port 8988
+// --lossy-port repeats every run against the second set, so the timeout paths are counted too.
+// Usage: alloc_check [--address A] [--port P] [--lossy-port P] [--boards N] [--cycles N] [--period-us N]
+
+static std::atomic<uint64_t> allocations(0);
+static thread_local bool counting = false;
+
+static void* counted_alloc(size_t size, size_t align) {
+    if (counting) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    void* pointer;
+    if (align <= alignof(std::max_align_t)) {
+        pointer = malloc(size);
+    } else if (posix_memalign(&pointer, align, size) != 0) {
+        pointer = nullptr;
+    }
+    return pointer;
+}
+
+void* operator new(size_t size) {
+    void* pointer = counted_alloc(size, 0);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    void* pointer = counted_alloc(size, static_cast<size_t>(align));
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept {
+    free(pointer);
+}
+
+struct RunResult {
+    uint64_t allocations;
+    uint64_t replies;
+    uint64_t timeouts;
+};
+
+// Runs body on absolute deadlines, counting only inside body; the warmup cycles are not counted
+template <typename Body>
+static uint64_t count_allocations(int warmup, int cycles, int64_t period_ns, Body body) {
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint64_t start = 0;
+    for (int i = 0; i < warmup + cycles; i++) {
+        if (i == warmup) {
+            start = allocations.load(std::memory_order_relaxed);
+        }
+        counting = i >= warmup;
+        body(i);
+        counting = false;
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+    return allocations.load(std::memory_order_relaxed) - start;
+}
+
+static RunResult run_single(const std::string& address, int port, RoundTripMode mode, int warmup, int cycles,
+                            int64_t period_ns) {
+    RunResult result = {0, 0, 0};
+    IoSamurai io;
+    if (!io.init(address, port)) {
+        return result;
+    }
+    io.set_round_trip_mode(mode);
+    result.allocations = count_allocations(warmup, cycles, period_ns, [&](int i) {
+        if (i == warmup) {
+            io.reset_stats();
+        }
+        io.set_outputs_mask(static_cast<uint8_t>(i));
+        io.update();
+        ProcessImage image = io.snapshot();
+        (void)image;
+        IoStats stats = io.stats();
+        (void)stats;
+    });
+    IoStats stats = io.stats();
+    result.replies = stats.replies;
+    result.timeouts = stats.timeouts;
+    return result;
+}
+
+static RunResult run_group(const std::string& address, int port, int boards, RoundTripMode mode,
+                           int warmup, int cycles, int64_t period_ns) {
+    RunResult result = {0, 0, 0};
+    IoSamuraiGroup group;
+    if (!group.init(port)) {  // The same local port as the single runs, the boards latch on it
+        return result;
+    }
+    for (int i = 0; i < boards; i++) {
+        if (!group.add_board(address, port + i)) {
+            return result;
+        }
+    }
+    group.set_round_trip_mode(mode);
+    GroupSnapshot snapshot;
+    group.snapshot(snapshot);  // Sizes snapshot.boards once, before counting
+    result.allocations = count_allocations(warmup, cycles, period_ns, [&](int i) {
+        for (size_t b = 0; b < group.size(); b++) {
+            if (i == warmup) {
+                group.board(b).reset_stats();
+            }
+            group.board(b).set_outputs_mask(static_cast<uint8_t>(i + b));
+        }
+        group.update();
+        group.snapshot(snapshot);
+        GroupStats stats = group.stats();
+        (void)stats;
+    });
+    for (size_t b = 0; b < group.size(); b++) {
+        IoStats stats = group.board(b).stats();
+        result.replies += stats.replies;
+        result.timeouts += stats.timeouts;
+    }
+    return result;
+}
+
+static const char* mode_name(RoundTripMode mode) {
+    switch (mode) {
+    case RoundTripMode::Poll:
+        return "poll";
+    case RoundTripMode::BusyPoll:
+        return "busy";
+    default:
+        return "immediate";
+    }
+}
+
+static void usage() {
+    std::cerr << "usage: alloc_check [--address A] [--port P] [--lossy-port P] [--boards N] [--cycles N] [--period-us N]"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string address = "10.77.1.1";
+    int port = 8888;
+    int lossy_port = -1;
+    int board_count = 4;
+    int cycles = 2000;
+    int64_t period_us = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--address") && i + 1 < argc) {
+            address = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--lossy-port") && i + 1 < argc) {
+            lossy_port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--boards") && i + 1 < argc) {
+            board_count = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+            cycles = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--period-us") && i + 1 < argc) {
+            period_us = atoll(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (board_count < 1 || cycles < 1 || period_us < 1) {
+        usage();
+        return 1;
+    }
+
+    const int64_t period_ns = period_us * 1000;
+    // Long enough for the boards' failsafe timeout to relock the chains after the previous run
+    const int warmup = static_cast<int>(250000 / period_us) + 10;
+    const RoundTripMode modes[] = {RoundTripMode::Immediate, RoundTripMode::Poll, RoundTripMode::BusyPoll};
+    std::vector<int> ports = {port};
+    if (lossy_port > 0) {
+        ports.push_back(lossy_port);
+    }
+
+    std::cout << cycles << " cycles of " << period_us << " us per run" << std::endl;
+    std::cout << std::left << std::setw(8) << "run" << std::setw(11) << "mode" << std::setw(7) << "port" << std::right
+              << std::setw(13) << "allocations" << std::setw(10) << "replies" << std::setw(10) << "timeouts"
+              << std::endl;
+    bool failed = false;
+    for (int board_port : ports) {
+        for (int group = 0; group < 2; group++) {
+            for (RoundTripMode mode : modes) {
+                RunResult result = group ? run_group(address, board_port, board_count, mode, warmup, cycles, period_ns)
+                                         : run_single(address, board_port, mode, warmup, cycles, period_ns);
+                EventLog::instance().flush();
+                bool ok = result.allocations == 0 && result.replies > 0;
+                failed = failed || !ok;
+                std::cout << std::left << std::setw(8) << (group ? "group" : "single") << std::setw(11)
+                          << mode_name(mode) << std::setw(7) << board_port << std::right << std::setw(13)
+                          << result.allocations << std::setw(10) << result.replies << std::setw(10)
+                          << result.timeouts << (ok ? "" : "  FAILED") << std::endl;
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -1 +1,9 @@
-g++ -std=c++11 -pthread -o usage_example io-samurai.cpp usage_example.cpp
\ No newline at end of file
+g++ -std=c++17 -pthread -o usage_example io-samurai.cpp io-samurai-group.cpp uring-transport.cpp packet-transport.cpp cyclic-task.cpp event-log.cpp latency-histogram.cpp packet-capture.cpp shared-image.cpp usage_example.cpp
+g++ -std=c++17 -pthread -o replay_capture io-samurai.cpp io-samurai-group.cpp uring-transport.cpp packet-transport.cpp cyclic-task.cpp event-log.cpp latency-histogram.cpp packet-capture.cpp shared-image.cpp replay_capture.cpp
+g++ -std=c++17 -pthread -o transport_benchmark io-samurai.cpp io-samurai-group.cpp uring-transport.cpp packet-transport.cpp cyclic-task.cpp event-log.cpp latency-histogram.cpp packet-capture.cpp shared-image.cpp transport_benchmark.cpp
+g++ -std=c++17 -pthread -o packet_benchmark packet-transport.cpp event-log.cpp latency-histogram.cpp packet_benchmark.cpp
+g++ -std=c++17 -pthread -o shm_monitor shared-image.cpp event-log.cpp shm_monitor.cpp
+g++ -std=c++20 -pthread -o coro_example io-samurai.cpp io-samurai-group.cpp io-samurai-coro.cpp uring-transport.cpp packet-transport.cpp cyclic-task.cpp event-log.cpp latency-histogram.cpp packet-capture.cpp shared-image.cpp coro_example.cpp
+g++ -std=c++17 -pthread -o table_benchmark io-samurai.cpp io-samurai-group.cpp io-samurai-table.cpp uring-transport.cpp packet-transport.cpp cyclic-task.cpp event-log.cpp latency-histogram.cpp packet-capture.cpp shared-image.cpp table_benchmark.cpp
+g++ -std=c++17 -pthread -o alloc_check io-samurai.cpp io-samurai-group.cpp uring-transport.cpp packet-transport.cpp cyclic-task.cpp event-log.cpp latency-histogram.cpp packet-capture.cpp shared-image.cpp alloc_check.cpp
+g++ -std=c++17 -pthread -o completion_check io-samurai.cpp io-samurai-group.cpp uring-transport.cpp packet-transport.cpp cyclic-task.cpp event-log.cpp latency-histogram.cpp packet-capture.cpp shared-image.cpp completion_check.cpp
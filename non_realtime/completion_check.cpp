@@ -0,0 +1,133 @@
+#include "io-samurai.h"
+#include "event-log.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+// Checks that send_async()/poll_completions() hand every reply to its own request when the board
+// answers later than the round-trip timeout. The first phase uses a timeout below the board's reply
+// delay, so the requests expire and their late replies must not complete a later request. The
+// second phase raises the timeout above the delay and every request must complete with ok true,
+// after the late replies of the first phase are skipped. A request completed with ok true must
+// show a round trip of at least the delay (a poll that wakes up late still reads its own reply),
+// an expired one 0. Exits with 1 when a completion has the wrong sequence, ok flag or round trip.
+// The IoSamurai binds the board port, so run the board in the namespace of
+// ../utility/virtual_board_netns.sh, with the reply delay given to both:
+//   virtual_board_netns.sh run 1 -n 1 -d 2000 &
+//   completion_check --address 10.77.1.1 --delay-us 2000
+// Usage: completion_check [--address A] [--port P] [--delay-us N] [--timeout-us N] [--requests N]
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_us(int64_t us) {
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&ts, nullptr);
+}
+
+// Sends one request at a time and polls until it completes, returns the number of wrong completions
+static int run_phase(IoSamurai& io, const char* name, int requests, bool require_ok, int64_t min_rtt_ns) {
+    int errors = 0;
+    int ok_count = 0;
+    int64_t rtt_min = INT64_MAX;
+    int64_t rtt_max = 0;
+    for (int i = 0; i < requests; i++) {
+        io.set_outputs_mask(static_cast<uint8_t>(i));
+        uint64_t sequence = io.send_async();
+        if (sequence == 0) {
+            std::cerr << name << ": send_async() refused a request with none in flight" << std::endl;
+            return errors + 1;
+        }
+        Completion completion;
+        bool done = false;
+        int64_t give_up = now_ns() + 1000000000LL;
+        while (!done && now_ns() < give_up) {
+            io.poll_completions();
+            while (io.pop_completion(completion)) {
+                bool wrong = completion.sequence != sequence || (completion.ok && completion.rtt_ns < min_rtt_ns) ||
+                             (!completion.ok && (require_ok || completion.rtt_ns != 0));
+                if (wrong && errors < 10) {
+                    std::cerr << name << ": expected sequence " << sequence << ", got sequence "
+                              << completion.sequence << " ok=" << completion.ok << " rtt_us=" << completion.rtt_ns / 1000
+                              << std::endl;
+                }
+                errors += wrong;
+                if (completion.ok) {
+                    ok_count++;
+                    rtt_min = std::min(rtt_min, completion.rtt_ns);
+                    rtt_max = std::max(rtt_max, completion.rtt_ns);
+                }
+                done = done || completion.sequence == sequence;
+            }
+            if (!done) {
+                sleep_us(50);
+            }
+        }
+        if (!done) {
+            std::cerr << name << ": request " << sequence << " never completed" << std::endl;
+            return errors + 1;
+        }
+    }
+    std::cout << name << ": " << requests << " requests, " << ok_count << " ok";
+    if (ok_count > 0) {
+        std::cout << ", rtt " << rtt_min / 1000 << ".." << rtt_max / 1000 << " us";
+    }
+    std::cout << ", " << errors << " wrong completions" << std::endl;
+    return errors;
+}
+
+static void usage() {
+    std::cerr << "usage: completion_check [--address A] [--port P] [--delay-us N] [--timeout-us N] [--requests N]"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string address = "10.77.1.1";
+    int port = IOS_DEFAULT_PORT;
+    int delay_us = 2000;
+    int timeout_us = 500;
+    int requests = 200;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--address") && i + 1 < argc) {
+            address = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--delay-us") && i + 1 < argc) {
+            delay_us = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--timeout-us") && i + 1 < argc) {
+            timeout_us = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--requests") && i + 1 < argc) {
+            requests = atoi(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (requests < 1 || timeout_us < 1 || delay_us <= timeout_us) {
+        std::cerr << "the reply delay must be longer than the timeout" << std::endl;
+        usage();
+        return 1;
+    }
+
+    IoSamurai io;
+    if (!io.init(address, port)) {
+        EventLog::instance().flush();
+        return 1;
+    }
+    const int64_t delay_ns = static_cast<int64_t>(delay_us) * 1000;
+    io.set_round_trip_mode(RoundTripMode::Poll, timeout_us);
+    int errors = run_phase(io, "expiring", requests, false, delay_ns);
+    io.set_round_trip_mode(RoundTripMode::Poll, delay_us * 4);
+    errors += run_phase(io, "answered", requests, true, delay_ns);
+    std::cout << "late replies skipped: " << io.stale_reply_count() << std::endl;
+    EventLog::instance().flush();
+    return errors ? 1 : 0;
+}
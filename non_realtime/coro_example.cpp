@@ -0,0 +1,161 @@
+#include "io-samurai.h"
+#include "io-samurai-group.h"
+#include "io-samurai-coro.h"
+#include "event-log.h"
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+// Sequencing with C++20 coroutines on a group of boards, all on the thread that runs update():
+//   per board   waits for a rising edge of input 0, pulses output 0 for --pulse cycles,
+//               and switches output 1 while the analog input is above --threshold
+//   --tasks N   adds N tasks that only count cycles (co_await next_cycle()), spread over the boards
+// It prints the time update() took per cycle, run it with --tasks 0 for the cost without tasks.
+// Board i is expected at address:port+i, for example ../utility/virtual_board -n 10 -I -S -i counter -A -1
+// The group sends from --local-port (default --port), the port a real board latches on. With
+// the boards on loopback the emulator holds that port, pass --local-port 0 there and -S to
+// the emulator, which would otherwise only answer the free port of the first run.
+// Usage: coro_example [--boards N] [--address A] [--port P] [--local-port P] [--tasks N] [--cycles N]
+//                     [--period-us N] [--pulse N] [--threshold V]
+
+static void usage() {
+    std::cerr << "usage: coro_example [--boards N] [--address A] [--port P] [--local-port P] [--tasks N] [--cycles N]"
+                 " [--period-us N] [--pulse N] [--threshold V]" << std::endl;
+}
+
+static int64_t monotonic_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+// Only touched by the coroutines, which all run on the main thread
+static uint64_t pulses = 0;
+static uint64_t analog_switches = 0;
+static uint64_t counted_cycles = 0;
+
+static IoTask pulse_on_edge(AwaitableBoard& io, uint64_t pulse_cycles) {
+    for (;;) {
+        co_await io.edge(0, Edge::Rising);
+        io.board().set_output(0, true);
+        co_await io.cycles(pulse_cycles);
+        io.board().set_output(0, false);
+        pulses++;
+    }
+}
+
+static IoTask follow_analog(AwaitableBoard& io, float threshold) {
+    for (;;) {
+        co_await io.analog_above(threshold);
+        io.board().set_output(1, true);
+        co_await io.analog_below(threshold);
+        io.board().set_output(1, false);
+        analog_switches++;
+    }
+}
+
+static IoTask count_cycles(AwaitableBoard& io) {
+    for (;;) {
+        co_await io.next_cycle();
+        counted_cycles++;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t board_count = 10;
+    std::string address = "127.0.0.1";
+    int port = 8888;
+    int local_port = -1;
+    long tasks = 1000;
+    long cycles = 5000;
+    long period_us = 1000;
+    long pulse_cycles = 20;
+    float threshold = 0.5f;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--boards") && i + 1 < argc) {
+            board_count = static_cast<size_t>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--address") && i + 1 < argc) {
+            address = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--local-port") && i + 1 < argc) {
+            local_port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--tasks") && i + 1 < argc) {
+            tasks = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+            cycles = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--period-us") && i + 1 < argc) {
+            period_us = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--pulse") && i + 1 < argc) {
+            pulse_cycles = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+            threshold = static_cast<float>(atof(argv[++i]));
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (board_count < 1 || tasks < 0 || cycles < 1 || period_us < 1 || pulse_cycles < 1) {
+        usage();
+        return 1;
+    }
+
+    IoSamuraiGroup group;
+    if (!group.init(local_port < 0 ? port : local_port)) {
+        EventLog::instance().flush();
+        return 1;
+    }
+    std::vector<std::unique_ptr<AwaitableBoard>> boards;
+    for (size_t i = 0; i < board_count; i++) {
+        IoSamurai* board = group.add_board(address, port + static_cast<int>(i));
+        if (!board) {
+            EventLog::instance().flush();
+            return 1;
+        }
+        board->set_analog_range(0.0f, 1.0f);
+        boards.emplace_back(new AwaitableBoard(*board));
+    }
+
+    // The tasks run up to their first co_await here and continue inside group.update()
+    for (auto& io : boards) {
+        pulse_on_edge(*io, static_cast<uint64_t>(pulse_cycles));
+        follow_analog(*io, threshold);
+    }
+    for (long i = 0; i < tasks; i++) {
+        count_cycles(*boards[static_cast<size_t>(i) % boards.size()]);
+    }
+
+    LatencyHistogram update_time;
+    int64_t deadline = monotonic_now_ns();
+    for (long cycle = 0; cycle < cycles; cycle++) {
+        int64_t start = monotonic_now_ns();
+        group.update();
+        update_time.record(monotonic_now_ns() - start);
+
+        deadline += period_us * 1000;
+        struct timespec next;
+        next.tv_sec = deadline / 1000000000LL;
+        next.tv_nsec = deadline % 1000000000LL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+
+    size_t waiting = 0;
+    for (auto& io : boards) {
+        waiting += io->waiting();
+    }
+    HistogramSummary summary = update_time.summary();
+    std::cout << "boards " << board_count << "  tasks " << waiting << "  cycles " << cycles << std::endl;
+    std::cout << "update() us  p50 " << std::fixed << std::setprecision(1) << summary.p50 / 1000.0 << "  p99 "
+              << summary.p99 / 1000.0 << "  max " << summary.max / 1000.0 << std::endl;
+    std::cout << "pulses " << pulses << "  analog switches " << analog_switches << "  counted cycles "
+              << counted_cycles << std::endl;
+
+    // Destroys the waiting tasks before the group and its boards
+    boards.clear();
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "cyclic-task.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <alloca.h>
+#include <time.h>
+#include <cstring>
+#include <cerrno>
+#include <future>
+#include "event-log.h"
+
+static constexpr int64_t NSEC_PER_SEC = 1000000000LL;
+
+static int64_t timespec_to_ns(const struct timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static struct timespec ns_to_timespec(int64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / NSEC_PER_SEC;
+    ts.tv_nsec = ns % NSEC_PER_SEC;
+    return ts;
+}
+
+CyclicTask::CyclicTask()
+    : running(false),
+      cycles(0),
+      overruns(0),
+      last_latency(0),
+      max_latency(0) {
+}
+
+CyclicTask::~CyclicTask() {
+    stop();
+}
+
+bool CyclicTask::start(const CyclicConfig& config, std::function<void()> body) {
+    if (running.load()) {
+        EventLog::instance().message(LogLevel::Error, 0, "cyclic task already running");
+        return false;
+    }
+    if (config.period_us <= 0 || !body) {
+        EventLog::instance().message(LogLevel::Error, 0, "invalid cyclic task period: %lld us",
+                                     static_cast<long long>(config.period_us));
+        return false;
+    }
+
+    this->config = config;
+    this->body = std::move(body);
+    cycles.store(0);
+    overruns.store(0);
+    last_latency.store(0);
+    max_latency.store(0);
+    latency.reset();
+
+    if (config.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "mlockall failed: %s", strerror(errno));
+        return false;
+    }
+
+    std::promise<bool> setup;
+    std::future<bool> setup_done = setup.get_future();
+    running.store(true);
+    thread = std::thread([this, &setup]() {
+        bool ok = apply_thread_config();
+        setup.set_value(ok);
+        if (ok) {
+            run();
+        }
+    });
+
+    if (!setup_done.get()) {
+        running.store(false);
+        thread.join();
+        return false;
+    }
+    return true;
+}
+
+void CyclicTask::stop() {
+    running.store(false);
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool CyclicTask::is_running() const {
+    return running.load(std::memory_order_relaxed);
+}
+
+uint64_t CyclicTask::cycle_count() const {
+    return cycles.load(std::memory_order_relaxed);
+}
+
+uint64_t CyclicTask::overrun_count() const {
+    return overruns.load(std::memory_order_relaxed);
+}
+
+int64_t CyclicTask::last_latency_ns() const {
+    return last_latency.load(std::memory_order_relaxed);
+}
+
+int64_t CyclicTask::max_latency_ns() const {
+    return max_latency.load(std::memory_order_relaxed);
+}
+
+const LatencyHistogram& CyclicTask::latency_histogram() const {
+    return latency;
+}
+
+void CyclicTask::reset_latency() {
+    max_latency.store(0, std::memory_order_relaxed);
+    latency.reset();
+}
+
+bool CyclicTask::apply_thread_config() {
+    if (config.cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(config.cpu, &cpuset);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (err != 0) {
+            EventLog::instance().message(LogLevel::Error, 0, "failed to pin cyclic task to CPU %d: %s",
+                                         config.cpu, strerror(err));
+            return false;
+        }
+    }
+
+    if (config.priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = config.priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0) {
+            EventLog::instance().message(LogLevel::Error, 0, "failed to set SCHED_FIFO priority %d: %s",
+                                         config.priority, strerror(err));
+            return false;
+        }
+    }
+
+    if (config.prefault_stack > 0) {
+        // Touch the stack once so the first cycles do not take page faults
+        volatile unsigned char* stack = static_cast<unsigned char*>(alloca(config.prefault_stack));
+        for (size_t i = 0; i < config.prefault_stack; i += 4096) {
+            stack[i] = 0;
+        }
+    }
+    return true;
+}
+
+void CyclicTask::run() {
+    const int64_t period_ns = config.period_us * 1000;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t deadline = timespec_to_ns(now) + period_ns;
+
+    while (running.load(std::memory_order_relaxed)) {
+        struct timespec next = ns_to_timespec(deadline);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) == EINTR) {
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t wake_latency = timespec_to_ns(now) - deadline;
+        last_latency.store(wake_latency, std::memory_order_relaxed);
+        if (wake_latency > max_latency.load(std::memory_order_relaxed)) {
+            max_latency.store(wake_latency, std::memory_order_relaxed);
+        }
+        latency.record(wake_latency);
+
+        body();
+        cycles.fetch_add(1, std::memory_order_relaxed);
+
+        // Schedule on absolute deadlines, skip the periods we already missed
+        deadline += period_ns;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t late = timespec_to_ns(now) - deadline;
+        if (late >= 0) {
+            int64_t missed = late / period_ns + 1;
+            overruns.fetch_add(static_cast<uint64_t>(missed), std::memory_order_relaxed);
+            deadline += missed * period_ns;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef CYCLIC_TASK_H
+#define CYCLIC_TASK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include "latency-histogram.h"
+
+// Scheduling options for a cyclic task
+struct CyclicConfig {
+    int64_t period_us = 1000;    // Cycle period in microseconds
+    int priority = 0;            // SCHED_FIFO priority (1-99), 0 keeps the default policy
+    int cpu = -1;                // CPU to pin the thread to, -1 disables pinning
+    bool lock_memory = false;    // mlockall(MCL_CURRENT | MCL_FUTURE) before starting
+    size_t prefault_stack = 0;   // Bytes of stack to touch before entering the loop
+};
+
+// Runs a function on absolute deadlines (clock_nanosleep + TIMER_ABSTIME) in its own thread
+class CyclicTask {
+public:
+    CyclicTask();
+    ~CyclicTask();
+
+    CyclicTask(const CyclicTask&) = delete;
+    CyclicTask& operator=(const CyclicTask&) = delete;
+
+    // Start the thread, returns false if the scheduling options could not be applied
+    bool start(const CyclicConfig& config, std::function<void()> body);
+
+    // Stop the thread and wait for the current cycle to finish
+    void stop();
+
+    // Check if the thread is running
+    bool is_running() const;
+
+    // Number of completed cycles
+    uint64_t cycle_count() const;
+
+    // Number of deadlines missed because a cycle ran longer than the period
+    uint64_t overrun_count() const;
+
+    // Wake-up latency of the last cycle in nanoseconds (actual start - deadline)
+    int64_t last_latency_ns() const;
+
+    // Worst wake-up latency since start in nanoseconds
+    int64_t max_latency_ns() const;
+
+    // Distribution of wake-up latencies (cycle start jitter) since start
+    const LatencyHistogram& latency_histogram() const;
+
+    // Clear the latency histogram and the worst latency
+    void reset_latency();
+
+private:
+    // Apply priority, affinity and stack prefaulting on the calling thread
+    bool apply_thread_config();
+
+    // Thread main loop
+    void run();
+
+    CyclicConfig config;
+    std::function<void()> body;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> cycles;
+    std::atomic<uint64_t> overruns;
+    std::atomic<int64_t> last_latency;
+    std::atomic<int64_t> max_latency;
+    LatencyHistogram latency;
+};
+
+#endif // CYCLIC_TASK_H
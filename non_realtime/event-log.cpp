@@ -0,0 +1,187 @@
+#include "event-log.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <time.h>
+
+static int64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+EventLog& EventLog::instance() {
+    static EventLog log;
+    return log;
+}
+
+EventLog::EventLog()
+    : enqueue_pos(0),
+      dequeue_pos(0),
+      dropped(0),
+      logged(0),
+      running(true) {
+    for (size_t i = 0; i < CAPACITY; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    sink = [](const LogEntry& entry) {
+        char line[160];
+        format(entry, line, sizeof(line));
+        std::cerr << line << std::endl;
+    };
+    writer = std::thread([this]() { run(); });
+}
+
+EventLog::~EventLog() {
+    running.store(false);
+    if (writer.joinable()) {
+        writer.join();
+    }
+    drain();
+}
+
+bool EventLog::push(const LogEntry& entry) {
+    // Bounded MPMC ring (Vyukov): a slot is free when its sequence equals the claim position
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[pos % CAPACITY];
+        size_t seq = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.entry = entry;
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                logged.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void EventLog::event(LogLevel level, uint32_t source, LogCode code, int32_t value0, int32_t value1) {
+    LogEntry entry;
+    entry.timestamp_ns = monotonic_ns();
+    entry.source = source;
+    entry.level = level;
+    entry.code = code;
+    entry.value[0] = value0;
+    entry.value[1] = value1;
+    entry.text[0] = '\0';
+    push(entry);
+}
+
+void EventLog::message(LogLevel level, uint32_t source, const char* format, ...) {
+    LogEntry entry;
+    entry.timestamp_ns = monotonic_ns();
+    entry.source = source;
+    entry.level = level;
+    entry.code = LogCode::Message;
+    entry.value[0] = 0;
+    entry.value[1] = 0;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(entry.text, sizeof(entry.text), format, args);
+    va_end(args);
+    push(entry);
+}
+
+void EventLog::set_sink(std::function<void(const LogEntry&)> sink) {
+    // Swap under the lock, the old sink is destroyed after it is released
+    std::lock_guard<std::mutex> lock(sink_lock);
+    this->sink.swap(sink);
+}
+
+void EventLog::format(const LogEntry& entry, char* buffer, size_t size) {
+    static const char* const levels[] = {"error", "warning", "info"};
+    const char* level = levels[static_cast<int>(entry.level)];
+    char source[24];
+    if (entry.source == 0) {
+        snprintf(source, sizeof(source), "io-samurai");
+    } else {
+        snprintf(source, sizeof(source), "io-samurai.%u", entry.source);
+    }
+
+    switch (entry.code) {
+    case LogCode::ChecksumError:
+        snprintf(buffer, size, "%s: %s: checksum error: %02x != %02x", source, level,
+                 entry.value[0], entry.value[1]);
+        break;
+    case LogCode::ShortPacket:
+        snprintf(buffer, size, "%s: %s: short packet: %d bytes", source, level, entry.value[0]);
+        break;
+    case LogCode::SendFailed:
+        snprintf(buffer, size, "%s: %s: send failed: %s", source, level, strerror(entry.value[0]));
+        break;
+    case LogCode::WatchdogTrip:
+        snprintf(buffer, size, "%s: %s: watchdog tripped, frame unanswered for %d us", source, level, entry.value[0]);
+        break;
+    case LogCode::LinkRecovered:
+        snprintf(buffer, size, "%s: %s: link recovered after %d ms", source, level, entry.value[0]);
+        break;
+    case LogCode::ChainResync:
+        snprintf(buffer, size, "%s: %s: checksum chain relocked after %d rejected replies", source, level,
+                 entry.value[0]);
+        break;
+    default:
+        snprintf(buffer, size, "%s: %s: %s", source, level, entry.text);
+        break;
+    }
+}
+
+size_t EventLog::drain() {
+    // One consumer at a time, the writer thread or flush() once it has stopped
+    std::lock_guard<std::mutex> lock(sink_lock);
+    size_t count = 0;
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[pos % CAPACITY];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            break;
+        }
+        LogEntry entry = slot.entry;
+        slot.sequence.store(pos + CAPACITY, std::memory_order_release);
+        if (sink) {
+            sink(entry);
+        }
+        // Published after the sink returned, so flush() only sees written entries
+        pos++;
+        dequeue_pos.store(pos, std::memory_order_release);
+        count++;
+    }
+    return count;
+}
+
+void EventLog::flush() {
+    size_t target = enqueue_pos.load(std::memory_order_acquire);
+    while (dequeue_pos.load(std::memory_order_acquire) < target) {
+        if (!running.load()) {
+            drain();  // No writer thread any more, write the entries here
+        }
+        if (dequeue_pos.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+uint64_t EventLog::dropped_count() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t EventLog::logged_count() const {
+    return logged.load(std::memory_order_relaxed);
+}
+
+void EventLog::run() {
+    while (running.load(std::memory_order_relaxed)) {
+        if (drain() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Severity of a log entry
+enum class LogLevel : uint8_t {
+    Error,
+    Warning,
+    Info
+};
+
+// What a log entry reports, Message entries carry preformatted text
+enum class LogCode : uint16_t {
+    Message,
+    ChecksumError,   // value[0] = received checksum, value[1] = expected checksum
+    ShortPacket,     // value[0] = received length
+    SendFailed,      // value[0] = errno
+    WatchdogTrip,    // value[0] = microseconds the oldest frame stayed unanswered
+    LinkRecovered,   // value[0] = milliseconds since the watchdog tripped
+    ChainResync      // value[0] = replies rejected before the checksum chain relocked
+};
+
+// One fixed-size log record, no pointers to caller memory
+struct LogEntry {
+    int64_t timestamp_ns;   // CLOCK_MONOTONIC time of the event
+    uint32_t source;        // Board id (IoSamurai::id()), 0 for the library itself
+    LogLevel level;
+    LogCode code;
+    int32_t value[2];
+    char text[80];          // Message text (LogCode::Message only)
+};
+
+// Process-wide lock-free log. Any thread may add entries without allocating,
+// locking or doing I/O; a background thread formats and writes them out.
+// When the ring is full new entries are dropped and counted.
+class EventLog {
+public:
+    static constexpr size_t CAPACITY = 1024;
+
+    // The shared log (the writer thread starts on first use)
+    static EventLog& instance();
+
+    // Record a structured event (hot path safe)
+    void event(LogLevel level, uint32_t source, LogCode code, int32_t value0 = 0, int32_t value1 = 0);
+
+    // Record a printf-style message, truncated to fit the entry (hot path safe, but slower)
+    void message(LogLevel level, uint32_t source, const char* format, ...)
+        __attribute__((format(printf, 4, 5)));
+
+    // Replace the output function (called on the writer thread, safe while logging but not from
+    // inside the sink), default prints to stderr
+    void set_sink(std::function<void(const LogEntry&)> sink);
+
+    // Format an entry as one line of text
+    static void format(const LogEntry& entry, char* buffer, size_t size);
+
+    // Wait until everything queued so far has been passed to the sink and the sink returned;
+    // writes the entries on the calling thread once the writer thread has stopped
+    void flush();
+
+    // Number of entries dropped because the ring was full
+    uint64_t dropped_count() const;
+
+    // Number of entries accepted into the ring
+    uint64_t logged_count() const;
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+private:
+    EventLog();
+    ~EventLog();
+
+    // Claim a slot and publish the entry, returns false if the ring is full
+    bool push(const LogEntry& entry);
+
+    // Pop entries and pass them to the sink, returns the number written
+    size_t drain();
+
+    // Writer thread main loop
+    void run();
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogEntry entry;
+    };
+
+    Slot slots[CAPACITY];
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> logged;
+    std::atomic<bool> running;
+    std::mutex sink_lock;  // Held for a whole drain() and by set_sink(), producers never take it
+    std::function<void(const LogEntry&)> sink;
+    std::thread writer;
+};
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,157 @@
+#include "io-samurai-coro.h"
+
+// Board whose wait list the current thread is resuming, a co_await on it is appended directly
+static thread_local const AwaitableBoard* resuming_board = nullptr;
+
+void CycleWait::await_suspend(std::coroutine_handle<> handle) noexcept {
+    coroutine = handle;
+    board.add(this);
+}
+
+AwaitableBoard::AwaitableBoard(IoSamurai& board)
+    : io(board),
+      head(nullptr),
+      tail(nullptr),
+      previous(),
+      have_previous(false),
+      waiting_count(0),
+      incoming_head(nullptr),
+      incoming_tail(nullptr),
+      have_incoming(false) {
+    io.set_publish_callback([this](const ProcessImage& image) { resume(image); });
+}
+
+AwaitableBoard::~AwaitableBoard() {
+    io.set_publish_callback(nullptr);
+    for (CycleWait* list : {head, incoming_head}) {
+        while (list) {
+            CycleWait* next = list->next;
+            list->coroutine.destroy();
+            list = next;
+        }
+    }
+}
+
+ImageWait AwaitableBoard::cycles(uint64_t count) {
+    return ImageWait(*this, &AwaitableBoard::count_reached, count > 0 ? count : 1);
+}
+
+EdgeWait AwaitableBoard::edge(int pin, Edge edge) {
+    uint16_t mask = pin >= 0 && pin < 16 ? static_cast<uint16_t>(1u << pin) : 0;
+    return EdgeWait(*this, &AwaitableBoard::edge_seen, mask, edge);
+}
+
+ImageWait AwaitableBoard::analog_above(float threshold) {
+    return ImageWait(*this, &AwaitableBoard::above, 0, threshold);
+}
+
+ImageWait AwaitableBoard::analog_below(float threshold) {
+    return ImageWait(*this, &AwaitableBoard::below, 0, threshold);
+}
+
+size_t AwaitableBoard::waiting() const {
+    return waiting_count.load(std::memory_order_relaxed);
+}
+
+void AwaitableBoard::resume(const ProcessImage& current) {
+    if (!have_previous) {
+        previous = current; // No edges in the first image
+        have_previous = true;
+    }
+    if (have_incoming.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(incoming_mutex);
+        if (tail) {
+            tail->next = incoming_head;
+        } else {
+            head = incoming_head;
+        }
+        tail = incoming_tail;
+        incoming_head = incoming_tail = nullptr;
+        have_incoming.store(false, std::memory_order_relaxed);
+    }
+
+    // Coroutines resumed here may wait again, they go to the emptied list and are
+    // checked from the next image on; the ones still waiting stay in front of them
+    CycleWait* wait = head;
+    CycleWait* kept_head = nullptr;
+    CycleWait* kept_tail = nullptr;
+    head = tail = nullptr;
+    const AwaitableBoard* outer = resuming_board;
+    resuming_board = this;
+    while (wait) {
+        CycleWait* next = wait->next;
+        if (wait->condition(*wait, previous, current)) {
+            wait->image = current;
+            waiting_count.fetch_sub(1, std::memory_order_relaxed);
+            wait->coroutine.resume(); // May free wait
+        } else {
+            wait->next = nullptr;
+            if (kept_tail) {
+                kept_tail->next = wait;
+            } else {
+                kept_head = wait;
+            }
+            kept_tail = wait;
+        }
+        wait = next;
+    }
+    resuming_board = outer;
+    if (kept_head) {
+        kept_tail->next = head;
+        if (!head) {
+            tail = kept_tail;
+        }
+        head = kept_head;
+    }
+    previous = current;
+}
+
+void AwaitableBoard::add(CycleWait* wait) {
+    waiting_count.fetch_add(1, std::memory_order_relaxed);
+    wait->next = nullptr;
+    if (resuming_board == this) {
+        if (tail) {
+            tail->next = wait;
+        } else {
+            head = wait;
+        }
+        tail = wait;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(incoming_mutex);
+    if (incoming_tail) {
+        incoming_tail->next = wait;
+    } else {
+        incoming_head = wait;
+    }
+    incoming_tail = wait;
+    have_incoming.store(true, std::memory_order_release);
+}
+
+bool AwaitableBoard::count_reached(CycleWait& wait, const ProcessImage&, const ProcessImage&) {
+    return --wait.count == 0;
+}
+
+bool AwaitableBoard::edge_seen(CycleWait& wait, const ProcessImage& previous, const ProcessImage& current) {
+    uint16_t changed = previous.inputs ^ current.inputs;
+    uint16_t hit = 0;
+    if (static_cast<uint8_t>(wait.edge) & static_cast<uint8_t>(Edge::Rising)) {
+        hit |= changed & current.inputs;
+    }
+    if (static_cast<uint8_t>(wait.edge) & static_cast<uint8_t>(Edge::Falling)) {
+        hit |= changed & previous.inputs;
+    }
+    if (!(hit & wait.mask)) {
+        return false;
+    }
+    wait.previous_inputs = previous.inputs;
+    return true;
+}
+
+bool AwaitableBoard::above(CycleWait& wait, const ProcessImage&, const ProcessImage& current) {
+    return current.analog_in > wait.threshold;
+}
+
+bool AwaitableBoard::below(CycleWait& wait, const ProcessImage&, const ProcessImage& current) {
+    return current.analog_in < wait.threshold;
+}
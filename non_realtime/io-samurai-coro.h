@@ -0,0 +1,180 @@
+#ifndef IO_SAMURAI_CORO_H
+#define IO_SAMURAI_CORO_H
+
+#if __cplusplus < 202002L
+#error "io-samurai-coro.h needs C++20 (-std=c++20)"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include "io-samurai.h"
+
+// Coroutine that starts when it is called and frees itself when it returns. Nothing waits
+// for it: it runs on the caller's thread up to its first co_await and continues on the
+// update thread of the board it awaits.
+struct IoTask {
+    struct promise_type {
+        IoTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+class AwaitableBoard;
+
+// Suspended coroutine waiting for a condition on the images of one board. The object lives
+// in the coroutine frame while it waits and is linked into the board's wait list, so
+// waiting allocates nothing.
+class CycleWait {
+public:
+    CycleWait(const CycleWait&) = delete;
+    CycleWait& operator=(const CycleWait&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> coroutine) noexcept;
+
+protected:
+    friend class AwaitableBoard;
+
+    // Checked once per published image, true resumes the coroutine
+    using Condition = bool (*)(CycleWait& wait, const ProcessImage& previous, const ProcessImage& current);
+
+    CycleWait(AwaitableBoard& owner, Condition check, uint64_t images, uint16_t pin_mask, Edge pin_edge, float level)
+        : board(owner), condition(check), next(nullptr), image(), previous_inputs(0), count(images), mask(pin_mask),
+          edge(pin_edge), threshold(level) {}
+
+    AwaitableBoard& board;
+    Condition condition;
+    std::coroutine_handle<> coroutine;
+    CycleWait* next;
+    ProcessImage image;        // Image that satisfied the condition
+    uint16_t previous_inputs;  // Inputs of the image before it
+    uint64_t count;            // Images still to wait for (cycles())
+    uint16_t mask;             // Input bit (edge())
+    Edge edge;
+    float threshold;           // analog_above(), analog_below()
+};
+
+// co_await result: the image that satisfied the condition
+class ImageWait : public CycleWait {
+public:
+    ImageWait(AwaitableBoard& owner, Condition check, uint64_t images = 0, float level = 0.0f)
+        : CycleWait(owner, check, images, 0, Edge::Any, level) {}
+    ProcessImage await_resume() const noexcept { return image; }
+};
+
+// co_await result: the input change, like the events of IoSamurai::subscribe_inputs()
+class EdgeWait : public CycleWait {
+public:
+    EdgeWait(AwaitableBoard& owner, Condition check, uint16_t pin_mask, Edge pin_edge)
+        : CycleWait(owner, check, 0, pin_mask, pin_edge, 0.0f) {}
+    InputEvent await_resume() const noexcept {
+        InputEvent event;
+        event.cycle = image.cycle;
+        event.timestamp_ns = image.timestamp_ns;
+        event.inputs = image.inputs;
+        event.rising = image.inputs & ~previous_inputs & mask;
+        event.falling = ~image.inputs & previous_inputs & mask;
+        return event;
+    }
+};
+
+// co_await result: the image for which predicate returned true
+template <typename Predicate>
+class PredicateWait : public ImageWait {
+public:
+    PredicateWait(AwaitableBoard& owner, Predicate test)
+        : ImageWait(owner, &PredicateWait::check), predicate(std::move(test)) {}
+
+private:
+    static bool check(CycleWait& wait, const ProcessImage&, const ProcessImage& current) {
+        return static_cast<PredicateWait&>(wait).predicate(current);
+    }
+
+    Predicate predicate;
+};
+
+// Awaitable view of one board for C++20 coroutines (IoTask). Coroutines are resumed
+// directly on the board's update thread, inside publish_cycle() of the image they
+// waited for, so a group update thread runs every task of all its boards with no
+// thread switch. Conditions are checked in the order the coroutines started waiting.
+//   IoTask blink(AwaitableBoard& io) {
+//       co_await io.edge(0, Edge::Rising);
+//       io.board().set_output(0, true);
+//       co_await io.cycles(100);
+//       io.board().set_output(0, false);
+//   }
+// Installs the board's publish callback: create it before starting updates and destroy it
+// after stopping them. Coroutines still waiting then are destroyed without resuming.
+// A resumed coroutine must not block, it delays the cycle of every board of the thread.
+class AwaitableBoard {
+public:
+    explicit AwaitableBoard(IoSamurai& board);
+    ~AwaitableBoard();
+
+    AwaitableBoard(const AwaitableBoard&) = delete;
+    AwaitableBoard& operator=(const AwaitableBoard&) = delete;
+
+    // Board the coroutines act on
+    IoSamurai& board() { return io; }
+
+    // Resume with the next published image
+    ImageWait next_cycle() { return cycles(1); }
+
+    // Resume with the count-th published image from now (count >= 1)
+    ImageWait cycles(uint64_t count);
+
+    // Resume when input pin (0 to 15) changes in the direction of edge
+    EdgeWait edge(int pin, Edge edge);
+
+    // Resume with the next image whose analog input is above threshold
+    ImageWait analog_above(float threshold);
+
+    // Resume with the next image whose analog input is below threshold
+    ImageWait analog_below(float threshold);
+
+    // Resume with the next image for which predicate(image) returns true
+    template <typename Predicate>
+    PredicateWait<Predicate> until(Predicate predicate) {
+        return PredicateWait<Predicate>(*this, std::move(predicate));
+    }
+
+    // Number of coroutines waiting on this board
+    size_t waiting() const;
+
+private:
+    friend class CycleWait;
+
+    // Publish callback, on the update thread
+    void resume(const ProcessImage& current);
+
+    // Append to the wait list (update thread) or the incoming list (any other thread)
+    void add(CycleWait* wait);
+
+    // Conditions of the awaitables above
+    static bool count_reached(CycleWait& wait, const ProcessImage& previous, const ProcessImage& current);
+    static bool edge_seen(CycleWait& wait, const ProcessImage& previous, const ProcessImage& current);
+    static bool above(CycleWait& wait, const ProcessImage& previous, const ProcessImage& current);
+    static bool below(CycleWait& wait, const ProcessImage& previous, const ProcessImage& current);
+
+    IoSamurai& io;
+    CycleWait* head;
+    CycleWait* tail;
+    ProcessImage previous;
+    bool have_previous;
+    std::atomic<size_t> waiting_count;
+
+    // Coroutines that started waiting outside this board's update thread
+    std::mutex incoming_mutex;
+    CycleWait* incoming_head;
+    CycleWait* incoming_tail;
+    std::atomic<bool> have_incoming;
+};
+
+#endif // IO_SAMURAI_CORO_H
@@ -0,0 +1,544 @@
+#include "io-samurai-group.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <time.h>
+#include "event-log.h"
+
+// Control buffer for one SCM_TIMESTAMPNS message
+static constexpr size_t RX_CONTROL_SIZE = CMSG_SPACE(sizeof(struct timespec));
+
+static int64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+static int64_t timespec_ns(const struct timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+IoSamuraiGroup::IoSamuraiGroup()
+    : sockfd(-1),
+      quiet_count(0),
+      round_trip_mode(RoundTripMode::Immediate),
+      reply_timeout_ns(500000),
+      clock_offset_ns(0),
+      first_arrival_ns(0),
+      last_arrival_ns(0),
+      reply_count(0),
+      receive_buffer_per_board(DEFAULT_RECEIVE_BUFFER_PER_BOARD),
+      cycle_info(),
+      cycles(0),
+      incomplete_cycles(0) {
+    EventLog::instance();
+}
+
+IoSamuraiGroup::~IoSamuraiGroup() {
+    stop_periodic_update();
+    if (sockfd >= 0) {
+        close(sockfd);
+    }
+}
+
+bool IoSamuraiGroup::init(int local_port) {
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "socket creation failed: %s", strerror(errno));
+        return false;
+    }
+
+    struct sockaddr_in local_addr;
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(local_port);
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(sockfd, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "bind failed: %s", strerror(errno));
+        close(sockfd);
+        sockfd = -1;
+        return false;
+    }
+
+    // Set non-blocking
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+
+    // Kernel receive timestamps, replies read in one batch would otherwise share one time
+    int enable = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+        EventLog::instance().message(LogLevel::Warning, 0, "SO_TIMESTAMPNS failed: %s", strerror(errno));
+    }
+    return true;
+}
+
+IoSamurai* IoSamuraiGroup::add_board(const std::string& ip_address, int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip_address.c_str(), &addr.sin_addr) <= 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "invalid IP address: %s", ip_address.c_str());
+        return nullptr;
+    }
+    if (board_by_addr.count(address_key(addr))) {
+        EventLog::instance().message(LogLevel::Error, 0, "board already added: %s:%d", ip_address.c_str(), port);
+        return nullptr;
+    }
+
+    std::unique_ptr<IoSamurai> board(new IoSamurai());
+    board->ip_address.ip = ip_address;
+    board->ip_address.port = port;
+    board->remote_addr = addr;
+
+    board_by_addr[address_key(addr)] = boards.size();
+    remote_addrs.push_back(addr);
+    boards.push_back(std::move(board));
+    prepare_messages();
+
+    // Grow the receive buffer in powers of two, so adding many boards costs few system calls
+    if ((boards.size() & (boards.size() - 1)) == 0) {
+        set_receive_buffer(receive_buffer_per_board);
+    }
+    return boards.back().get();
+}
+
+size_t IoSamuraiGroup::size() const {
+    return boards.size();
+}
+
+IoSamurai& IoSamuraiGroup::board(size_t index) {
+    return *boards[index];
+}
+
+const IoSamurai& IoSamuraiGroup::board(size_t index) const {
+    return *boards[index];
+}
+
+uint64_t IoSamuraiGroup::address_key(const struct sockaddr_in& addr) {
+    return static_cast<uint64_t>(addr.sin_addr.s_addr) << 16 | addr.sin_port;
+}
+
+void IoSamuraiGroup::prepare_messages() {
+    const size_t count = boards.size();
+    tx_frames.assign(count, ios_tx_frame_t());
+    rx_frames.assign(count, ios_rx_frame_t());
+    tx_msgs.assign(count, mmsghdr());
+    rx_msgs.assign(count, mmsghdr());
+    tx_iov.assign(count, iovec());
+    rx_iov.assign(count, iovec());
+    rx_addrs.assign(count, sockaddr_in());
+    rx_control.assign(count * RX_CONTROL_SIZE, 0);
+    replied.assign(count, 0);
+    quiet.assign(count, 0);
+    snapshot_images.assign(count, ProcessImage());
+    group_image.resize(count);
+
+    for (size_t i = 0; i < count; i++) {
+        tx_iov[i].iov_base = &tx_frames[i];
+        tx_iov[i].iov_len = IOS_TX_FRAME_SIZE;
+        tx_msgs[i].msg_hdr.msg_name = &remote_addrs[i];
+        tx_msgs[i].msg_hdr.msg_namelen = sizeof(remote_addrs[i]);
+        tx_msgs[i].msg_hdr.msg_iov = &tx_iov[i];
+        tx_msgs[i].msg_hdr.msg_iovlen = 1;
+
+        rx_iov[i].iov_base = &rx_frames[i];
+        rx_iov[i].iov_len = IOS_RX_FRAME_SIZE;
+        rx_msgs[i].msg_hdr.msg_name = &rx_addrs[i];
+        rx_msgs[i].msg_hdr.msg_namelen = sizeof(rx_addrs[i]);
+        rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+        rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        rx_msgs[i].msg_hdr.msg_control = &rx_control[i * RX_CONTROL_SIZE];
+    }
+
+    if (uring) {
+        // Grow the ring if the boards no longer fit into one submit
+        if (count > uring->capacity() && !uring->init(sockfd, count, uring_config)) {
+            EventLog::instance().message(LogLevel::Error, 0, "io_uring disabled, using sendmmsg/recvmmsg");
+            uring.reset();
+            return;
+        }
+        uring_replies.assign(count, UringReply());
+    }
+}
+
+bool IoSamuraiGroup::enable_io_uring(const UringConfig& config) {
+    if (sockfd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring requires an initialized socket");
+        return false;
+    }
+    std::unique_ptr<UringTransport> transport(new UringTransport());
+    if (!transport->init(sockfd, boards.size(), config)) {
+        return false;
+    }
+    uring = std::move(transport);
+    uring_config = config;
+    prepare_messages();
+    return uring != nullptr;
+}
+
+bool IoSamuraiGroup::io_uring_enabled() const {
+    return uring != nullptr;
+}
+
+void IoSamuraiGroup::send_all() {
+    const size_t count = boards.size();
+    // Boards whose watchdog keeps the link quiet are left out of this cycle
+    const int64_t now = monotonic_ns();
+    quiet_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        quiet[i] = !boards[i]->watchdog_before_send(now);
+        quiet_count += quiet[i];
+    }
+    const bool all = quiet_count == 0;
+
+    if (uring) {
+        // With SQPOLL the kernel may still be reading last cycle's frames
+        if (uring->sends_in_flight() > 0) {
+            EventLog::instance().message(LogLevel::Warning, 0, "io_uring sends still in flight, cycle skipped");
+            return;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (quiet[i]) {
+                continue;
+            }
+            boards[i]->encode_frame(&tx_frames[i]);
+            uring->queue_send(&tx_frames[i], IOS_TX_FRAME_SIZE, &remote_addrs[i], boards[i]->id());
+        }
+        start_send();
+        uring->submit();
+        cycle_info.send_spread_ns = monotonic_ns() - cycle_info.send_time_ns;
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!quiet[i]) {
+            boards[i]->encode_frame(&tx_frames[i]);
+        }
+    }
+
+    // All frames are encoded first, so they leave back to back
+    start_send();
+    if (all) {
+        send_batch(0, count);
+    } else {
+        for (size_t first = 0; first < count;) {
+            size_t end = first;
+            while (end < count && !quiet[end]) {
+                end++;
+            }
+            send_batch(first, end);
+            first = end + 1;
+        }
+    }
+    cycle_info.send_spread_ns = monotonic_ns() - cycle_info.send_time_ns;
+}
+
+void IoSamuraiGroup::send_batch(size_t first, size_t end) {
+    size_t sent = first;
+    while (sent < end) {
+        int r = sendmmsg(sockfd, &tx_msgs[sent], end - sent, 0);
+        if (r <= 0) {
+            EventLog::instance().event(LogLevel::Error, 0, LogCode::SendFailed, errno);
+            break;
+        }
+        sent += r;
+    }
+}
+
+void IoSamuraiGroup::start_send() {
+    struct timespec real;
+    clock_gettime(CLOCK_REALTIME, &real);
+    cycle_info.send_time_ns = monotonic_ns();
+    clock_offset_ns = timespec_ns(real) - cycle_info.send_time_ns;
+}
+
+bool IoSamuraiGroup::route_reply(const struct sockaddr_in& addr, const ios_rx_frame_t* frame, int len,
+                                 int64_t arrival, bool stale) {
+    auto it = board_by_addr.find(address_key(addr));
+    if (it == board_by_addr.end()) {
+        return false; // Not one of our boards
+    }
+    IoSamurai& board = *boards[it->second];
+    if (stale) {
+        // Late replies still advance the board's checksum chain, so they are skipped, not dropped
+        board.skip_frame(frame, len);
+        board.stale_replies.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    board.decode_frame(frame, len, arrival);
+    if (round_trip_mode != RoundTripMode::Immediate) {
+        board.last_rtt.store(arrival - cycle_info.send_time_ns, std::memory_order_relaxed);
+        board.rtt.record(arrival - cycle_info.send_time_ns);
+    }
+    if (!replied[it->second] && !quiet[it->second]) { // A quiet board's reply answers an older frame
+        replied[it->second] = 1;
+        if (reply_count++ == 0) {
+            first_arrival_ns = arrival;
+            last_arrival_ns = arrival;
+        } else {
+            first_arrival_ns = std::min(first_arrival_ns, arrival);
+            last_arrival_ns = std::max(last_arrival_ns, arrival);
+        }
+    }
+    return true;
+}
+
+static int64_t receive_stamp(struct msghdr& msg) {
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec stamp;
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+            return timespec_ns(stamp);
+        }
+    }
+    return 0;
+}
+
+int64_t IoSamuraiGroup::arrival_ns(int64_t stamp_ns, int64_t now_ns) const {
+    // A step of the wall clock makes the stamp useless, fall back to the read time
+    int64_t arrival = stamp_ns - clock_offset_ns;
+    return stamp_ns != 0 && arrival <= now_ns && arrival > now_ns - 1000000000LL ? arrival : now_ns;
+}
+
+void IoSamuraiGroup::read_replies(bool stale) {
+    const size_t count = boards.size();
+    while (uring) {
+        size_t r = uring->reap(uring_replies.data(), uring_replies.size());
+        int64_t now = monotonic_ns();
+        for (size_t i = 0; i < r; i++) {
+            route_reply(uring_replies[i].addr, reinterpret_cast<const ios_rx_frame_t*>(uring_replies[i].data),
+                        uring_replies[i].len, arrival_ns(uring_replies[i].stamp_ns, now), stale);
+        }
+        if (r == 0 || r < uring_replies.size()) {
+            return;
+        }
+    }
+
+    while (true) {
+        for (size_t i = 0; i < count; i++) {
+            rx_msgs[i].msg_hdr.msg_namelen = sizeof(rx_addrs[i]);
+            rx_msgs[i].msg_hdr.msg_controllen = RX_CONTROL_SIZE;
+        }
+        int r = recvmmsg(sockfd, rx_msgs.data(), count, MSG_DONTWAIT, nullptr);
+        if (r <= 0) {
+            return;
+        }
+        int64_t now = monotonic_ns();
+        for (int i = 0; i < r; i++) {
+            route_reply(rx_addrs[i], &rx_frames[i], static_cast<int>(rx_msgs[i].msg_len),
+                        arrival_ns(receive_stamp(rx_msgs[i].msg_hdr), now), stale);
+        }
+        if (static_cast<size_t>(r) < count) {
+            return;
+        }
+    }
+}
+
+void IoSamuraiGroup::gather_replies() {
+    const size_t count = boards.size() - quiet_count; // Quiet boards got no frame to answer
+    const int64_t deadline = cycle_info.send_time_ns + reply_timeout_ns;
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+
+    while (reply_count < count) {
+        int64_t now = monotonic_ns();
+        if (now >= deadline) {
+            break;
+        }
+        if (uring) {
+            // Completions are only posted inside io_uring_enter()
+            if (!uring->wait(round_trip_mode == RoundTripMode::Poll ? deadline - now : 0)) {
+                break;
+            }
+        } else if (round_trip_mode == RoundTripMode::Poll) {
+            struct timespec remaining;
+            remaining.tv_sec = (deadline - now) / 1000000000LL;
+            remaining.tv_nsec = (deadline - now) % 1000000000LL;
+            if (ppoll(&pfd, 1, &remaining, nullptr) == 0) {
+                break;
+            }
+        }
+        read_replies(false);
+    }
+}
+
+void IoSamuraiGroup::recv_all() {
+    const size_t count = boards.size();
+    std::fill(replied.begin(), replied.end(), 0);
+    reply_count = 0;
+
+    // With io_uring the replies were already collected by the io_uring_enter() in send_all()
+    read_replies(false);
+    const bool synchronized = round_trip_mode != RoundTripMode::Immediate;
+    if (synchronized) {
+        gather_replies();
+    }
+
+    int64_t now = monotonic_ns();
+    size_t missing = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!replied[i]) {
+            boards[i]->decode_frame(nullptr, -1, now);
+            // A board held quiet by its watchdog got no frame, so it missed nothing
+            if (!quiet[i]) {
+                missing++;
+                if (synchronized) {
+                    boards[i]->missed_replies.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        boards[i]->publish_cycle();
+    }
+
+    cycle_info.cycle++;
+    cycle_info.replies = static_cast<uint32_t>(reply_count);
+    cycle_info.missing = static_cast<uint32_t>(missing);
+    cycle_info.reply_skew_ns = reply_count >= 2 ? last_arrival_ns - first_arrival_ns : 0;
+    cycle_info.gather_ns = 0;
+    if (synchronized) {
+        cycle_info.gather_ns = (missing == 0 && reply_count > 0 ? last_arrival_ns : now) - cycle_info.send_time_ns;
+        gather_time.record(cycle_info.gather_ns);
+    }
+    send_spread.record(cycle_info.send_spread_ns);
+    if (reply_count >= 2) {
+        reply_skew.record(cycle_info.reply_skew_ns);
+    }
+    if (missing > 0) {
+        incomplete_cycles.fetch_add(1, std::memory_order_relaxed);
+    }
+    cycles.fetch_add(1, std::memory_order_relaxed);
+    publish_snapshot();
+}
+
+void IoSamuraiGroup::publish_snapshot() {
+    for (size_t i = 0; i < boards.size(); i++) {
+        snapshot_images[i] = boards[i]->image;
+    }
+    group_image.store(cycle_info, snapshot_images.data());
+}
+
+void IoSamuraiGroup::update() {
+    if (boards.empty()) {
+        return;
+    }
+    if (round_trip_mode != RoundTripMode::Immediate) {
+        // Replies that missed an earlier deadline must not count for this cycle
+        if (uring) {
+            uring->wait(0);
+        }
+        read_replies(true);
+    }
+    send_all();
+    recv_all();
+}
+
+void IoSamuraiGroup::set_round_trip_mode(RoundTripMode mode, int timeout_us) {
+    round_trip_mode = mode;
+    reply_timeout_ns = static_cast<int64_t>(timeout_us) * 1000;
+}
+
+void IoSamuraiGroup::snapshot(GroupSnapshot& snapshot) const {
+    snapshot.boards.resize(group_image.size());
+    group_image.load(snapshot.info, snapshot.boards.data());
+}
+
+bool IoSamuraiGroup::set_receive_buffer(size_t bytes_per_board) {
+    receive_buffer_per_board = bytes_per_board;
+    if (sockfd < 0) {
+        return false;
+    }
+    size_t needed = bytes_per_board * std::max<size_t>(boards.size(), 1);
+    int wanted = needed > INT_MAX / 2 ? INT_MAX / 2 : static_cast<int>(needed);
+
+    // The kernel doubles the requested size for its bookkeeping and reports the doubled value
+    int current = 0;
+    socklen_t len = sizeof(current);
+    getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &current, &len);
+    if (current >= wanted) {
+        return true;
+    }
+    int request = wanted / 2 + 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &request, sizeof(request)) < 0) {
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &request, sizeof(request));
+    }
+    getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &current, &len);
+    if (current < wanted) {
+        EventLog::instance().message(LogLevel::Warning, 0,
+                                     "receive buffer %d bytes for %zu boards, wanted %d (raise net.core.rmem_max)",
+                                     current, boards.size(), wanted);
+        return false;
+    }
+    return true;
+}
+
+GroupStats IoSamuraiGroup::stats() const {
+    GroupStats result;
+    result.cycles = cycles.load(std::memory_order_relaxed);
+    result.incomplete_cycles = incomplete_cycles.load(std::memory_order_relaxed);
+    result.send_spread = send_spread.summary();
+    result.reply_skew = reply_skew.summary();
+    result.gather = gather_time.summary();
+    return result;
+}
+
+void IoSamuraiGroup::reset_stats() {
+    cycles.store(0, std::memory_order_relaxed);
+    incomplete_cycles.store(0, std::memory_order_relaxed);
+    send_spread.reset();
+    reply_skew.reset();
+    gather_time.reset();
+}
+
+bool IoSamuraiGroup::start_periodic_update(const CyclicConfig& config) {
+    if (sockfd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "periodic update requires an initialized socket");
+        return false;
+    }
+    return update_task.start(config, [this]() {
+        update();
+        if (cycle_callback) {
+            cycle_callback();
+        }
+    });
+}
+
+void IoSamuraiGroup::stop_periodic_update() {
+    update_task.stop();
+}
+
+void IoSamuraiGroup::set_cycle_callback(std::function<void()> callback) {
+    cycle_callback = std::move(callback);
+}
+
+uint64_t IoSamuraiGroup::cycle_count() const {
+    return update_task.cycle_count();
+}
+
+uint64_t IoSamuraiGroup::overrun_count() const {
+    return update_task.overrun_count();
+}
+
+void IoSamuraiGroup::set_capture(PacketCapture* capture) {
+    for (auto& board : boards) {
+        board->set_capture(capture);
+    }
+}
+
+void IoSamuraiGroup::set_shared_image(SharedImage* shared, size_t first_slot) {
+    for (size_t i = 0; i < boards.size(); i++) {
+        boards[i]->set_shared_image(shared, first_slot + i);
+    }
+}
+
+HistogramSummary IoSamuraiGroup::jitter() const {
+    return update_task.latency_histogram().summary();
+}
@@ -0,0 +1,208 @@
+#ifndef IO_SAMURAI_GROUP_H
+#define IO_SAMURAI_GROUP_H
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <unordered_map>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "io-samurai.h"
+#include "cyclic-task.h"
+#include "uring-transport.h"
+#include "latency-histogram.h"
+#include "seqlock.h"
+
+// Timing of one group cycle, published together with the board images
+struct GroupCycle {
+    uint64_t cycle;          // Group update that produced the snapshot
+    int64_t send_time_ns;    // CLOCK_MONOTONIC time before the first frame was sent
+    int64_t send_spread_ns;  // First to last frame handed to the kernel
+    int64_t reply_skew_ns;   // First to last reply arrival (kernel receive time), 0 with fewer than two
+    int64_t gather_ns;       // Send time to the last reply, or to the deadline if one was missing (Poll/BusyPoll)
+    uint32_t replies;        // Boards that replied in this cycle
+    uint32_t missing;        // Boards without a reply, not counting boards held quiet by their watchdog
+};
+
+// Every board of one group cycle, copied out together
+struct GroupSnapshot {
+    GroupCycle info;
+    std::vector<ProcessImage> boards;  // Indexed like IoSamuraiGroup::board()
+};
+
+// Group statistics since init() or the last reset_stats()
+struct GroupStats {
+    uint64_t cycles;              // Group updates
+    uint64_t incomplete_cycles;   // Updates where at least one board did not reply
+    HistogramSummary send_spread; // First to last frame handed to the kernel
+    HistogramSummary reply_skew;  // Inter-board skew: first to last reply arrival within a cycle
+    HistogramSummary gather;      // Send to last reply (Poll/BusyPoll)
+};
+
+// Drives many io-samurai boards from one UDP socket.
+// Every cycle sends all output frames with one sendmmsg() and collects the
+// replies with recvmmsg(), routing them to the boards by source address.
+// With enable_io_uring() both go through one io_uring_enter() instead.
+// In Poll/BusyPoll mode a cycle fires all frames back to back and gathers the
+// replies of that same cycle until every board answered or the deadline passed,
+// so the published snapshot holds all boards sampled within one round trip.
+class IoSamuraiGroup {
+public:
+    static constexpr size_t DEFAULT_RECEIVE_BUFFER_PER_BOARD = 4096; // Two replies at ~2 KiB kernel overhead each
+
+    // Constructor
+    IoSamuraiGroup();
+
+    // Destructor
+    ~IoSamuraiGroup();
+
+    IoSamuraiGroup(const IoSamuraiGroup&) = delete;
+    IoSamuraiGroup& operator=(const IoSamuraiGroup&) = delete;
+
+    // Open the shared socket on local_port. A board answers the first host port it heard from
+    // after boot (IOS_DEFAULT_PORT), so keep it fixed; 0 picks a free port (emulator only)
+    bool init(int local_port = IOS_DEFAULT_PORT);
+
+    // Add a board, returns nullptr on invalid address (call before starting updates)
+    IoSamurai* add_board(const std::string& ip_address, int port);
+
+    // Number of boards
+    size_t size() const;
+
+    // Access a board (set outputs, read snapshots)
+    IoSamurai& board(size_t index);
+    const IoSamurai& board(size_t index) const;
+
+    // Send all outputs and collect the replies (two syscalls regardless of board count, one with io_uring)
+    void update();
+
+    // Select how update() waits for the replies: Immediate reads whatever already arrived (the
+    // previous cycle), Poll/BusyPoll wait for this cycle's replies up to timeout_us after sending
+    void set_round_trip_mode(RoundTripMode mode, int timeout_us = 500);
+
+    // Consistent copy of all boards and the timing of the newest cycle (resizes snapshot.boards)
+    void snapshot(GroupSnapshot& snapshot) const;
+
+    // Size SO_RCVBUF for bytes_per_board bytes per board, so a burst of replies is not dropped
+    // (done by add_board() with the default; above net.core.rmem_max needs CAP_NET_ADMIN)
+    bool set_receive_buffer(size_t bytes_per_board = DEFAULT_RECEIVE_BUFFER_PER_BOARD);
+
+    // Cycle counters and skew percentiles (lock-free)
+    GroupStats stats() const;
+
+    // Clear the group counters and histograms
+    void reset_stats();
+
+    // Use io_uring instead of sendmmsg()/recvmmsg() (call after init(), before starting updates)
+    bool enable_io_uring(const UringConfig& config = UringConfig());
+
+    // Check if the io_uring backend is in use
+    bool io_uring_enabled() const;
+
+    // Start periodic updates in a separate thread
+    bool start_periodic_update(const CyclicConfig& config);
+
+    // Stop periodic updates
+    void stop_periodic_update();
+
+    // Function called on the update thread after every cycle (set before starting)
+    void set_cycle_callback(std::function<void()> callback);
+
+    // Number of cycles run by the update thread
+    uint64_t cycle_count() const;
+
+    // Number of missed cycle deadlines
+    uint64_t overrun_count() const;
+
+    // Record the frames of all boards added so far into capture
+    void set_capture(PacketCapture* capture);
+
+    // Publish board i into slot first_slot + i of shared (nullptr stops, set before starting)
+    void set_shared_image(SharedImage* shared, size_t first_slot = 0);
+
+    // Wake-up latency percentiles of the group update thread
+    HistogramSummary jitter() const;
+
+private:
+    // Key for the source address lookup
+    static uint64_t address_key(const struct sockaddr_in& addr);
+
+    // Rebuild the message vectors after the board list changed
+    void prepare_messages();
+
+    // Send all output frames
+    void send_all();
+
+    // Send the frames of boards first to end - 1 with sendmmsg()
+    void send_batch(size_t first, size_t end);
+
+    // Take the send time of the cycle
+    void start_send();
+
+    // Receive the replies and publish the cycle
+    void recv_all();
+
+    // Read every reply already queued on the socket, stale ones only advance the checksum chains
+    void read_replies(bool stale);
+
+    // Wait in Poll/BusyPoll mode until every board replied or the deadline passed
+    void gather_replies();
+
+    // Kernel receive time (CLOCK_REALTIME, 0 if none) on the CLOCK_MONOTONIC scale, now_ns if unusable
+    int64_t arrival_ns(int64_t stamp_ns, int64_t now_ns) const;
+
+    // Pass one reply to the board it came from, returns false if it is not one of ours
+    bool route_reply(const struct sockaddr_in& addr, const ios_rx_frame_t* frame, int len, int64_t arrival,
+                     bool stale);
+
+    // Publish the board images and the cycle timing as one snapshot
+    void publish_snapshot();
+
+    int sockfd;
+    std::vector<std::unique_ptr<IoSamurai>> boards;
+    std::vector<struct sockaddr_in> remote_addrs;
+    std::unordered_map<uint64_t, size_t> board_by_addr;
+
+    // Preallocated batch buffers, one slot per board
+    std::vector<ios_tx_frame_t> tx_frames;
+    std::vector<ios_rx_frame_t> rx_frames;
+    std::vector<struct mmsghdr> tx_msgs;
+    std::vector<struct mmsghdr> rx_msgs;
+    std::vector<struct iovec> tx_iov;
+    std::vector<struct iovec> rx_iov;
+    std::vector<struct sockaddr_in> rx_addrs;
+    std::vector<uint8_t> rx_control;     // SCM_TIMESTAMPNS buffers
+    std::vector<uint8_t> replied;
+    std::vector<uint8_t> quiet;          // Boards held quiet by their watchdog this cycle
+    size_t quiet_count;
+
+    // Cycle-synchronized round trip
+    RoundTripMode round_trip_mode;
+    int64_t reply_timeout_ns;
+    int64_t clock_offset_ns;             // CLOCK_REALTIME minus CLOCK_MONOTONIC at send time
+    int64_t first_arrival_ns;
+    int64_t last_arrival_ns;
+    size_t reply_count;
+    size_t receive_buffer_per_board;
+    GroupCycle cycle_info;
+    std::vector<ProcessImage> snapshot_images;
+    SeqlockArray<GroupCycle, ProcessImage> group_image;
+    std::atomic<uint64_t> cycles;
+    std::atomic<uint64_t> incomplete_cycles;
+    LatencyHistogram send_spread;
+    LatencyHistogram reply_skew;
+    LatencyHistogram gather_time;
+
+    // io_uring backend, nullptr when sendmmsg()/recvmmsg() are used
+    std::unique_ptr<UringTransport> uring;
+    UringConfig uring_config;
+    std::vector<UringReply> uring_replies;
+
+    CyclicTask update_task;
+    std::function<void()> cycle_callback;
+};
+
+#endif // IO_SAMURAI_GROUP_H
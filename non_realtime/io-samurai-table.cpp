@@ -0,0 +1,470 @@
+#include "io-samurai-table.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <time.h>
+#include "event-log.h"
+
+// Two replies at ~2 KiB kernel overhead each, as IoSamuraiGroup::DEFAULT_RECEIVE_BUFFER_PER_BOARD
+static constexpr size_t RECEIVE_BUFFER_PER_BOARD = 4096;
+
+static int64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+IoSamuraiTable::IoSamuraiTable()
+    : sockfd(-1),
+      count(0),
+      first_id(0),
+      lookup_mask(0),
+      cycle_info(),
+      round_trip_mode(RoundTripMode::Immediate),
+      reply_timeout_ns(500000),
+      send_time_ns(0),
+      reply_count(0),
+      valid_replies(0),
+      cycles(0),
+      replies(0),
+      missed(0),
+      checksum_errors(0),
+      resyncs(0),
+      short_packets(0),
+      stale_drops(0),
+      unknown_sources(0) {
+    EventLog::instance();
+}
+
+IoSamuraiTable::~IoSamuraiTable() {
+    stop_periodic_update();
+    if (sockfd >= 0) {
+        close(sockfd);
+    }
+}
+
+bool IoSamuraiTable::init(size_t capacity, int local_port) {
+    if (capacity < 1 || capacity > UINT32_MAX / 4) {
+        EventLog::instance().message(LogLevel::Error, 0, "invalid table capacity: %zu", capacity);
+        return false;
+    }
+    size_t lookup_size = 1;
+    while (lookup_size < capacity * 2) {
+        lookup_size <<= 1;
+    }
+    bool allocated = links.allocate(capacity) && inputs.allocate(capacity) && adc_raw.allocate(capacity) &&
+                     sent_outputs.allocate(capacity) && status.allocate(capacity) && replied.allocate(capacity) &&
+                     remote_addrs.allocate(capacity) && command_outputs.allocate(capacity) &&
+                     command_flags.allocate(capacity) && analog_ranges.allocate(capacity) &&
+                     board_counters.allocate(capacity) && rejected.allocate(capacity) &&
+                     lookup_keys.allocate(lookup_size) && lookup_boards.allocate(lookup_size) &&
+                     samples.allocate(capacity);
+    if (!allocated) {
+        EventLog::instance().message(LogLevel::Error, 0, "out of memory for %zu boards", capacity);
+        return false;
+    }
+    lookup_mask = lookup_size - 1;
+    first_id = IoSamurai::reserve_ids(static_cast<uint32_t>(capacity));
+    count = 0;
+    table_image.resize(0);
+
+    for (size_t i = 0; i < BATCH; i++) {
+        memset(&tx_msgs[i], 0, sizeof(tx_msgs[i]));
+        memset(&rx_msgs[i], 0, sizeof(rx_msgs[i]));
+        tx_iov[i].iov_base = &tx_frames[i];
+        tx_iov[i].iov_len = IOS_TX_FRAME_SIZE;
+        tx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        tx_msgs[i].msg_hdr.msg_iov = &tx_iov[i];
+        tx_msgs[i].msg_hdr.msg_iovlen = 1;
+
+        rx_iov[i].iov_base = &rx_frames[i];
+        rx_iov[i].iov_len = IOS_RX_FRAME_SIZE;
+        rx_msgs[i].msg_hdr.msg_name = &rx_addrs[i];
+        rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+        rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "socket creation failed: %s", strerror(errno));
+        return false;
+    }
+
+    struct sockaddr_in local_addr;
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(local_port);
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(sockfd, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "bind failed: %s", strerror(errno));
+        close(sockfd);
+        sockfd = -1;
+        return false;
+    }
+
+    // Set non-blocking
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+
+    // Room for the replies of every board, the kernel doubles the requested size for its bookkeeping
+    size_t needed = RECEIVE_BUFFER_PER_BOARD * capacity / 2 + 1;
+    int request = needed > INT_MAX / 2 ? INT_MAX / 2 : static_cast<int>(needed);
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &request, sizeof(request)) < 0) {
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &request, sizeof(request));
+    }
+    return true;
+}
+
+uint64_t IoSamuraiTable::address_key(const struct sockaddr_in& addr) {
+    return static_cast<uint64_t>(addr.sin_addr.s_addr) << 16 | addr.sin_port;
+}
+
+long IoSamuraiTable::find_board(uint64_t key) const {
+    // Fibonacci hashing spreads the consecutive ports of a board rack over the table
+    uint64_t slot = (key * 0x9E3779B97F4A7C15ULL) >> 20 & lookup_mask;
+    while (lookup_keys[slot] != 0) {
+        if (lookup_keys[slot] == key) {
+            return lookup_boards[slot];
+        }
+        slot = (slot + 1) & lookup_mask;
+    }
+    return -1;
+}
+
+long IoSamuraiTable::add_board(const std::string& ip_address, int port) {
+    if (count >= links.size()) {
+        EventLog::instance().message(LogLevel::Error, 0, "board table full (%zu boards)", links.size());
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip_address.c_str(), &addr.sin_addr) <= 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "invalid IP address: %s", ip_address.c_str());
+        return -1;
+    }
+    uint64_t key = address_key(addr);
+    if (key == 0 || find_board(key) >= 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "board already added: %s:%d", ip_address.c_str(), port);
+        return -1;
+    }
+
+    uint64_t slot = (key * 0x9E3779B97F4A7C15ULL) >> 20 & lookup_mask;
+    while (lookup_keys[slot] != 0) {
+        slot = (slot + 1) & lookup_mask;
+    }
+    lookup_keys[slot] = key;
+    lookup_boards[slot] = static_cast<uint32_t>(count);
+
+    size_t index = count++;
+    remote_addrs[index] = addr;
+    ios_link_reset(&links[index]);
+    analog_ranges[index].min_value.store(0.0f, std::memory_order_relaxed);
+    analog_ranges[index].max_value.store(1.0f, std::memory_order_relaxed);
+    table_image.resize(count);
+    return static_cast<long>(index);
+}
+
+size_t IoSamuraiTable::size() const {
+    return count;
+}
+
+void IoSamuraiTable::set_outputs(size_t index, uint8_t mask) {
+    command_outputs[index].store(mask, std::memory_order_relaxed);
+}
+
+void IoSamuraiTable::set_output(size_t index, int bit, bool value) {
+    if (bit < 0 || bit > 7) {
+        return;
+    }
+    uint8_t mask = static_cast<uint8_t>(1u << bit);
+    if (value) {
+        command_outputs[index].fetch_or(mask, std::memory_order_relaxed);
+    } else {
+        command_outputs[index].fetch_and(static_cast<uint8_t>(~mask), std::memory_order_relaxed);
+    }
+}
+
+uint8_t IoSamuraiTable::outputs(size_t index) const {
+    return command_outputs[index].load(std::memory_order_relaxed);
+}
+
+void IoSamuraiTable::set_flags(size_t index, uint8_t flags) {
+    command_flags[index].store(flags, std::memory_order_relaxed);
+}
+
+void IoSamuraiTable::set_analog_range(size_t index, float min_value, float max_value) {
+    analog_ranges[index].min_value.store(min_value, std::memory_order_relaxed);
+    analog_ranges[index].max_value.store(max_value, std::memory_order_relaxed);
+}
+
+float IoSamuraiTable::analog(size_t index, uint16_t raw) const {
+    float min_value = analog_ranges[index].min_value.load(std::memory_order_relaxed);
+    float max_value = analog_ranges[index].max_value.load(std::memory_order_relaxed);
+    float ratio = static_cast<float>(std::min<uint16_t>(raw, IOS_ADC_MASK)) / IOS_ADC_MASK;
+    return ratio * (max_value - min_value) + min_value;
+}
+
+BoardSample IoSamuraiTable::sample(size_t index) const {
+    BoardSample result;
+    table_image.load_item(index, result);
+    return result;
+}
+
+void IoSamuraiTable::snapshot(TableSnapshot& snapshot) const {
+    snapshot.boards.resize(table_image.size());
+    table_image.load(snapshot.info, snapshot.boards.data());
+}
+
+void IoSamuraiTable::send_all() {
+    send_time_ns = monotonic_ns();
+    for (size_t first = 0; first < count; first += BATCH) {
+        const size_t batch = std::min(BATCH, count - first);
+        for (size_t j = 0; j < batch; j++) {
+            const size_t i = first + j;
+            uint8_t out = command_outputs[i].load(std::memory_order_relaxed);
+            ios_encode_tx(&links[i].tx, &tx_frames[j], out, command_flags[i].load(std::memory_order_relaxed));
+            sent_outputs[i] = out;
+            tx_msgs[j].msg_hdr.msg_name = &remote_addrs[i];
+        }
+        size_t sent = 0;
+        while (sent < batch) {
+            int r = sendmmsg(sockfd, &tx_msgs[sent], batch - sent, 0);
+            if (r <= 0) {
+                EventLog::instance().event(LogLevel::Error, 0, LogCode::SendFailed, errno);
+                break;
+            }
+            sent += r;
+        }
+    }
+}
+
+void IoSamuraiTable::decode_reply(size_t index, const ios_rx_frame_t* frame, int len) {
+    const uint32_t source = first_id + static_cast<uint32_t>(index);
+    if (len != IOS_RX_FRAME_SIZE) {
+        EventLog::instance().event(LogLevel::Warning, source, LogCode::ShortPacket, len);
+        board_counters[index].short_packets.fetch_add(1, std::memory_order_relaxed);
+        short_packets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint8_t chain_index = links[index].rx.index;
+    int check = ios_check_rx(&links[index].rx, frame);
+    if (check == IOS_CHAIN_MISMATCH) {
+        // The chain took over the board's index, the next reply confirms it
+        EventLog::instance().event(LogLevel::Error, source, LogCode::ChecksumError, frame->checksum,
+                                   ios_jump_table[static_cast<uint8_t>(chain_index + ios_rx_sum(frame) + 1)]);
+        board_counters[index].checksum_errors.fetch_add(1, std::memory_order_relaxed);
+        checksum_errors.fetch_add(1, std::memory_order_relaxed);
+        if (rejected[index] < UINT8_MAX) {
+            rejected[index]++;
+        }
+        return;
+    }
+    if (check == IOS_CHAIN_RELOCKED) {
+        EventLog::instance().event(LogLevel::Warning, source, LogCode::ChainResync, rejected[index]);
+        board_counters[index].resyncs.fetch_add(1, std::memory_order_relaxed);
+        resyncs.fetch_add(1, std::memory_order_relaxed);
+        rejected[index] = 0;
+    }
+    inputs[index] = ios_rx_inputs(frame);
+    adc_raw[index] = ios_rx_adc(frame);
+    status[index] = ios_rx_status(frame);
+    reply_count += !replied[index];
+    replied[index] = 1;
+    valid_replies++;
+}
+
+void IoSamuraiTable::read_replies(bool stale) {
+    while (true) {
+        for (size_t j = 0; j < BATCH; j++) {
+            rx_msgs[j].msg_hdr.msg_namelen = sizeof(rx_addrs[j]);
+        }
+        int r = recvmmsg(sockfd, rx_msgs, BATCH, MSG_DONTWAIT, nullptr);
+        if (r <= 0) {
+            return;
+        }
+        for (int j = 0; j < r; j++) {
+            long index = find_board(address_key(rx_addrs[j]));
+            if (index < 0) {
+                unknown_sources.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            int len = static_cast<int>(rx_msgs[j].msg_len);
+            if (stale) {
+                // Late replies still advance the board's checksum chain, so they are skipped, not dropped
+                if (len == IOS_RX_FRAME_SIZE) {
+                    ios_skip_rx(&links[index].rx, &rx_frames[j]);
+                }
+                stale_drops.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            decode_reply(static_cast<size_t>(index), &rx_frames[j], len);
+        }
+        if (static_cast<size_t>(r) < BATCH) {
+            return;
+        }
+    }
+}
+
+void IoSamuraiTable::gather_replies() {
+    const int64_t deadline = send_time_ns + reply_timeout_ns;
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+
+    while (reply_count < count) {
+        int64_t now = monotonic_ns();
+        if (now >= deadline) {
+            break;
+        }
+        if (round_trip_mode == RoundTripMode::Poll) {
+            struct timespec remaining;
+            remaining.tv_sec = (deadline - now) / 1000000000LL;
+            remaining.tv_nsec = (deadline - now) % 1000000000LL;
+            if (ppoll(&pfd, 1, &remaining, nullptr) == 0) {
+                break;
+            }
+        }
+        read_replies(false);
+    }
+}
+
+void IoSamuraiTable::publish_cycle() {
+    for (size_t i = 0; i < count; i++) {
+        BoardSample& out = samples[i];
+        out.inputs = inputs[i];
+        out.adc_raw = adc_raw[i];
+        out.outputs = sent_outputs[i];
+        out.status = status[i];
+        out.connected = replied[i];
+        out.reserved = 0;
+        if (!replied[i]) {
+            board_counters[i].missed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    cycle_info.cycle++;
+    cycle_info.timestamp_ns = monotonic_ns();
+    cycle_info.replies = static_cast<uint32_t>(reply_count);
+    cycle_info.missing = static_cast<uint32_t>(count - reply_count);
+    table_image.store(cycle_info, samples.data());
+
+    cycles.fetch_add(1, std::memory_order_relaxed);
+    replies.fetch_add(valid_replies, std::memory_order_relaxed);
+    missed.fetch_add(count - reply_count, std::memory_order_relaxed);
+}
+
+void IoSamuraiTable::update() {
+    if (count == 0) {
+        return;
+    }
+    if (round_trip_mode != RoundTripMode::Immediate) {
+        // Replies that missed an earlier deadline must not count for this cycle
+        read_replies(true);
+    }
+    send_all();
+
+    memset(replied.data(), 0, count);
+    reply_count = 0;
+    valid_replies = 0;
+    read_replies(false);
+    if (round_trip_mode != RoundTripMode::Immediate) {
+        gather_replies();
+    }
+    publish_cycle();
+}
+
+void IoSamuraiTable::set_round_trip_mode(RoundTripMode mode, int timeout_us) {
+    round_trip_mode = mode;
+    reply_timeout_ns = static_cast<int64_t>(timeout_us) * 1000;
+}
+
+BoardCounters IoSamuraiTable::counters(size_t index) const {
+    BoardCounters result;
+    result.missed = board_counters[index].missed.load(std::memory_order_relaxed);
+    result.checksum_errors = board_counters[index].checksum_errors.load(std::memory_order_relaxed);
+    result.resyncs = board_counters[index].resyncs.load(std::memory_order_relaxed);
+    result.short_packets = board_counters[index].short_packets.load(std::memory_order_relaxed);
+    return result;
+}
+
+TableStats IoSamuraiTable::stats() const {
+    TableStats result;
+    result.cycles = cycles.load(std::memory_order_relaxed);
+    result.replies = replies.load(std::memory_order_relaxed);
+    result.missed = missed.load(std::memory_order_relaxed);
+    result.checksum_errors = checksum_errors.load(std::memory_order_relaxed);
+    result.resyncs = resyncs.load(std::memory_order_relaxed);
+    result.short_packets = short_packets.load(std::memory_order_relaxed);
+    result.stale_drops = stale_drops.load(std::memory_order_relaxed);
+    result.unknown_sources = unknown_sources.load(std::memory_order_relaxed);
+    return result;
+}
+
+void IoSamuraiTable::reset_stats() {
+    cycles.store(0, std::memory_order_relaxed);
+    replies.store(0, std::memory_order_relaxed);
+    missed.store(0, std::memory_order_relaxed);
+    checksum_errors.store(0, std::memory_order_relaxed);
+    resyncs.store(0, std::memory_order_relaxed);
+    short_packets.store(0, std::memory_order_relaxed);
+    stale_drops.store(0, std::memory_order_relaxed);
+    unknown_sources.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < count; i++) {
+        board_counters[i].missed.store(0, std::memory_order_relaxed);
+        board_counters[i].checksum_errors.store(0, std::memory_order_relaxed);
+        board_counters[i].resyncs.store(0, std::memory_order_relaxed);
+        board_counters[i].short_packets.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t IoSamuraiTable::memory_bytes() const {
+    size_t arrays = links.bytes() + inputs.bytes() + adc_raw.bytes() + sent_outputs.bytes() + status.bytes() +
+                    replied.bytes() + remote_addrs.bytes() + command_outputs.bytes() + command_flags.bytes() +
+                    analog_ranges.bytes() + board_counters.bytes() + rejected.bytes() + lookup_keys.bytes() +
+                    lookup_boards.bytes() + samples.bytes();
+    // The sequence-locked copy keeps one 8-byte word per board
+    return sizeof(*this) + arrays + (count + 3) * sizeof(uint64_t);
+}
+
+size_t IoSamuraiTable::hot_bytes_per_board() {
+    // Chains, inputs, ADC, sent outputs, status, reply flag, address, commands, sample and its published copy
+    return sizeof(ios_link_t) + 2 * sizeof(uint16_t) + 3 * sizeof(uint8_t) + sizeof(struct sockaddr_in) +
+           2 * sizeof(uint8_t) + 2 * sizeof(BoardSample);
+}
+
+bool IoSamuraiTable::start_periodic_update(const CyclicConfig& config) {
+    if (sockfd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "periodic update requires an initialized socket");
+        return false;
+    }
+    return update_task.start(config, [this]() {
+        update();
+        if (cycle_callback) {
+            cycle_callback();
+        }
+    });
+}
+
+void IoSamuraiTable::stop_periodic_update() {
+    update_task.stop();
+}
+
+void IoSamuraiTable::set_cycle_callback(std::function<void()> callback) {
+    cycle_callback = std::move(callback);
+}
+
+uint64_t IoSamuraiTable::cycle_count() const {
+    return update_task.cycle_count();
+}
+
+uint64_t IoSamuraiTable::overrun_count() const {
+    return update_task.overrun_count();
+}
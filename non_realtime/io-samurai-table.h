@@ -0,0 +1,313 @@
+#ifndef IO_SAMURAI_TABLE_H
+#define IO_SAMURAI_TABLE_H
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <new>
+#include <functional>
+#include <atomic>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "io-samurai.h"
+#include "cyclic-task.h"
+#include "seqlock.h"
+
+// One board of a table cycle, packed into a single 8-byte word
+struct BoardSample {
+    uint16_t inputs;     // Input bits 0-15
+    uint16_t adc_raw;    // Raw 12-bit ADC value
+    uint8_t outputs;     // Output bits sent in this cycle
+    uint8_t status;      // Board status bits (STATUS_*)
+    uint8_t connected;   // A reply with a valid checksum was read in this cycle
+    uint8_t reserved;
+};
+
+// Timing of one table cycle, published together with the board samples
+struct TableCycle {
+    uint64_t cycle;          // Table update that produced the snapshot
+    int64_t timestamp_ns;    // CLOCK_MONOTONIC time after the replies were read
+    uint32_t replies;        // Boards that replied in this cycle
+    uint32_t missing;        // Boards without a reply
+};
+
+// Every board of one table cycle, copied out together
+struct TableSnapshot {
+    TableCycle info;
+    std::vector<BoardSample> boards;  // Indexed like the add_board() results
+};
+
+// Per-board counters, only touched when something goes wrong
+struct BoardCounters {
+    uint64_t missed;            // Cycles without a valid reply
+    uint64_t checksum_errors;   // Replies with a wrong checksum
+    uint64_t resyncs;           // Checksum chain relocked after wrong checksums
+    uint64_t short_packets;     // Replies with the wrong length
+};
+
+// Table statistics since init() or the last reset_stats()
+struct TableStats {
+    uint64_t cycles;            // Table updates
+    uint64_t replies;           // Valid replies, all boards
+    uint64_t missed;            // Board cycles without a valid reply
+    uint64_t checksum_errors;
+    uint64_t resyncs;
+    uint64_t short_packets;
+    uint64_t stale_drops;       // Late replies skipped before sending (Poll/BusyPoll)
+    uint64_t unknown_sources;   // Datagrams from addresses that are not in the table
+};
+
+// Values of one kind for every board of a table, starting on a cache line of their own and
+// padded to whole lines, so two arrays never share a line. Allocated once, never moves.
+template <typename T>
+class CacheLineArray {
+public:
+    static constexpr size_t LINE = 64;
+
+    CacheLineArray() : items(nullptr), count(0) {}
+    ~CacheLineArray() { release(); }
+
+    CacheLineArray(const CacheLineArray&) = delete;
+    CacheLineArray& operator=(const CacheLineArray&) = delete;
+
+    // Make room for size value-initialized entries, returns false if out of memory
+    bool allocate(size_t size) {
+        release();
+        void* memory = aligned_alloc(LINE, bytes_for(size));
+        if (!memory) {
+            return false;
+        }
+        items = static_cast<T*>(memory);
+        count = size;
+        for (size_t i = 0; i < count; i++) {
+            new (&items[i]) T();
+        }
+        return true;
+    }
+
+    T& operator[](size_t index) { return items[index]; }
+    const T& operator[](size_t index) const { return items[index]; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    size_t size() const { return count; }
+
+    // Allocated bytes, whole cache lines
+    size_t bytes() const { return items ? bytes_for(count) : 0; }
+
+private:
+    static size_t bytes_for(size_t size) {
+        size_t bytes = size * sizeof(T);
+        return bytes == 0 ? LINE : (bytes + LINE - 1) / LINE * LINE;
+    }
+
+    void release() {
+        for (size_t i = 0; i < count; i++) {
+            items[i].~T();
+        }
+        free(items);
+        items = nullptr;
+        count = 0;
+    }
+
+    T* items;
+    size_t count;
+};
+
+// Drives thousands of io-samurai boards from one UDP socket with the per-board state kept
+// as a struct of arrays. The update thread sweeps the hot arrays (checksum chains, inputs,
+// ADC values, outputs) front to back, a few bytes per board, and never touches the
+// configuration, the counters or the lines the application writes its output commands to.
+// Readers get the boards through a sequence-locked copy, not the arrays the update thread
+// works on. Frames go out and come in with sendmmsg()/recvmmsg() in batches of BATCH, so the
+// batch buffers stay the same size for any number of boards.
+//
+// Compared to IoSamuraiGroup there are no per-board sockets, threads, subscriptions, watchdog,
+// histograms, analog filter or capture: a board that stays silent shows up as missing, and once
+// it answers again the checksum chains relock on their own (ios_check_rx() here, ios_check_tx()
+// on the board). Use IoSamuraiGroup when a board needs any of those.
+class IoSamuraiTable {
+public:
+    static constexpr size_t BATCH = 256; // Frames per sendmmsg()/recvmmsg() call
+
+    // Constructor
+    IoSamuraiTable();
+
+    // Destructor
+    ~IoSamuraiTable();
+
+    IoSamuraiTable(const IoSamuraiTable&) = delete;
+    IoSamuraiTable& operator=(const IoSamuraiTable&) = delete;
+
+    // Allocate the arrays for up to capacity boards and open the socket on local_port. A board
+    // answers the first host port it heard from after boot (IOS_DEFAULT_PORT), so keep it fixed;
+    // 0 picks a free port (emulator only)
+    bool init(size_t capacity, int local_port = IOS_DEFAULT_PORT);
+
+    // Add a board, returns its index or -1 on an invalid or duplicate address or a full table
+    // (call before starting updates)
+    long add_board(const std::string& ip_address, int port);
+
+    // Number of boards
+    size_t size() const;
+
+    // Set all outputs of board index (any thread, sent with the next cycle)
+    void set_outputs(size_t index, uint8_t mask);
+
+    // Set output bit (0 to 7) of board index (any thread)
+    void set_output(size_t index, int bit, bool value);
+
+    // Output bits the application set for board index
+    uint8_t outputs(size_t index) const;
+
+    // Set the IOS_FLAG_* bits sent to board index (board side low-pass filter, OLED off)
+    void set_flags(size_t index, uint8_t flags);
+
+    // Range the raw ADC value of board index is scaled to by analog()
+    void set_analog_range(size_t index, float min_value, float max_value);
+
+    // Scale a raw ADC value of board index to its analog range
+    float analog(size_t index, uint16_t adc_raw) const;
+
+    // Last published sample of board index (lock-free)
+    BoardSample sample(size_t index) const;
+
+    // Consistent copy of all boards and the timing of the newest cycle (resizes snapshot.boards)
+    void snapshot(TableSnapshot& snapshot) const;
+
+    // Send all outputs and collect the replies
+    void update();
+
+    // Select how update() waits for the replies: Immediate reads whatever already arrived (the
+    // previous cycle), Poll/BusyPoll wait for this cycle's replies up to timeout_us after sending
+    void set_round_trip_mode(RoundTripMode mode, int timeout_us = 500);
+
+    // Counters of board index (lock-free)
+    BoardCounters counters(size_t index) const;
+
+    // Counters of the whole table (lock-free)
+    TableStats stats() const;
+
+    // Clear the table and board counters
+    void reset_stats();
+
+    // Bytes allocated for the board arrays and the batch buffers
+    size_t memory_bytes() const;
+
+    // Bytes per board the update thread touches every cycle
+    static size_t hot_bytes_per_board();
+
+    // Start periodic updates in a separate thread
+    bool start_periodic_update(const CyclicConfig& config);
+
+    // Stop periodic updates
+    void stop_periodic_update();
+
+    // Function called on the update thread after every cycle (set before starting)
+    void set_cycle_callback(std::function<void()> callback);
+
+    // Number of cycles run by the update thread
+    uint64_t cycle_count() const;
+
+    // Number of missed cycle deadlines
+    uint64_t overrun_count() const;
+
+private:
+    // Raw ADC range of a board, read by analog() on the application side
+    struct AnalogRange {
+        std::atomic<float> min_value;
+        std::atomic<float> max_value;
+    };
+
+    // Counters of a board, written by the update thread on errors only
+    struct Counters {
+        std::atomic<uint64_t> missed;
+        std::atomic<uint64_t> checksum_errors;
+        std::atomic<uint64_t> resyncs;
+        std::atomic<uint64_t> short_packets;
+    };
+
+    // Key for the source address lookup
+    static uint64_t address_key(const struct sockaddr_in& addr);
+
+    // Board index of a source address, -1 if unknown
+    long find_board(uint64_t key) const;
+
+    // Encode and send the frames of all boards, BATCH at a time
+    void send_all();
+
+    // Read every reply already queued on the socket, stale ones only advance the checksum chains
+    void read_replies(bool stale);
+
+    // Check one reply and store its data in the hot arrays
+    void decode_reply(size_t index, const ios_rx_frame_t* frame, int len);
+
+    // Wait in Poll/BusyPoll mode until every board replied or the deadline passed
+    void gather_replies();
+
+    // Pack the hot arrays into samples and publish them with the cycle timing
+    void publish_cycle();
+
+    int sockfd;
+    size_t count;
+    uint32_t first_id;       // Log source id of board 0 (IoSamurai::reserve_ids)
+
+    // Hot: read and written by the update thread every cycle, nothing else touches them
+    CacheLineArray<ios_link_t> links;
+    CacheLineArray<uint16_t> inputs;
+    CacheLineArray<uint16_t> adc_raw;
+    CacheLineArray<uint8_t> sent_outputs;
+    CacheLineArray<uint8_t> status;
+    CacheLineArray<uint8_t> replied;
+    CacheLineArray<struct sockaddr_in> remote_addrs;   // Read only
+
+    // Written by the application, read by the update thread when it encodes the frames
+    CacheLineArray<std::atomic<uint8_t>> command_outputs;
+    CacheLineArray<std::atomic<uint8_t>> command_flags;
+
+    // Cold: configuration and counters
+    CacheLineArray<AnalogRange> analog_ranges;
+    CacheLineArray<Counters> board_counters;
+    CacheLineArray<uint8_t> rejected;   // Replies rejected since the chain lost step
+
+    // Open addressing table from address_key() to board index, twice the capacity rounded
+    // up to a power of two, key 0 marks a free slot
+    CacheLineArray<uint64_t> lookup_keys;
+    CacheLineArray<uint32_t> lookup_boards;
+    uint64_t lookup_mask;
+
+    // Batch buffers, reused for every BATCH boards
+    ios_tx_frame_t tx_frames[BATCH];
+    ios_rx_frame_t rx_frames[BATCH];
+    struct mmsghdr tx_msgs[BATCH];
+    struct mmsghdr rx_msgs[BATCH];
+    struct iovec tx_iov[BATCH];
+    struct iovec rx_iov[BATCH];
+    struct sockaddr_in rx_addrs[BATCH];
+
+    // Published copy for readers
+    CacheLineArray<BoardSample> samples;
+    SeqlockArray<TableCycle, BoardSample> table_image;
+    TableCycle cycle_info;
+
+    RoundTripMode round_trip_mode;
+    int64_t reply_timeout_ns;
+    int64_t send_time_ns;
+    size_t reply_count;      // Boards that replied in this cycle
+    size_t valid_replies;    // Replies with a valid checksum in this cycle, late ones included
+
+    // Table counters, written by the update thread
+    std::atomic<uint64_t> cycles;
+    std::atomic<uint64_t> replies;
+    std::atomic<uint64_t> missed;
+    std::atomic<uint64_t> checksum_errors;
+    std::atomic<uint64_t> resyncs;
+    std::atomic<uint64_t> short_packets;
+    std::atomic<uint64_t> stale_drops;
+    std::atomic<uint64_t> unknown_sources;
+
+    CyclicTask update_task;
+    std::function<void()> cycle_callback;
+};
+
+#endif // IO_SAMURAI_TABLE_H
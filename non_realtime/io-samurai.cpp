@@ -5,42 +5,92 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <climits>
 #include <cstring>
-#include <iostream>
+#include <cerrno>
 #include <cmath>
-#include "jump_table.h"
+#include <time.h>
+#include <poll.h>
+#include "event-log.h"
+
+static int64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
 
-// Placeholder jump_table (replace with actual implementation)
-uint8_t IoSamurai::jump_tbl[256];
+static std::atomic<uint32_t> next_board_id(1);
 
 IoSamurai::IoSamurai()
-    : sockfd(-1),
-      rx_buffer(RX_BUFFER_SIZE, 0),
-      tx_buffer(TX_BUFFER_SIZE, 0),
-      input_data(16, false),
-      output_data(8, false),
-      analog_in(0.0f),
-      analog_in_s32(0),
+    : board_id(next_board_id.fetch_add(1)),
+      sockfd(-1),
+      output_data(0),
       analog_min(0.0f),
       analog_max(1.0f),
       analog_lowpass(false),
       analog_rounding(false),
       oled_off(false),
-      connected(false),
-      current_time(0),
-      last_received_time(0),
-      watchdog_running(false),
-      watchdog_expired(false),
       error_triggered(false),
-      checksum_index(1),
-      checksum_index_in(1),
       previous_analog(0.0f),
-      first_analog_sample(true) {
+      first_analog_sample(true),
+      round_trip_mode(RoundTripMode::Immediate),
+      reply_timeout_ns(500000),
+      last_rtt(0),
+      missed_replies(0),
+      stale_replies(0),
+      good_replies(0),
+      checksum_errors(0),
+      resyncs(0),
+      resync_rejected(0),
+      short_packets(0),
+      reconnects(0),
+      link_up(false),
+      link_seen(false),
+      watchdog_running(false),
+      watchdog_status(WatchdogState::Off),
+      watchdog_reset_request(false),
+      last_received_time(0),
+      watchdog_last_send(0),
+      watchdog_pending_since(0),
+      watchdog_trip_time(0),
+      watchdog_quiet_until(0),
+      watchdog_probe_time(0),
+      watchdog_trips(0),
+      have_inputs(false),
+      changed_rising(0),
+      changed_falling(0),
+      changed_time_ns(0),
+      retire_pending(false),
+      dropped_events(0),
+      next_sequence(1),
+      oldest_sequence(1),
+      expired_unanswered(0),
+      expired_quiet_since(0),
+      max_in_flight(4),
+      requests_in_flight(0),
+      dropped_completions(0),
+      capture(nullptr),
+      shared(nullptr),
+      shared_slot(0) {
     memset(&local_addr, 0, sizeof(local_addr));
     memset(&remote_addr, 0, sizeof(remote_addr));
+    memset(&rx_frame, 0, sizeof(rx_frame));
+    memset(&tx_frame, 0, sizeof(tx_frame));
+    ios_link_reset(&link);
+    memset(&image, 0, sizeof(image));
+    process_image.store(image);
+    for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+        subscribers[i].state.store(SLOT_FREE, std::memory_order_relaxed);
+        subscribers[i].queue = nullptr;
+    }
+
+    // Create the log (and its writer thread) now, not on the first error in the hot path
+    EventLog::instance();
 }
 
 IoSamurai::~IoSamurai() {
+    stop_periodic_update();
     if (sockfd >= 0) {
         close(sockfd);
     }
@@ -50,21 +100,28 @@ bool IoSamurai::init(const std::string& ip_address, int port) {
     this->ip_address.ip = ip_address;
     this->ip_address.port = port;
 
-    memcpy(jump_tbl, jump_table, sizeof(jump_table));
-
     if (!init_socket()) {
-        std::cerr << "Failed to initialize socket" << std::endl;
+        EventLog::instance().message(LogLevel::Error, board_id, "failed to initialize socket");
         return false;
     }
 
-    std::cout << "IoSamurai initialized with IP: " << ip_address << ", Port: " << port << std::endl;
+    EventLog::instance().message(LogLevel::Info, board_id, "initialized with IP: %s, Port: %d",
+                                 ip_address.c_str(), port);
     return true;
 }
 
+uint32_t IoSamurai::id() const {
+    return board_id;
+}
+
+uint32_t IoSamurai::reserve_ids(uint32_t count) {
+    return next_board_id.fetch_add(count);
+}
+
 bool IoSamurai::init_socket() {
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
-        std::cerr << "Socket creation failed: " << strerror(errno) << std::endl;
+        EventLog::instance().message(LogLevel::Error, board_id, "socket creation failed: %s", strerror(errno));
         return false;
     }
 
@@ -73,7 +130,7 @@ bool IoSamurai::init_socket() {
     local_addr.sin_addr.s_addr = INADDR_ANY;
 
     if (bind(sockfd, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
-        std::cerr << "Bind failed: " << strerror(errno) << std::endl;
+        EventLog::instance().message(LogLevel::Error, board_id, "bind failed: %s", strerror(errno));
         close(sockfd);
         sockfd = -1;
         return false;
@@ -87,7 +144,7 @@ bool IoSamurai::init_socket() {
     remote_addr.sin_family = AF_INET;
     remote_addr.sin_port = htons(ip_address.port);
     if (inet_pton(AF_INET, ip_address.ip.c_str(), &remote_addr.sin_addr) <= 0) {
-        std::cerr << "Invalid IP address: " << ip_address.ip << std::endl;
+        EventLog::instance().message(LogLevel::Error, board_id, "invalid IP address: %s", ip_address.ip.c_str());
         close(sockfd);
         sockfd = -1;
         return false;
@@ -98,29 +155,47 @@ bool IoSamurai::init_socket() {
 
 void IoSamurai::set_output(int index, bool value) {
     if (index >= 0 && index < 8) {
-        output_data[index] = value;
+        if (value) {
+            output_data.fetch_or(static_cast<uint8_t>(1 << index), std::memory_order_relaxed);
+        } else {
+            output_data.fetch_and(static_cast<uint8_t>(~(1 << index)), std::memory_order_relaxed);
+        }
     }
 }
 
 void IoSamurai::reset_output(int index) {
-    if (index >= 0 && index < 8) {
-        output_data[index] = false;
-    }
+    set_output(index, false);
+}
+
+void IoSamurai::set_outputs_mask(uint8_t mask) {
+    output_data.store(mask, std::memory_order_relaxed);
+}
+
+uint8_t IoSamurai::outputs_mask() const {
+    return output_data.load(std::memory_order_relaxed);
 }
 
 bool IoSamurai::get_input(int index) const {
     if (index >= 0 && index < 16) {
-        return input_data[index];
+        return (inputs_mask() >> index) & 0x01;
     }
     return false;
 }
 
+uint16_t IoSamurai::inputs_mask() const {
+    return process_image.load().inputs;
+}
+
+ProcessImage IoSamurai::snapshot() const {
+    return process_image.load();
+}
+
 float IoSamurai::get_analog_in() const {
-    return analog_in;
+    return process_image.load().analog_in;
 }
 
 int32_t IoSamurai::get_analog_in_s32() const {
-    return analog_in_s32;
+    return process_image.load().analog_in_s32;
 }
 
 void IoSamurai::set_analog_range(float min_value, float max_value) {
@@ -141,7 +216,7 @@ void IoSamurai::set_oled_off(bool off) {
 }
 
 bool IoSamurai::is_connected() const {
-    return connected;
+    return process_image.load().connected;
 }
 
 float IoSamurai::low_pass_filter(float new_sample, float previous_filtered, bool& first_sample) {
@@ -159,81 +234,720 @@ float IoSamurai::scale_adc(uint16_t adc_in, float min_value, float max_value) {
     return ratio * (max_value - min_value) + min_value;
 }
 
-void IoSamurai::udp_io_process_send() {
-    tx_buffer[0] = 0;
-    for (int i = 0; i < 8; i++) {
-        tx_buffer[0] |= (output_data[i] ? 1 : 0) << i;
+void IoSamurai::encode_frame(ios_tx_frame_t* frame) {
+    uint8_t flags = 0;
+    if (oled_off.load(std::memory_order_relaxed)) {
+        flags |= IOS_FLAG_OLED_OFF;
+    }
+    if (analog_lowpass.load(std::memory_order_relaxed)) {
+        flags |= IOS_FLAG_LOWPASS;
     }
 
-    tx_buffer[1] = 0;
-    if (oled_off) {
-        tx_buffer[1] = set_bit(tx_buffer[1], 1, 1);
+    uint8_t outputs = output_data.load(std::memory_order_relaxed);
+    if (watchdog_running && watchdog_status.load(std::memory_order_relaxed) != WatchdogState::Armed) {
+        outputs = watchdog.safe_outputs;
     }
-    if (analog_lowpass) {
-        tx_buffer[1] = set_bit(tx_buffer[1], 0, 1);
+    ios_encode_tx(&link.tx, frame, outputs, flags);
+    image.outputs = frame->outputs;
+    if (capture) {
+        capture->record(board_id, CaptureDirection::Tx, reinterpret_cast<const uint8_t*>(frame),
+                        IOS_TX_FRAME_SIZE, monotonic_ns());
     }
-
-    checksum_index += tx_buffer[0] + tx_buffer[1] + 1;
-    tx_buffer[2] = jump_tbl[checksum_index];
-
-    sendto(sockfd, tx_buffer.data(), TX_BUFFER_SIZE, 0,
-           (struct sockaddr*)&remote_addr, sizeof(remote_addr));
-    std::fill(tx_buffer.begin(), tx_buffer.end(), 0);
 }
 
-void IoSamurai::udp_io_process_recv() {
-
-    socklen_t addr_len = sizeof(remote_addr);
-    int len = recvfrom(sockfd, rx_buffer.data(), RX_BUFFER_SIZE, 0, nullptr, nullptr);
-
-    if (len == RX_BUFFER_SIZE) {
-        checksum_index_in += rx_buffer[0] + rx_buffer[1] + rx_buffer[2] + rx_buffer[3] + 1;
-        uint8_t calc_checksum = jump_tbl[checksum_index_in];
-        if (calc_checksum == rx_buffer[4]) {
-            connected = true;
-            last_received_time = current_time;
-
-            // Parse inputs
-            for (int i = 0; i < 8; i++) {
-                input_data[i] = (rx_buffer[0] >> i) & 0x01;
-                input_data[i + 8] = (rx_buffer[1] >> i) & 0x01;
+void IoSamurai::decode_frame(const ios_rx_frame_t* frame, int len, int64_t now_ns) {
+    if (capture) {
+        capture->record(board_id, len >= 0 ? CaptureDirection::Rx : CaptureDirection::RxMissing,
+                        reinterpret_cast<const uint8_t*>(frame), len, now_ns);
+    }
+    if (len == IOS_RX_FRAME_SIZE) {
+        uint8_t index = link.rx.index;
+        int check = ios_check_rx(&link.rx, frame);
+        if (check != IOS_CHAIN_MISMATCH) {
+            if (check == IOS_CHAIN_RELOCKED) {
+                resyncs.fetch_add(1, std::memory_order_relaxed);
+                EventLog::instance().event(LogLevel::Warning, board_id, LogCode::ChainResync,
+                                           static_cast<int32_t>(resync_rejected));
             }
+            resync_rejected = 0;
+            image.connected = true;
+            image.timestamp_ns = now_ns;
+            good_replies.fetch_add(1, std::memory_order_relaxed);
+            last_received_time = now_ns;
+            // A frame sent after this reply arrived is still waiting for its own
+            watchdog_pending_since = watchdog_last_send > now_ns ? watchdog_last_send : 0;
+
+            // Parse inputs, the first valid reply is the baseline for edge detection
+            uint16_t inputs = ios_rx_inputs(frame);
+            uint16_t changed = have_inputs ? inputs ^ image.inputs : 0;
+            if (changed) {
+                changed_rising |= changed & inputs;
+                changed_falling |= changed & ~inputs;
+                changed_time_ns = image.timestamp_ns;
+            }
+            have_inputs = true;
+            image.inputs = inputs;
+            image.status = ios_rx_status(frame);
 
             // Parse ADC
-            uint16_t raw_adc = (rx_buffer[3] << 8 | rx_buffer[2]) & 0xfff;
-            float scaled_adc = scale_adc(raw_adc, analog_min, analog_max);
-            if (analog_lowpass) {
+            uint16_t raw_adc = ios_rx_adc(frame);
+            float scaled_adc = scale_adc(raw_adc, analog_min.load(std::memory_order_relaxed),
+                                         analog_max.load(std::memory_order_relaxed));
+            if (analog_lowpass.load(std::memory_order_relaxed)) {
                 scaled_adc = low_pass_filter(scaled_adc, previous_analog, first_analog_sample);
                 previous_analog = scaled_adc;
             }
-            if (analog_rounding) {
+            if (analog_rounding.load(std::memory_order_relaxed)) {
                 scaled_adc = std::round(scaled_adc);
             }
-            analog_in = scaled_adc;
-            analog_in_s32 = static_cast<int32_t>(scaled_adc);
+            image.adc_raw = raw_adc;
+            image.analog_in = scaled_adc;
+            image.analog_in_s32 = static_cast<int32_t>(scaled_adc);
         } else {
-            std::cerr << "Checksum error: " << static_cast<int>(rx_buffer[4])
-                      << " != " << static_cast<int>(calc_checksum) << std::endl;
-            connected = false;
+            // The chain took over the board's index, the next reply confirms it
+            EventLog::instance().event(LogLevel::Error, board_id, LogCode::ChecksumError, frame->checksum,
+                                       ios_jump_table[static_cast<uint8_t>(index + ios_rx_sum(frame) + 1)]);
+            checksum_errors.fetch_add(1, std::memory_order_relaxed);
+            resync_rejected++;
+            image.connected = false;
         }
     } else {
-        connected = false;
+        if (len >= 0) {
+            EventLog::instance().event(LogLevel::Warning, board_id, LogCode::ShortPacket, len);
+            short_packets.fetch_add(1, std::memory_order_relaxed);
+        }
+        image.connected = false;
     }
 }
 
-uint8_t IoSamurai::set_bit(uint8_t buffer, int bit_position, int value) {
-    if (bit_position < 0 || bit_position >= 8) {
-        return buffer;
+void IoSamurai::skip_frame(const ios_rx_frame_t* frame, int len) {
+    if (capture) {
+        capture->record(board_id, CaptureDirection::RxSkipped, reinterpret_cast<const uint8_t*>(frame), len,
+                        monotonic_ns());
     }
-    if (value) {
-        buffer |= (1 << bit_position);
-    } else {
-        buffer &= ~(1 << bit_position);
+    if (len == IOS_RX_FRAME_SIZE) {
+        ios_skip_rx(&link.rx, frame);
+    }
+}
+
+void IoSamurai::publish_cycle() {
+    image.cycle++;
+    process_image.store(image);
+    if (shared) {
+        publish_shared();
+    }
+    if (watchdog_running) {
+        watchdog_check(monotonic_ns());
+    }
+    if (image.connected != link_up) {
+        if (image.connected && link_seen) {
+            reconnects.fetch_add(1, std::memory_order_relaxed);
+        }
+        link_up = image.connected;
+        link_seen = link_seen || link_up;
+    }
+    if ((changed_rising | changed_falling) || retire_pending.load(std::memory_order_relaxed)) {
+        dispatch_input_events();
+    }
+    if (publish_callback) {
+        publish_callback(image);
+    }
+}
+
+void IoSamurai::publish_shared() {
+    shared->publish(shared_slot, image);
+    // Fold the commands queued since the last cycle into one change, in the order they were written
+    OutputCommand command;
+    uint8_t value = 0;
+    uint8_t mask = 0;
+    for (size_t i = 0; i < SharedImage::COMMAND_QUEUE && shared->pop_command(shared_slot, command); i++) {
+        value = static_cast<uint8_t>((value & ~command.mask) | (command.value & command.mask));
+        mask |= command.mask;
+    }
+    if (mask == 0) {
+        return;
+    }
+    uint8_t current = output_data.load(std::memory_order_relaxed);
+    uint8_t next;
+    do {
+        next = static_cast<uint8_t>((current & ~mask) | (value & mask));
+    } while (!output_data.compare_exchange_weak(current, next, std::memory_order_relaxed));
+}
+
+void IoSamurai::dispatch_input_events() {
+    InputEvent event;
+    event.cycle = image.cycle;
+    event.timestamp_ns = changed_time_ns;
+    event.inputs = image.inputs;
+    retire_pending.store(false, std::memory_order_relaxed);
+
+    for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+        Subscriber& subscriber = subscribers[i];
+        uint8_t state = subscriber.state.load(std::memory_order_acquire);
+        if (state == SLOT_RETIRED) {
+            subscriber.callback = nullptr;
+            subscriber.queue = nullptr;
+            subscriber.state.store(SLOT_FREE, std::memory_order_release);
+            continue;
+        }
+        if (state != SLOT_ACTIVE) {
+            continue;
+        }
+        event.rising = changed_rising & subscriber.rising_mask;
+        event.falling = changed_falling & subscriber.falling_mask;
+        if (!(event.rising | event.falling)) {
+            continue;
+        }
+        if (subscriber.queue) {
+            if (!subscriber.queue->push(event)) {
+                dropped_events.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else {
+            subscriber.callback(event);
+        }
+    }
+    changed_rising = 0;
+    changed_falling = 0;
+}
+
+int IoSamurai::add_subscriber(uint16_t mask, Edge edge, std::function<void(const InputEvent&)> callback,
+                              InputEventQueue* queue) {
+    for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+        Subscriber& subscriber = subscribers[i];
+        uint8_t expected = SLOT_FREE;
+        if (!subscriber.state.compare_exchange_strong(expected, SLOT_CLAIMED, std::memory_order_acquire)) {
+            continue;
+        }
+        subscriber.rising_mask = (static_cast<uint8_t>(edge) & static_cast<uint8_t>(Edge::Rising)) ? mask : 0;
+        subscriber.falling_mask = (static_cast<uint8_t>(edge) & static_cast<uint8_t>(Edge::Falling)) ? mask : 0;
+        subscriber.callback = std::move(callback);
+        subscriber.queue = queue;
+        subscriber.state.store(SLOT_ACTIVE, std::memory_order_release);
+        return static_cast<int>(i);
+    }
+    EventLog::instance().message(LogLevel::Error, board_id, "no free input subscriber slot");
+    return -1;
+}
+
+int IoSamurai::subscribe_inputs(uint16_t mask, Edge edge, std::function<void(const InputEvent&)> callback) {
+    if (!callback) {
+        return -1;
+    }
+    return add_subscriber(mask, edge, std::move(callback), nullptr);
+}
+
+int IoSamurai::subscribe_inputs(uint16_t mask, Edge edge, InputEventQueue* queue) {
+    if (!queue) {
+        return -1;
+    }
+    return add_subscriber(mask, edge, nullptr, queue);
+}
+
+void IoSamurai::unsubscribe_inputs(int id) {
+    if (id < 0 || id >= static_cast<int>(MAX_SUBSCRIBERS)) {
+        return;
+    }
+    uint8_t expected = SLOT_ACTIVE;
+    if (subscribers[id].state.compare_exchange_strong(expected, SLOT_RETIRED, std::memory_order_release)) {
+        retire_pending.store(true, std::memory_order_relaxed);
+    }
+}
+
+uint64_t IoSamurai::dropped_event_count() const {
+    return dropped_events.load(std::memory_order_relaxed);
+}
+
+bool IoSamurai::enable_packet_transport(const PacketConfig& config) {
+    if (sockfd < 0) {
+        EventLog::instance().message(LogLevel::Error, board_id, "packet transport requires init()");
+        return false;
+    }
+    std::unique_ptr<PacketTransport> transport(new PacketTransport());
+    if (!transport->init(remote_addr, ip_address.port, config)) {
+        return false;
+    }
+    // The UDP socket keeps the port bound but no longer queues the replies
+    if (!PacketTransport::reserve_port(sockfd)) {
+        return false;
+    }
+    packet = std::move(transport);
+    return true;
+}
+
+bool IoSamurai::packet_transport_enabled() const {
+    return packet != nullptr;
+}
+
+bool IoSamurai::send_frame(const ios_tx_frame_t* frame) {
+    if (packet) {
+        return packet->send(frame, IOS_TX_FRAME_SIZE);
+    }
+    return sendto(sockfd, frame, IOS_TX_FRAME_SIZE, 0, (struct sockaddr*)&remote_addr, sizeof(remote_addr)) >= 0;
+}
+
+int IoSamurai::read_reply(const ios_rx_frame_t** frame) {
+    if (packet) {
+        // Read in place from the ring, longer datagrams are cut like recvfrom() would
+        int len;
+        const uint8_t* payload = packet->receive(&len);
+        if (!payload) {
+            return -1;
+        }
+        *frame = reinterpret_cast<const ios_rx_frame_t*>(payload);
+        return len < IOS_RX_FRAME_SIZE ? len : IOS_RX_FRAME_SIZE;
+    }
+    *frame = &rx_frame;
+    return recvfrom(sockfd, &rx_frame, IOS_RX_FRAME_SIZE, MSG_DONTWAIT, nullptr, nullptr);
+}
+
+bool IoSamurai::udp_io_process_send() {
+    if (watchdog_running && !watchdog_before_send(monotonic_ns())) {
+        return false;
+    }
+    encode_frame(&tx_frame);
+    if (!send_frame(&tx_frame)) {
+        EventLog::instance().event(LogLevel::Error, board_id, LogCode::SendFailed, errno);
+    }
+    return true;
+}
+
+void IoSamurai::udp_io_process_recv() {
+    const ios_rx_frame_t* frame;
+    int len = read_reply(&frame);
+    decode_frame(frame, len, monotonic_ns());
+}
+
+void IoSamurai::drain_stale_replies() {
+    // Late replies still advance the board's checksum chain, so they are skipped, not dropped
+    const ios_rx_frame_t* frame;
+    int len;
+    while ((len = read_reply(&frame)) >= 0) {
+        skip_frame(frame, len);
+        stale_replies.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void IoSamurai::wait_for_reply(int64_t send_time_ns) {
+    const int64_t deadline = send_time_ns + reply_timeout_ns;
+    struct pollfd pfd;
+    pfd.fd = packet ? packet->fd() : sockfd;
+    pfd.events = POLLIN;
+
+    int64_t now = send_time_ns;
+    while (true) {
+        const ios_rx_frame_t* frame;
+        int len = read_reply(&frame);
+        if (len >= 0) {
+            now = monotonic_ns();
+            decode_frame(frame, len, now);
+            last_rtt.store(now - send_time_ns, std::memory_order_relaxed);
+            rtt.record(now - send_time_ns);
+            return;
+        }
+        now = monotonic_ns();
+        if (now >= deadline) {
+            break;
+        }
+        if (round_trip_mode == RoundTripMode::Poll) {
+            struct timespec remaining;
+            remaining.tv_sec = (deadline - now) / 1000000000LL;
+            remaining.tv_nsec = (deadline - now) % 1000000000LL;
+            if (ppoll(&pfd, 1, &remaining, nullptr) == 0) {
+                break;
+            }
+        }
+    }
+
+    decode_frame(nullptr, -1, monotonic_ns());
+    missed_replies.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IoSamurai::set_round_trip_mode(RoundTripMode mode, int timeout_us) {
+    round_trip_mode = mode;
+    reply_timeout_ns = static_cast<int64_t>(timeout_us) * 1000;
+}
+
+bool IoSamurai::set_socket_busy_poll(int busy_poll_us) {
+    if (setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) < 0) {
+        EventLog::instance().message(LogLevel::Error, board_id, "SO_BUSY_POLL failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+int64_t IoSamurai::last_rtt_ns() const {
+    return last_rtt.load(std::memory_order_relaxed);
+}
+
+uint64_t IoSamurai::missed_reply_count() const {
+    return missed_replies.load(std::memory_order_relaxed);
+}
+
+uint64_t IoSamurai::stale_reply_count() const {
+    return stale_replies.load(std::memory_order_relaxed);
+}
+
+IoStats IoSamurai::stats() const {
+    IoStats result;
+    result.cycles = process_image.load().cycle;
+    result.replies = good_replies.load(std::memory_order_relaxed);
+    result.timeouts = missed_replies.load(std::memory_order_relaxed);
+    result.checksum_errors = checksum_errors.load(std::memory_order_relaxed);
+    result.resyncs = resyncs.load(std::memory_order_relaxed);
+    result.short_packets = short_packets.load(std::memory_order_relaxed);
+    result.stale_drops = stale_replies.load(std::memory_order_relaxed);
+    result.reconnects = reconnects.load(std::memory_order_relaxed);
+    result.watchdog_trips = watchdog_trips.load(std::memory_order_relaxed);
+    result.rtt = rtt.summary();
+    result.jitter = update_task.latency_histogram().summary();
+    result.watchdog_detect = watchdog_detect.summary();
+    return result;
+}
+
+const LatencyHistogram& IoSamurai::rtt_histogram() const {
+    return rtt;
+}
+
+void IoSamurai::reset_stats() {
+    good_replies.store(0, std::memory_order_relaxed);
+    missed_replies.store(0, std::memory_order_relaxed);
+    checksum_errors.store(0, std::memory_order_relaxed);
+    resyncs.store(0, std::memory_order_relaxed);
+    short_packets.store(0, std::memory_order_relaxed);
+    stale_replies.store(0, std::memory_order_relaxed);
+    reconnects.store(0, std::memory_order_relaxed);
+    watchdog_trips.store(0, std::memory_order_relaxed);
+    watchdog_detect.reset();
+    rtt.reset();
+    update_task.reset_latency();
+}
+
+static void write_summary(FILE* file, const char* name, const HistogramSummary& summary) {
+    fprintf(file, "# %s count=%llu mean=%lld p50=%lld p99=%lld p99.9=%lld max=%lld\n", name,
+            static_cast<unsigned long long>(summary.count), static_cast<long long>(summary.mean),
+            static_cast<long long>(summary.p50), static_cast<long long>(summary.p99),
+            static_cast<long long>(summary.p999), static_cast<long long>(summary.max));
+}
+
+bool IoSamurai::dump_stats(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        EventLog::instance().message(LogLevel::Error, board_id, "cannot write %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    IoStats current = stats();
+    fprintf(file, "# io-samurai.%u %s:%d\n", board_id, ip_address.ip.c_str(), ip_address.port);
+    fprintf(file, "# cycles=%llu replies=%llu timeouts=%llu checksum_errors=%llu resyncs=%llu "
+                  "short_packets=%llu stale_drops=%llu reconnects=%llu watchdog_trips=%llu\n",
+            static_cast<unsigned long long>(current.cycles), static_cast<unsigned long long>(current.replies),
+            static_cast<unsigned long long>(current.timeouts),
+            static_cast<unsigned long long>(current.checksum_errors),
+            static_cast<unsigned long long>(current.resyncs),
+            static_cast<unsigned long long>(current.short_packets),
+            static_cast<unsigned long long>(current.stale_drops),
+            static_cast<unsigned long long>(current.reconnects),
+            static_cast<unsigned long long>(current.watchdog_trips));
+    write_summary(file, "rtt_ns", current.rtt);
+    rtt.write(file);
+    write_summary(file, "jitter_ns", current.jitter);
+    update_task.latency_histogram().write(file);
+    write_summary(file, "watchdog_detect_ns", current.watchdog_detect);
+    watchdog_detect.write(file);
+    bool ok = ferror(file) == 0;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+void IoSamurai::set_capture(PacketCapture* capture) {
+    this->capture = capture;
+}
+
+void IoSamurai::set_shared_image(SharedImage* shared, size_t slot) {
+    if (shared) {
+        shared->describe(slot, board_id, ip_address.ip, ip_address.port);
+        shared_slot = slot;
+        // Commands written before attaching are not replayed
+        shared->discard_commands(slot);
+    }
+    this->shared = shared;
+}
+
+bool IoSamurai::enable_watchdog(const WatchdogConfig& config) {
+    if (config.timeout_us <= 0 || config.quiet_us < 0) {
+        EventLog::instance().message(LogLevel::Error, board_id, "invalid watchdog timeout");
+        return false;
+    }
+    watchdog = config;
+    last_received_time = monotonic_ns();
+    watchdog_last_send = 0;
+    watchdog_pending_since = 0;
+    watchdog_quiet_until = 0;
+    watchdog_reset_request.store(false, std::memory_order_relaxed);
+    watchdog_status.store(WatchdogState::Armed, std::memory_order_relaxed);
+    watchdog_running = true;
+    return true;
+}
+
+void IoSamurai::disable_watchdog() {
+    watchdog_running = false;
+    watchdog_status.store(WatchdogState::Off, std::memory_order_relaxed);
+}
+
+void IoSamurai::add_failsafe_callback(std::function<void(const WatchdogEvent&)> callback) {
+    failsafe_callbacks.push_back(std::move(callback));
+}
+
+WatchdogState IoSamurai::watchdog_state() const {
+    return watchdog_status.load(std::memory_order_relaxed);
+}
+
+void IoSamurai::reset_watchdog() {
+    watchdog_reset_request.store(true, std::memory_order_relaxed);
+}
+
+bool IoSamurai::watchdog_before_send(int64_t now_ns) {
+    if (!watchdog_running) {
+        return true;
+    }
+    if (watchdog_status.load(std::memory_order_relaxed) == WatchdogState::Tripped) {
+        if (watchdog_quiet_until == 0) {
+            // One frame with the safe outputs on the current chains, in case the board still hears us
+            watchdog_quiet_until = now_ns + watchdog.quiet_us * 1000;
+            return true;
+        }
+        if (now_ns < watchdog_quiet_until) {
+            return false;
+        }
+        // The board has run into its timeout by now and restarted both chains, so do we
+        ios_link_reset(&link);
+        resync_rejected = 0;
+        watchdog_probe_time = now_ns;
+        watchdog_pending_since = 0;
+        watchdog_status.store(WatchdogState::Probing, std::memory_order_relaxed);
+    }
+    // Only frames that went out can be overdue, a stalled update thread does not trip the watchdog
+    watchdog_last_send = now_ns;
+    if (watchdog_pending_since == 0) {
+        watchdog_pending_since = now_ns;
+    }
+    return true;
+}
+
+void IoSamurai::watchdog_check(int64_t now_ns) {
+    const int64_t timeout_ns = watchdog.timeout_us * 1000;
+    switch (watchdog_status.load(std::memory_order_relaxed)) {
+    case WatchdogState::Latched:
+        if (watchdog_reset_request.exchange(false, std::memory_order_relaxed)) {
+            watchdog_status.store(WatchdogState::Armed, std::memory_order_relaxed);
+        }
+        // fall through
+    case WatchdogState::Armed:
+        // A reset only releases a trip that already happened
+        watchdog_reset_request.store(false, std::memory_order_relaxed);
+        if (watchdog_pending_since != 0 && now_ns - watchdog_pending_since > timeout_ns) {
+            int64_t elapsed = now_ns - watchdog_pending_since;
+            watchdog_trips.fetch_add(1, std::memory_order_relaxed);
+            watchdog_detect.record(elapsed);
+            watchdog_trip_time = now_ns;
+            watchdog_quiet_until = 0;
+            EventLog::instance().event(LogLevel::Error, board_id, LogCode::WatchdogTrip,
+                                       static_cast<int32_t>(std::min<int64_t>(elapsed / 1000, INT32_MAX)));
+            watchdog_report(WatchdogState::Tripped, true, now_ns, elapsed);
+        }
+        break;
+    case WatchdogState::Probing:
+        if (last_received_time >= watchdog_probe_time) {
+            int64_t elapsed = now_ns - watchdog_trip_time;
+            EventLog::instance().event(LogLevel::Info, board_id, LogCode::LinkRecovered,
+                                       static_cast<int32_t>(std::min<int64_t>(elapsed / 1000000, INT32_MAX)));
+            bool released = watchdog_reset_request.exchange(false, std::memory_order_relaxed);
+            watchdog_report(watchdog.latch && !released ? WatchdogState::Latched : WatchdogState::Armed, false,
+                            now_ns, elapsed);
+        } else if (watchdog_pending_since != 0 && now_ns - watchdog_pending_since > timeout_ns) {
+            // Still no answer, be quiet again so the board times out once more
+            watchdog_quiet_until = now_ns + watchdog.quiet_us * 1000;
+            watchdog_status.store(WatchdogState::Tripped, std::memory_order_relaxed);
+        }
+        break;
+    case WatchdogState::Tripped:
+    case WatchdogState::Off:
+        break;
+    }
+}
+
+void IoSamurai::watchdog_report(WatchdogState state, bool tripped, int64_t now_ns, int64_t elapsed_ns) {
+    watchdog_status.store(state, std::memory_order_relaxed);
+    WatchdogEvent event;
+    event.tripped = tripped;
+    event.cycle = image.cycle;
+    event.timestamp_ns = now_ns;
+    event.last_reply_ns = last_received_time;
+    event.elapsed_ns = elapsed_ns;
+    for (const auto& callback : failsafe_callbacks) {
+        callback(event);
     }
-    return buffer;
 }
 
 void IoSamurai::update() {
+    if (round_trip_mode == RoundTripMode::Immediate) {
+        udp_io_process_send();
+        udp_io_process_recv();
+    } else {
+        drain_stale_replies();
+        int64_t send_time = monotonic_ns();
+        if (udp_io_process_send()) {
+            wait_for_reply(send_time);
+        } else {
+            decode_frame(nullptr, -1, monotonic_ns()); // Held quiet, no reply to wait for
+        }
+    }
+    publish_cycle();
+}
+
+uint64_t IoSamurai::send_async() {
+    if (next_sequence - oldest_sequence >= max_in_flight) {
+        return 0;
+    }
+    uint64_t sequence = next_sequence++;
+    PendingRequest& request = pending[sequence % MAX_IN_FLIGHT];
+    request.sequence = sequence;
+    request.send_time_ns = monotonic_ns();
     udp_io_process_send();
-    udp_io_process_recv();
+    requests_in_flight.store(next_sequence - oldest_sequence, std::memory_order_relaxed);
+    return sequence;
+}
+
+void IoSamurai::complete_request(bool ok, int64_t now_ns) {
+    const PendingRequest& request = pending[oldest_sequence % MAX_IN_FLIGHT];
+    oldest_sequence++;
+    requests_in_flight.store(next_sequence - oldest_sequence, std::memory_order_relaxed);
+
+    if (ok) {
+        last_rtt.store(now_ns - request.send_time_ns, std::memory_order_relaxed);
+        rtt.record(now_ns - request.send_time_ns);
+    } else {
+        missed_replies.fetch_add(1, std::memory_order_relaxed);
+    }
+    publish_cycle();
+
+    Completion completion;
+    completion.sequence = request.sequence;
+    completion.rtt_ns = ok ? now_ns - request.send_time_ns : 0;
+    completion.ok = ok;
+    completion.image = image;
+    if (completion_callback) {
+        completion_callback(completion);
+    } else if (!completions.push(completion)) {
+        dropped_completions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int IoSamurai::poll_completions() {
+    int completed = 0;
+    const ios_rx_frame_t* frame;
+    int len;
+
+    // Replies come back in send order, so each one answers the oldest request not answered yet:
+    // first the expired ones, then the oldest pending request
+    while ((len = read_reply(&frame)) >= 0) {
+        int64_t now = monotonic_ns();
+        const int64_t window_ns = reply_timeout_ns * static_cast<int64_t>(MAX_IN_FLIGHT);
+        if (expired_unanswered > 0 && now - expired_quiet_since > window_ns) {
+            expired_unanswered = 0; // Silent for longer than the in-flight window, those replies are lost
+        }
+        expired_quiet_since = now;
+        ios_chain_t probe = link.rx;
+        if (expired_unanswered > 0 && (len != IOS_RX_FRAME_SIZE || !ios_verify_rx(&probe, frame))) {
+            expired_unanswered = 0; // Out of step, a reply went missing and the chain relocks on this one
+        }
+        if (expired_unanswered > 0 || oldest_sequence == next_sequence) {
+            skip_frame(frame, len); // Reply to a request that already expired
+            stale_replies.fetch_add(1, std::memory_order_relaxed);
+            expired_unanswered -= expired_unanswered > 0;
+            continue;
+        }
+        decode_frame(frame, len, now);
+        complete_request(image.connected, now);
+        completed++;
+    }
+
+    // Expire requests whose reply did not arrive in time
+    int64_t now = monotonic_ns();
+    while (oldest_sequence != next_sequence &&
+           now - pending[oldest_sequence % MAX_IN_FLIGHT].send_time_ns > reply_timeout_ns) {
+        decode_frame(nullptr, -1, now);
+        complete_request(false, now);
+        if (expired_unanswered++ == 0) {
+            expired_quiet_since = now;
+        }
+        completed++;
+    }
+    return completed;
+}
+
+bool IoSamurai::pop_completion(Completion& completion) {
+    return completions.pop(completion);
+}
+
+void IoSamurai::set_completion_callback(std::function<void(const Completion&)> callback) {
+    completion_callback = std::move(callback);
+}
+
+void IoSamurai::set_max_in_flight(size_t count) {
+    if (count < 1) count = 1;
+    if (count > MAX_IN_FLIGHT) count = MAX_IN_FLIGHT;
+    max_in_flight = count;
+}
+
+size_t IoSamurai::in_flight() const {
+    return requests_in_flight.load(std::memory_order_relaxed);
+}
+
+uint64_t IoSamurai::dropped_completion_count() const {
+    return dropped_completions.load(std::memory_order_relaxed);
+}
+
+void IoSamurai::start_periodic_update(int interval_ms) {
+    CyclicConfig config;
+    config.period_us = static_cast<int64_t>(interval_ms) * 1000;
+    start_periodic_update(config);
+}
+
+bool IoSamurai::start_periodic_update(const CyclicConfig& config) {
+    if (sockfd < 0) {
+        EventLog::instance().message(LogLevel::Error, board_id, "periodic update requires an initialized socket");
+        return false;
+    }
+    return update_task.start(config, [this]() {
+        update();
+        if (cycle_callback) {
+            cycle_callback();
+        }
+    });
+}
+
+void IoSamurai::stop_periodic_update() {
+    update_task.stop();
+}
+
+void IoSamurai::set_cycle_callback(std::function<void()> callback) {
+    cycle_callback = std::move(callback);
+}
+
+void IoSamurai::set_publish_callback(std::function<void(const ProcessImage&)> callback) {
+    publish_callback = std::move(callback);
+}
+
+uint64_t IoSamurai::cycle_count() const {
+    return update_task.cycle_count();
+}
+
+uint64_t IoSamurai::overrun_count() const {
+    return update_task.overrun_count();
+}
+
+int64_t IoSamurai::max_latency_ns() const {
+    return update_task.max_latency_ns();
 }
\ No newline at end of file
@@ -3,12 +3,117 @@
 
 #include <string>
 #include <cstdint>
-#include <vector>
-#include <thread>
 #include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
 #include <netinet/in.h> // Added for sockaddr_in
+#include "cyclic-task.h"
+#include "seqlock.h"
+#include "spsc-queue.h"
+#include "packet-capture.h"
+#include "packet-transport.h"
+#include "shared-image.h"
+#include "io_samurai_proto.h"
+
+// Board state published after every update cycle
+struct ProcessImage {
+    uint64_t cycle;          // Update cycle that produced this image
+    int64_t timestamp_ns;    // CLOCK_MONOTONIC time of the last valid reply
+    float analog_in;         // Scaled (and optionally filtered/rounded) analog input
+    int32_t analog_in_s32;   // Analog input as integer
+    uint16_t inputs;         // Input bits 0-15
+    uint16_t adc_raw;        // Raw 12-bit ADC value
+    uint8_t outputs;         // Output bits sent in this cycle
+    uint8_t status;          // Board status bits (STATUS_*)
+    bool connected;          // Last reply arrived with a valid checksum
+};
+
+// How update() waits for the board's reply
+enum class RoundTripMode {
+    Immediate, // One non-blocking read right after sending (reply is usually from the previous cycle)
+    Poll,      // Sleep in ppoll() until the reply arrives or the deadline passes
+    BusyPoll   // Spin on non-blocking reads until the reply arrives or the deadline passes
+};
+
+// Result of one asynchronous request (see IoSamurai::send_async)
+struct Completion {
+    uint64_t sequence;   // Value returned by send_async()
+    int64_t rtt_ns;      // Send time to reply processing in poll_completions(), 0 if expired
+    bool ok;             // Reply arrived with a valid checksum before the timeout
+    ProcessImage image;  // Board state after this reply
+};
+
+// Input edges a subscriber is interested in
+enum class Edge : uint8_t {
+    Rising = 1,
+    Falling = 2,
+    Any = 3
+};
+
+// Input change reported to subscribers
+struct InputEvent {
+    uint64_t cycle;          // Cycle of the process image that contains the change
+    int64_t timestamp_ns;    // CLOCK_MONOTONIC time of the reply that contains the change
+    uint16_t inputs;         // Input word after the change
+    uint16_t rising;         // Subscribed inputs that went from 0 to 1
+    uint16_t falling;        // Subscribed inputs that went from 1 to 0
+};
+
+// Queue for receiving input events on another thread
+using InputEventQueue = SpscQueue<InputEvent, 256>;
+
+// Link watchdog options (see IoSamurai::enable_watchdog)
+struct WatchdogConfig {
+    int64_t timeout_us = 3000;    // Age of the oldest unanswered frame at which the watchdog trips
+    uint8_t safe_outputs = 0x00;  // Outputs sent while tripped
+    int64_t quiet_us = 150000;    // Silence after a trip, longer than the board's failsafe timeout (100 ms)
+    bool latch = true;            // Keep the safe outputs after the link recovered until reset_watchdog()
+};
+
+// Watchdog states
+enum class WatchdogState : uint8_t {
+    Off,      // Not enabled
+    Armed,    // Link up, outputs follow the application
+    Tripped,  // One frame with the safe outputs sent, then quiet so the board restarts its chains
+    Probing,  // Chains restarted, safe outputs sent until a valid reply arrives
+    Latched   // Link recovered, safe outputs held until reset_watchdog()
+};
+
+// Reported to the fail-safe callbacks on the update thread
+struct WatchdogEvent {
+    bool tripped;            // true when the watchdog tripped, false when the link recovered
+    uint64_t cycle;          // Cycle that detected it
+    int64_t timestamp_ns;    // CLOCK_MONOTONIC time of the detection
+    int64_t last_reply_ns;   // Time of the last valid reply (or of enabling the watchdog)
+    int64_t elapsed_ns;      // Trip: time-to-detect since the first unanswered frame. Recovery: time since the trip
+};
+
+// Link statistics since init() or the last reset_stats()
+struct IoStats {
+    uint64_t cycles;            // Published cycles
+    uint64_t replies;           // Replies with a valid checksum
+    uint64_t timeouts;          // Replies that missed the deadline (Poll/BusyPoll/async)
+    uint64_t checksum_errors;   // Replies with a wrong checksum
+    uint64_t resyncs;           // Checksum chain relocked after wrong checksums (lost or reordered reply)
+    uint64_t short_packets;     // Replies with the wrong length
+    uint64_t stale_drops;       // Late replies skipped before sending or after expiry
+    uint64_t reconnects;        // Valid replies after the link was lost
+    uint64_t watchdog_trips;    // Times the watchdog tripped
+    HistogramSummary rtt;       // Send-to-reply time (Poll/BusyPoll/async)
+    HistogramSummary jitter;    // Update thread wake-up latency (periodic update only)
+    HistogramSummary watchdog_detect; // First unanswered frame to watchdog trip
+};
+
+// Board status bits reported in the upper bits of reply byte 3
+static constexpr uint8_t STATUS_OUTPUTS_PRESENT = IOS_STATUS_OUTPUTS; // MCP23008 found
+static constexpr uint8_t STATUS_INPUTS_PRESENT = IOS_STATUS_INPUTS;   // MCP23017 found
+static constexpr uint8_t STATUS_OLED_PRESENT = IOS_STATUS_OLED;       // SH1106 found
 
 class IoSamurai {
+    friend class IoSamuraiGroup;
+    friend class CaptureReplay;
+
 public:
     // Constructor
     IoSamurai();
@@ -19,15 +124,47 @@ public:
     // Initialize with IP address and port
     bool init(const std::string& ip_address, int port);
 
+    // Board id used as the source of log entries
+    uint32_t id() const;
+
+    // Reserve count consecutive log source ids for boards driven without an IoSamurai (returns the first)
+    static uint32_t reserve_ids(uint32_t count);
+
     // Set output bit (0 to 7)
     void set_output(int index, bool value);
 
     // Reset output bit (0 to 7)
     void reset_output(int index);
 
+    // Set all output bits at once
+    void set_outputs_mask(uint8_t mask);
+
+    // Get all output bits
+    uint8_t outputs_mask() const;
+
     // Get input bit (0 to 15)
     bool get_input(int index) const;
 
+    // Get all input bits
+    uint16_t inputs_mask() const;
+
+    // Get a consistent copy of the last published board state (lock-free)
+    ProcessImage snapshot() const;
+
+    // Call callback on the update thread when an input in mask changes (returns subscription id or -1)
+    int subscribe_inputs(uint16_t mask, Edge edge, std::function<void(const InputEvent&)> callback);
+
+    // Push events for the inputs in mask into queue, the caller owns the queue (returns subscription id or -1)
+    int subscribe_inputs(uint16_t mask, Edge edge, InputEventQueue* queue);
+
+    // Remove a subscription, no new events are delivered after the next cycle
+    void unsubscribe_inputs(int id);
+
+    // Number of input events dropped because a subscriber queue was full
+    uint64_t dropped_event_count() const;
+
+    static constexpr size_t MAX_SUBSCRIBERS = 16;
+
     // Get analog input value (scaled)
     float get_analog_in() const;
 
@@ -52,18 +189,120 @@ public:
     // Start periodic updates in a separate thread
     void start_periodic_update(int interval_ms);
 
+    // Start periodic updates with microsecond period and real-time options
+    bool start_periodic_update(const CyclicConfig& config);
+
     // Stop periodic updates
     void stop_periodic_update();
 
+    // Function called on the update thread after every cycle (set before starting)
+    void set_cycle_callback(std::function<void()> callback);
+
+    // Function called on the update thread with every published process image of this board,
+    // also for boards of an IoSamuraiGroup and for asynchronous completions (set before starting)
+    void set_publish_callback(std::function<void(const ProcessImage&)> callback);
+
+    // Number of cycles run by the update thread
+    uint64_t cycle_count() const;
+
+    // Number of missed cycle deadlines
+    uint64_t overrun_count() const;
+
+    // Worst wake-up latency of the update thread in nanoseconds
+    int64_t max_latency_ns() const;
+
+    // Select how update() waits for the reply (set before starting periodic updates)
+    void set_round_trip_mode(RoundTripMode mode, int timeout_us = 500);
+
+    // Set SO_BUSY_POLL on the socket (microseconds, needs CAP_NET_ADMIN above net.core.busy_poll)
+    bool set_socket_busy_poll(int busy_poll_us);
+
+    // Exchange frames over an AF_PACKET socket with mmap rings instead of the UDP socket
+    // (call after init(), before starting periodic updates; needs CAP_NET_RAW)
+    bool enable_packet_transport(const PacketConfig& config = PacketConfig());
+
+    // Check if the AF_PACKET transport is in use
+    bool packet_transport_enabled() const;
+
+    // Round-trip time of the last reply in nanoseconds (Poll/BusyPoll modes)
+    int64_t last_rtt_ns() const;
+
+    // Number of cycles where the reply missed the deadline (Poll/BusyPoll modes)
+    uint64_t missed_reply_count() const;
+
+    // Number of stale replies drained from the socket before sending
+    uint64_t stale_reply_count() const;
+
+    // Counters and latency percentiles (lock-free, cheap enough to call every cycle)
+    IoStats stats() const;
+
+    // Round-trip time histogram
+    const LatencyHistogram& rtt_histogram() const;
+
+    // Clear counters and histograms
+    void reset_stats();
+
+    // Write the statistics and both histograms to a text file
+    bool dump_stats(const std::string& path) const;
+
+    // Record every TX and RX frame of this board into capture (nullptr stops, set before starting)
+    void set_capture(PacketCapture* capture);
+
+    // Publish every cycle into slot of shared and apply the output commands written there
+    // (nullptr stops, set before starting)
+    void set_shared_image(SharedImage* shared, size_t slot);
+
+    // Watch the replies on the update thread: when a frame stays unanswered for timeout_us, call the
+    // fail-safe callbacks, send the safe outputs, stay quiet until the board restarted its
+    // checksum chains, then restart ours and probe until the link is back (call before starting)
+    bool enable_watchdog(const WatchdogConfig& config = WatchdogConfig());
+
+    // Stop watching, outputs follow the application again (call while not updating)
+    void disable_watchdog();
+
+    // Function called on the update thread when the watchdog trips and when the link recovers
+    // (add before starting)
+    void add_failsafe_callback(std::function<void(const WatchdogEvent&)> callback);
+
+    // Current watchdog state (any thread)
+    WatchdogState watchdog_state() const;
+
+    // Release a latched watchdog, the application outputs apply again once the link is up (any thread)
+    void reset_watchdog();
+
     // Update function to handle send and receive
     void update();
 
+    // Send the current outputs without waiting for the reply.
+    // Returns the request sequence number, or 0 if max_in_flight requests are already pending.
+    uint64_t send_async();
+
+    // Process the replies that have arrived and expire requests older than the round-trip timeout.
+    // Completions go to the completion callback if set, otherwise to the completion queue.
+    // Returns the number of completed requests.
+    int poll_completions();
+
+    // Pop a completion from the queue (any thread, when no completion callback is set)
+    bool pop_completion(Completion& completion);
+
+    // Function called from poll_completions() for every completed request (set before sending)
+    void set_completion_callback(std::function<void(const Completion&)> callback);
+
+    // Limit the number of outstanding requests (1 to MAX_IN_FLIGHT)
+    void set_max_in_flight(size_t count);
+
+    // Number of requests sent but not completed yet
+    size_t in_flight() const;
+
+    // Number of completions dropped because the completion queue was full
+    uint64_t dropped_completion_count() const;
+
+    static constexpr size_t MAX_IN_FLIGHT = 64;
+
 private:
     // Constants
     static constexpr float ALPHA = 0.1f; // Low-pass filter constant (EMA)
     static constexpr float ADC_MAX = 4095.0f; // Maximum ADC value (12-bit resolution)
-    static constexpr size_t RX_BUFFER_SIZE = 5;
-    static constexpr size_t TX_BUFFER_SIZE = 3;
 
     // Structure for IP and port
     struct IpPort {
@@ -80,46 +319,157 @@ private:
     // Initialize UDP socket
     bool init_socket();
 
-    // Send data over UDP
-    void udp_io_process_send();
+    // Build the next output frame and advance the output checksum chain
+    void encode_frame(ios_tx_frame_t* frame);
+
+    // Verify and parse a reply frame received at now_ns (len < 0 or short frame means no reply)
+    void decode_frame(const ios_rx_frame_t* frame, int len, int64_t now_ns);
+
+    // Publish the process image at the end of a cycle
+    void publish_cycle();
+
+    // Send data over UDP, false if the watchdog keeps the link quiet and nothing was sent
+    bool udp_io_process_send();
 
     // Receive data over UDP
     void udp_io_process_recv();
 
-    // Set bit in buffer
-    uint8_t set_bit(uint8_t buffer, int bit_position, int value);
+    // Send one frame over the UDP socket or the packet transport
+    bool send_frame(const ios_tx_frame_t* frame);
+
+    // Read one reply without blocking, returns its length or -1 if none arrived.
+    // *frame points to the reply until the next call.
+    int read_reply(const ios_rx_frame_t** frame);
+
+    // Advance the input checksum chain over a reply without using its data
+    void skip_frame(const ios_rx_frame_t* frame, int len);
+
+    // Read and skip replies left over from earlier cycles
+    void drain_stale_replies();
+
+    // Wait for the reply to the frame sent at send_time_ns
+    void wait_for_reply(int64_t send_time_ns);
+
+    // Claim a free subscriber slot
+    int add_subscriber(uint16_t mask, Edge edge, std::function<void(const InputEvent&)> callback,
+                       InputEventQueue* queue);
+
+    // Report the input changes of the published cycle to the subscribers
+    void dispatch_input_events();
+
+    // Publish the cycle into the shared image and apply the queued output commands
+    void publish_shared();
+
+    // Watchdog: note a frame about to be sent at now_ns, false while the link is kept quiet after
+    // a trip (restarts the chains when the quiet ends)
+    bool watchdog_before_send(int64_t now_ns);
+
+    // Watchdog: check the replies of the published cycle
+    void watchdog_check(int64_t now_ns);
+
+    // Watchdog: switch to state and report it to the fail-safe callbacks
+    void watchdog_report(WatchdogState state, bool tripped, int64_t now_ns, int64_t elapsed_ns);
+
+    // Complete the oldest outstanding request
+    void complete_request(bool ok, int64_t now_ns);
 
     // Data members
+    uint32_t board_id;
     IpPort ip_address;
     int sockfd;
+    std::unique_ptr<PacketTransport> packet;
     struct sockaddr_in local_addr, remote_addr;
-    std::vector<uint8_t> rx_buffer;
-    std::vector<uint8_t> tx_buffer;
-    std::vector<bool> input_data; // 16 inputs
-    std::vector<bool> output_data; // 8 outputs
-    float analog_in;
-    int32_t analog_in_s32;
-    float analog_min;
-    float analog_max;
-    bool analog_lowpass;
-    bool analog_rounding;
-    bool oled_off;
-    bool connected;
-    long long current_time;
-    long long last_received_time;
-    bool watchdog_running;
-    bool watchdog_expired;
+    ios_rx_frame_t rx_frame;
+    ios_tx_frame_t tx_frame;
+
+    // Written by the application, read by the update thread
+    std::atomic<uint8_t> output_data; // 8 outputs
+    std::atomic<float> analog_min;
+    std::atomic<float> analog_max;
+    std::atomic<bool> analog_lowpass;
+    std::atomic<bool> analog_rounding;
+    std::atomic<bool> oled_off;
+
+    // Owned by the update thread, published through process_image
+    ProcessImage image;
+    Seqlock<ProcessImage> process_image;
+
     bool error_triggered;
-    uint8_t checksum_index;
-    uint8_t checksum_index_in;
+    ios_link_t link;
     float previous_analog;
     bool first_analog_sample;
-    std::thread update_thread;
-    std::atomic<bool> running;
+    RoundTripMode round_trip_mode;
+    int64_t reply_timeout_ns;
+    std::atomic<int64_t> last_rtt;
+    std::atomic<uint64_t> missed_replies;
+    std::atomic<uint64_t> stale_replies;
+
+    // Statistics, written by the update thread
+    std::atomic<uint64_t> good_replies;
+    std::atomic<uint64_t> checksum_errors;
+    std::atomic<uint64_t> resyncs;
+    uint32_t resync_rejected;    // Replies rejected since the chain lost step
+    std::atomic<uint64_t> short_packets;
+    std::atomic<uint64_t> reconnects;
+    bool link_up;
+    bool link_seen;
+    LatencyHistogram rtt;
 
-    // Placeholder for jump_table (checksum lookup table)
-    // Note: Replace with actual jump_table implementation
-    static uint8_t jump_tbl[256];
+    // Link watchdog, owned by the update thread
+    WatchdogConfig watchdog;
+    bool watchdog_running;
+    std::atomic<WatchdogState> watchdog_status; // Read by other threads
+    std::atomic<bool> watchdog_reset_request;
+    int64_t last_received_time;  // CLOCK_MONOTONIC time of the last valid reply (or of enabling)
+    int64_t watchdog_last_send;
+    int64_t watchdog_pending_since; // Send time of the oldest frame not followed by a valid reply, 0 if none
+    int64_t watchdog_trip_time;
+    int64_t watchdog_quiet_until; // 0 until the safe frame after a trip was sent
+    int64_t watchdog_probe_time;
+    std::vector<std::function<void(const WatchdogEvent&)>> failsafe_callbacks;
+    std::atomic<uint64_t> watchdog_trips;
+    LatencyHistogram watchdog_detect;
+
+    // Input edge detection, changes are collected until the cycle is published
+    bool have_inputs;
+    uint16_t changed_rising;
+    uint16_t changed_falling;
+    int64_t changed_time_ns;
+
+    // Subscriber slots, claimed by the application and released by the update thread
+    enum SubscriberState : uint8_t { SLOT_FREE, SLOT_CLAIMED, SLOT_ACTIVE, SLOT_RETIRED };
+    struct Subscriber {
+        std::atomic<uint8_t> state;
+        uint16_t rising_mask;
+        uint16_t falling_mask;
+        std::function<void(const InputEvent&)> callback;
+        InputEventQueue* queue;
+    };
+    Subscriber subscribers[MAX_SUBSCRIBERS];
+    std::atomic<bool> retire_pending;
+    std::atomic<uint64_t> dropped_events;
+
+    // Asynchronous requests, FIFO of send times indexed by sequence number
+    struct PendingRequest {
+        uint64_t sequence;
+        int64_t send_time_ns;
+    };
+    PendingRequest pending[MAX_IN_FLIGHT];
+    uint64_t next_sequence;
+    uint64_t oldest_sequence;
+    uint64_t expired_unanswered;  // Expired requests whose late reply may still come, skipped first
+    int64_t expired_quiet_since;  // First of them expired or the last reply read, whichever is later
+    size_t max_in_flight;
+    std::atomic<size_t> requests_in_flight;
+    std::atomic<uint64_t> dropped_completions;
+    std::function<void(const Completion&)> completion_callback;
+    SpscQueue<Completion, MAX_IN_FLIGHT> completions;
+    CyclicTask update_task;
+    std::function<void()> cycle_callback;
+    std::function<void(const ProcessImage&)> publish_callback;
+    PacketCapture* capture;
+    SharedImage* shared;
+    size_t shared_slot;
 };
 
 #endif // IO_SAMURAI_H
\ No newline at end of file
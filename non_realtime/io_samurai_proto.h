@@ -0,0 +1 @@
+../firmware/w5100s-evb-pico/inc/io_samurai_proto.h
\ No newline at end of file
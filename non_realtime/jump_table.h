@@ -1 +0,0 @@
-../firmware/w5100s-evb-pico/inc/jump_table.h
\ No newline at end of file
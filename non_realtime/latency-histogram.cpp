@@ -0,0 +1,127 @@
+#include "latency-histogram.h"
+#include <cinttypes>
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+size_t LatencyHistogram::bucket_index(uint64_t value) {
+    if (value < static_cast<uint64_t>(SUB_BUCKETS)) {
+        return static_cast<size_t>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    uint64_t sub = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return static_cast<size_t>(exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_low(size_t index) {
+    if (index < static_cast<size_t>(SUB_BUCKETS)) {
+        return index;
+    }
+    int exponent = static_cast<int>(index / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+    uint64_t sub = index % SUB_BUCKETS;
+    return (1ULL << exponent) + (sub << (exponent - SUB_BUCKET_BITS));
+}
+
+uint64_t LatencyHistogram::bucket_high(size_t index) {
+    if (index + 1 >= BUCKETS) {
+        return UINT64_MAX;
+    }
+    return bucket_low(index + 1) - 1;
+}
+
+void LatencyHistogram::record(int64_t value_ns) {
+    uint64_t value = value_ns > 0 ? static_cast<uint64_t>(value_ns) : 0;
+    buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    if (static_cast<int64_t>(value) > maximum.load(std::memory_order_relaxed)) {
+        maximum.store(static_cast<int64_t>(value), std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+HistogramSummary LatencyHistogram::summary() const {
+    HistogramSummary result;
+    result.count = total.load(std::memory_order_relaxed);
+    result.max = maximum.load(std::memory_order_relaxed);
+    result.mean = result.count ? static_cast<int64_t>(sum.load(std::memory_order_relaxed) / result.count) : 0;
+    result.p50 = result.p99 = result.p999 = 0;
+    if (result.count == 0) {
+        return result;
+    }
+
+    // Ranks are taken from the same count the mean uses; buckets recorded meanwhile only add
+    const uint64_t rank50 = (result.count * 500 + 999) / 1000;
+    const uint64_t rank99 = (result.count * 990 + 999) / 1000;
+    const uint64_t rank999 = (result.count * 999 + 999) / 1000;
+    uint64_t seen = 0;
+    // Found flags, not a 0 sentinel: bucket 0 ends at 0 ns and is a valid percentile
+    bool have50 = false;
+    bool have99 = false;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        uint64_t n = buckets[i].load(std::memory_order_relaxed);
+        if (n == 0) {
+            continue;
+        }
+        seen += n;
+        int64_t high = static_cast<int64_t>(bucket_high(i));
+        if (high > result.max) {
+            high = result.max;
+        }
+        if (!have50 && seen >= rank50) {
+            result.p50 = high;
+            have50 = true;
+        }
+        if (!have99 && seen >= rank99) {
+            result.p99 = high;
+            have99 = true;
+        }
+        if (seen >= rank999) {
+            result.p999 = high;
+            break;
+        }
+    }
+    return result;
+}
+
+int64_t LatencyHistogram::percentile(double q) const {
+    uint64_t count = total.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return 0;
+    }
+    if (q < 0.0) q = 0.0;
+    if (q > 1.0) q = 1.0;
+    uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+    if (rank == 0) rank = 1;
+    int64_t max = maximum.load(std::memory_order_relaxed);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            int64_t high = static_cast<int64_t>(bucket_high(i));
+            return high < max ? high : max;
+        }
+    }
+    return max;
+}
+
+void LatencyHistogram::write(FILE* file) const {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        uint64_t n = buckets[i].load(std::memory_order_relaxed);
+        if (n) {
+            fprintf(file, "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", bucket_low(i), bucket_high(i), n);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+
+// Percentiles of a latency histogram in nanoseconds
+struct HistogramSummary {
+    uint64_t count;
+    int64_t p50;
+    int64_t p99;
+    int64_t p999;
+    int64_t max;
+    int64_t mean;
+};
+
+// HDR-style log-linear histogram of nanosecond values.
+// Every power of two is split into 32 linear buckets, so any recorded value is
+// reported within ~3% and recording is a few instructions with no allocation.
+// One thread records, any thread may read.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 40; // ~18 minutes, larger values go to the last bucket
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    // Record one value (negative values count as 0)
+    void record(int64_t value_ns);
+
+    // Clear all buckets
+    void reset();
+
+    // Count, mean, max and p50/p99/p99.9 in one pass over the buckets
+    HistogramSummary summary() const;
+
+    // Value at quantile q (0.0 to 1.0), upper edge of the bucket
+    int64_t percentile(double q) const;
+
+    // Write the non-empty buckets as "low_ns high_ns count" lines
+    void write(FILE* file) const;
+
+private:
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_low(size_t index);
+    static uint64_t bucket_high(size_t index);
+
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<int64_t> maximum;
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,255 @@
+#include "packet-capture.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include "event-log.h"
+#include "io-samurai.h"
+
+static const char CAPTURE_MAGIC[8] = {'I', 'O', 'S', 'C', 'A', 'P', '0', '1'};
+static constexpr uint32_t CAPTURE_VERSION = 1;
+
+static_assert(sizeof(CaptureRecord) == 24, "capture records must stay 24 bytes");
+static_assert(sizeof(CaptureHeader) == 64, "capture header must stay 64 bytes");
+
+PacketCapture::PacketCapture()
+    : fd(-1),
+      header(nullptr),
+      records(nullptr),
+      capacity(0),
+      mapped_size(0),
+      next_record(0),
+      dropped(0) {
+}
+
+PacketCapture::~PacketCapture() {
+    close();
+}
+
+bool PacketCapture::open(const std::string& path, size_t capacity) {
+    if (is_open()) {
+        EventLog::instance().message(LogLevel::Error, 0, "capture already open");
+        return false;
+    }
+    if (capacity == 0) {
+        capacity = DEFAULT_CAPACITY;
+    }
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot create capture %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    size_t size = sizeof(CaptureHeader) + capacity * sizeof(CaptureRecord);
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot size capture %s: %s", path.c_str(), strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // Populate the whole mapping now so recording never takes a page fault
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot map capture %s: %s", path.c_str(), strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    header = static_cast<CaptureHeader*>(mapping);
+    memcpy(header->magic, CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = CAPTURE_VERSION;
+    header->record_size = sizeof(CaptureRecord);
+    header->capacity = capacity;
+    header->record_count = 0;
+    records = reinterpret_cast<CaptureRecord*>(header + 1);
+    this->capacity = capacity;
+    mapped_size = size;
+    next_record.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void PacketCapture::close() {
+    if (!is_open()) {
+        return;
+    }
+    uint64_t count = record_count();
+    header->record_count = count;
+    munmap(header, mapped_size);
+    if (ftruncate(fd, static_cast<off_t>(sizeof(CaptureHeader) + count * sizeof(CaptureRecord))) != 0) {
+        EventLog::instance().message(LogLevel::Warning, 0, "cannot trim capture: %s", strerror(errno));
+    }
+    ::close(fd);
+    fd = -1;
+    header = nullptr;
+    records = nullptr;
+}
+
+bool PacketCapture::is_open() const {
+    return fd >= 0;
+}
+
+void PacketCapture::record(uint32_t board, CaptureDirection direction, const uint8_t* frame, int len,
+                           int64_t timestamp_ns) {
+    uint64_t index = next_record.fetch_add(1, std::memory_order_relaxed);
+    if (index >= capacity) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    CaptureRecord& entry = records[index];
+    if (len < 0 || !frame) {
+        len = 0;
+    }
+    if (len > static_cast<int>(sizeof(entry.data))) {
+        len = sizeof(entry.data);
+    }
+    entry.timestamp_ns = timestamp_ns;
+    entry.board = board;
+    entry.length = static_cast<uint8_t>(len);
+    memcpy(entry.data, frame, len);
+    // The direction is written last, a zero direction marks the end of an unclosed capture
+    std::atomic_signal_fence(std::memory_order_release);
+    entry.direction = direction;
+}
+
+uint64_t PacketCapture::record_count() const {
+    uint64_t count = next_record.load(std::memory_order_relaxed);
+    return count < capacity ? count : capacity;
+}
+
+uint64_t PacketCapture::dropped_count() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+CaptureReader::CaptureReader()
+    : mapping(nullptr),
+      mapped_size(0),
+      records(nullptr),
+      count(0) {
+}
+
+CaptureReader::~CaptureReader() {
+    close();
+}
+
+bool CaptureReader::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot open capture %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CaptureHeader)) {
+        EventLog::instance().message(LogLevel::Error, 0, "not a capture file: %s", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    mapped_size = static_cast<size_t>(st.st_size);
+    mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot map capture %s: %s", path.c_str(), strerror(errno));
+        mapping = nullptr;
+        return false;
+    }
+
+    const CaptureHeader* header = static_cast<const CaptureHeader*>(mapping);
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->record_size != sizeof(CaptureRecord)) {
+        EventLog::instance().message(LogLevel::Error, 0, "not a capture file: %s", path.c_str());
+        close();
+        return false;
+    }
+
+    records = reinterpret_cast<const CaptureRecord*>(header + 1);
+    size_t available = (mapped_size - sizeof(CaptureHeader)) / sizeof(CaptureRecord);
+    if (header->record_count > 0 && header->record_count <= available) {
+        count = header->record_count;
+    } else {
+        // The writer did not close the file, records end at the first empty slot
+        count = 0;
+        while (count < available && records[count].direction != static_cast<CaptureDirection>(0)) {
+            count++;
+        }
+    }
+    return true;
+}
+
+void CaptureReader::close() {
+    if (mapping) {
+        munmap(mapping, mapped_size);
+    }
+    mapping = nullptr;
+    mapped_size = 0;
+    records = nullptr;
+    count = 0;
+}
+
+size_t CaptureReader::size() const {
+    return count;
+}
+
+const CaptureRecord& CaptureReader::operator[](size_t index) const {
+    return records[index];
+}
+
+const CaptureRecord* CaptureReader::begin() const {
+    return records;
+}
+
+const CaptureRecord* CaptureReader::end() const {
+    return records + count;
+}
+
+CaptureReplay::CaptureReplay(IoSamurai& board)
+    : board(board),
+      tx_mismatches(0) {
+}
+
+bool CaptureReplay::apply(const CaptureRecord& record) {
+    switch (record.direction) {
+    case CaptureDirection::Tx: {
+        if (record.length < IOS_TX_FRAME_SIZE) {
+            return false;
+        }
+        // Take outputs and flags from the frame, then check the encoder produces the same checksum
+        board.output_data.store(record.data[0], std::memory_order_relaxed);
+        board.analog_lowpass.store((record.data[1] & IOS_FLAG_LOWPASS) != 0, std::memory_order_relaxed);
+        board.oled_off.store((record.data[1] & IOS_FLAG_OLED_OFF) != 0, std::memory_order_relaxed);
+        ios_tx_frame_t frame;
+        board.encode_frame(&frame);
+        if (frame.checksum != record.data[2]) {
+            tx_mismatches++;
+        }
+        return false;
+    }
+    case CaptureDirection::Rx: {
+        ios_rx_frame_t frame;
+        memcpy(&frame, record.data, sizeof(frame));
+        board.decode_frame(&frame, record.length, record.timestamp_ns);
+        board.publish_cycle();
+        return true;
+    }
+    case CaptureDirection::RxSkipped: {
+        ios_rx_frame_t frame;
+        memcpy(&frame, record.data, sizeof(frame));
+        board.skip_frame(&frame, record.length);
+        return false;
+    }
+    case CaptureDirection::RxMissing:
+        board.decode_frame(nullptr, -1, record.timestamp_ns);
+        board.publish_cycle();
+        return true;
+    }
+    return false;
+}
+
+uint64_t CaptureReplay::tx_mismatch_count() const {
+    return tx_mismatches;
+}
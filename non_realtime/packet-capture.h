@@ -0,0 +1,128 @@
+#ifndef PACKET_CAPTURE_H
+#define PACKET_CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <string>
+
+class IoSamurai;
+
+// What a capture record holds
+enum class CaptureDirection : uint8_t {
+    Tx = 1,         // Output frame sent to the board
+    Rx = 2,         // Reply passed to the decoder (any length)
+    RxSkipped = 3,  // Late reply that only advanced the checksum chain
+    RxMissing = 4   // No reply in this cycle (data is empty)
+};
+
+// One captured frame, fixed size so the file can be indexed directly
+struct CaptureRecord {
+    int64_t timestamp_ns;        // CLOCK_MONOTONIC time of the send or receive
+    uint32_t board;              // Board id (IoSamurai::id())
+    CaptureDirection direction;
+    uint8_t length;              // Valid bytes in data
+    uint8_t data[10];
+};
+
+// File header, records follow at offset sizeof(CaptureHeader)
+struct CaptureHeader {
+    char magic[8];               // "IOSCAP01"
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;           // Records the file has room for
+    uint64_t record_count;       // Records written, 0 if the writer did not close the file
+    uint8_t reserved[32];
+};
+
+// Append-only capture of protocol frames into a memory-mapped file.
+// The file is sized and mapped once in open(), so recording is a slot claim and
+// a 24-byte store with no system call. Any number of threads may record.
+// When the file is full further frames are dropped and counted.
+class PacketCapture {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 20; // 24 MiB, about 8 minutes of one board at 1 kHz
+
+    PacketCapture();
+    ~PacketCapture();
+
+    PacketCapture(const PacketCapture&) = delete;
+    PacketCapture& operator=(const PacketCapture&) = delete;
+
+    // Create (or truncate) the file with room for capacity records
+    bool open(const std::string& path, size_t capacity = DEFAULT_CAPACITY);
+
+    // Write the record count into the header, trim the file and unmap it
+    void close();
+
+    // Check if a file is open
+    bool is_open() const;
+
+    // Append one frame (hot path safe)
+    void record(uint32_t board, CaptureDirection direction, const uint8_t* frame, int len, int64_t timestamp_ns);
+
+    // Number of records written
+    uint64_t record_count() const;
+
+    // Number of frames dropped because the file was full
+    uint64_t dropped_count() const;
+
+private:
+    int fd;
+    CaptureHeader* header;
+    CaptureRecord* records;
+    size_t capacity;
+    size_t mapped_size;
+    alignas(64) std::atomic<uint64_t> next_record;
+    std::atomic<uint64_t> dropped;
+};
+
+// Read-only view of a capture file
+class CaptureReader {
+public:
+    CaptureReader();
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    // Map the file, returns false if it is not a capture
+    bool open(const std::string& path);
+
+    // Unmap the file
+    void close();
+
+    // Number of records (found by scanning if the writer did not close the file)
+    size_t size() const;
+
+    // Record access
+    const CaptureRecord& operator[](size_t index) const;
+    const CaptureRecord* begin() const;
+    const CaptureRecord* end() const;
+
+private:
+    void* mapping;
+    size_t mapped_size;
+    const CaptureRecord* records;
+    size_t count;
+};
+
+// Feeds captured frames of one board back through the IoSamurai decode path:
+// checksum chains, input parsing, scaling, low-pass filter and rounding.
+// The board must not be initialized or updated otherwise.
+class CaptureReplay {
+public:
+    explicit CaptureReplay(IoSamurai& board);
+
+    // Apply one record, returns true if it completed a cycle (reply or missing reply)
+    bool apply(const CaptureRecord& record);
+
+    // Number of TX frames whose checksum differed from the one the encoder produced
+    uint64_t tx_mismatch_count() const;
+
+private:
+    IoSamurai& board;
+    uint64_t tx_mismatches;
+};
+
+#endif // PACKET_CAPTURE_H
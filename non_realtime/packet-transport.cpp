@@ -0,0 +1,414 @@
+#include "packet-transport.h"
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <ifaddrs.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+#include <cerrno>
+#include "event-log.h"
+
+// Frame layout: Ethernet header, IPv4 header without options, UDP header
+static constexpr size_t ETH_HEADER = 14;
+static constexpr size_t IP_HEADER = 20;
+static constexpr size_t UDP_HEADER = 8;
+static constexpr size_t HEADERS = ETH_HEADER + IP_HEADER + UDP_HEADER;
+static constexpr size_t MIN_FRAME = 60; // Ethernet minimum without the FCS
+
+// Ring geometry, 16 frames of 256 bytes per page-sized block
+static constexpr unsigned FRAME_SIZE = 256;
+static constexpr unsigned BLOCK_SIZE = 4096;
+static constexpr unsigned FRAMES_PER_BLOCK = BLOCK_SIZE / FRAME_SIZE;
+
+// Outgoing frame data starts right after the aligned frame header
+static constexpr size_t TX_DATA_OFFSET = TPACKET_ALIGN(sizeof(struct tpacket2_hdr));
+
+// UDP port used to make the kernel resolve the board's MAC address (discard service)
+static constexpr uint16_t RESOLVE_PORT = 9;
+
+static int64_t monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+static uint16_t ip_checksum(const uint8_t* header) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < IP_HEADER; i += 2) {
+        sum += static_cast<uint32_t>(header[i] << 8 | header[i + 1]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum);
+}
+
+static void put16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value & 0xff);
+}
+
+static uint16_t get16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+PacketTransport::PacketTransport()
+    : sock(-1),
+      ifindex(0),
+      local_port(0),
+      ring(nullptr),
+      ring_size(0),
+      frame_size(FRAME_SIZE),
+      frame_count(0),
+      rx_index(0),
+      tx_index(0),
+      rx_held(false),
+      drops(0) {
+    memset(local_mac, 0, sizeof(local_mac));
+    memset(remote_mac, 0, sizeof(remote_mac));
+    memset(&local_ip, 0, sizeof(local_ip));
+    memset(&remote_addr, 0, sizeof(remote_addr));
+    memset(header_template, 0, sizeof(header_template));
+}
+
+PacketTransport::~PacketTransport() {
+    close();
+}
+
+bool PacketTransport::init(const struct sockaddr_in& remote, int local_port, const PacketConfig& config) {
+    close();
+    this->local_port = static_cast<uint16_t>(local_port);
+    if (!resolve(remote, config)) {
+        return false;
+    }
+
+    // Protocol 0 receives nothing until bind(), so no frame gets into the ring before the filter
+    sock = socket(AF_PACKET, SOCK_RAW, 0);
+    if (sock < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "packet socket creation failed: %s", strerror(errno));
+        return false;
+    }
+    if (!setup_rings(config.ring_frames) || !attach_filter()) {
+        close();
+        return false;
+    }
+    if (config.qdisc_bypass) {
+        int one = 1;
+        if (setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) < 0) {
+            EventLog::instance().message(LogLevel::Warning, 0, "PACKET_QDISC_BYPASS failed: %s", strerror(errno));
+        }
+    }
+
+    struct sockaddr_ll link_addr;
+    memset(&link_addr, 0, sizeof(link_addr));
+    link_addr.sll_family = AF_PACKET;
+    link_addr.sll_protocol = htons(ETH_P_IP);
+    link_addr.sll_ifindex = ifindex;
+    if (bind(sock, reinterpret_cast<struct sockaddr*>(&link_addr), sizeof(link_addr)) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "packet socket bind to %s failed: %s", ifname.c_str(),
+                                     strerror(errno));
+        close();
+        return false;
+    }
+
+    build_header_template();
+    char remote_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &remote_addr.sin_addr, remote_ip, sizeof(remote_ip));
+    EventLog::instance().message(LogLevel::Info, 0,
+                                 "packet transport on %s to %s (%02x:%02x:%02x:%02x:%02x:%02x), %u frame rings",
+                                 ifname.c_str(), remote_ip, remote_mac[0], remote_mac[1], remote_mac[2],
+                                 remote_mac[3], remote_mac[4], remote_mac[5], frame_count);
+    return true;
+}
+
+void PacketTransport::close() {
+    if (ring) {
+        munmap(ring, ring_size);
+        ring = nullptr;
+    }
+    if (sock >= 0) {
+        ::close(sock);
+        sock = -1;
+    }
+    ring_size = 0;
+    frame_count = 0;
+    rx_index = 0;
+    tx_index = 0;
+    rx_held = false;
+}
+
+bool PacketTransport::is_open() const {
+    return sock >= 0;
+}
+
+int PacketTransport::fd() const {
+    return sock;
+}
+
+bool PacketTransport::resolve(const struct sockaddr_in& remote, const PacketConfig& config) {
+    remote_addr = remote;
+
+    // The route to the board picks the source address; the socket also triggers the ARP request below
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probe < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "socket creation failed: %s", strerror(errno));
+        return false;
+    }
+    struct sockaddr_in probe_addr = remote;
+    probe_addr.sin_port = htons(RESOLVE_PORT);
+    struct sockaddr_in source;
+    socklen_t source_len = sizeof(source);
+    if (connect(probe, reinterpret_cast<struct sockaddr*>(&probe_addr), sizeof(probe_addr)) < 0 ||
+        getsockname(probe, reinterpret_cast<struct sockaddr*>(&source), &source_len) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "no route to the board: %s", strerror(errno));
+        ::close(probe);
+        return false;
+    }
+    local_ip = source.sin_addr;
+
+    // Interface that owns the source address, unless one was given
+    ifname = config.interface;
+    if (ifname.empty()) {
+        struct ifaddrs* list = nullptr;
+        if (getifaddrs(&list) == 0) {
+            for (struct ifaddrs* entry = list; entry; entry = entry->ifa_next) {
+                if (entry->ifa_addr && entry->ifa_addr->sa_family == AF_INET &&
+                    reinterpret_cast<struct sockaddr_in*>(entry->ifa_addr)->sin_addr.s_addr == local_ip.s_addr) {
+                    ifname = entry->ifa_name;
+                    break;
+                }
+            }
+            freeifaddrs(list);
+        }
+    }
+    ifindex = ifname.empty() ? 0 : static_cast<int>(if_nametoindex(ifname.c_str()));
+    if (ifindex == 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "no interface for the packet transport");
+        ::close(probe);
+        return false;
+    }
+
+    struct ifreq request;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.ifr_name, sizeof(request.ifr_name), "%s", ifname.c_str());
+    if (ioctl(probe, SIOCGIFHWADDR, &request) < 0 || request.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+        EventLog::instance().message(LogLevel::Error, 0, "%s is not an Ethernet interface", ifname.c_str());
+        ::close(probe);
+        return false;
+    }
+    memcpy(local_mac, request.ifr_hwaddr.sa_data, sizeof(local_mac));
+
+    // Board MAC from the neighbour table. An empty datagram to the discard port
+    // starts the ARP request without touching the board's checksum chains.
+    const int64_t deadline = monotonic_ms() + config.resolve_timeout_ms;
+    bool triggered = false;
+    while (true) {
+        struct arpreq entry;
+        memset(&entry, 0, sizeof(entry));
+        memcpy(&entry.arp_pa, &remote_addr, sizeof(remote_addr));
+        reinterpret_cast<struct sockaddr_in*>(&entry.arp_pa)->sin_port = 0;
+        snprintf(entry.arp_dev, sizeof(entry.arp_dev), "%s", ifname.c_str());
+        if (ioctl(probe, SIOCGARP, &entry) == 0 && (entry.arp_flags & ATF_COM)) {
+            memcpy(remote_mac, entry.arp_ha.sa_data, sizeof(remote_mac));
+            break;
+        }
+        if (monotonic_ms() >= deadline) {
+            EventLog::instance().message(LogLevel::Error, 0,
+                                         "board MAC address not resolved on %s (is the board on this network?)",
+                                         ifname.c_str());
+            ::close(probe);
+            return false;
+        }
+        if (!triggered) {
+            ::send(probe, "", 0, MSG_DONTWAIT);
+            triggered = true;
+        }
+        usleep(10000);
+    }
+    ::close(probe);
+    return true;
+}
+
+bool PacketTransport::setup_rings(unsigned frames) {
+    int version = TPACKET_V2;
+    if (setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "TPACKET_V2 not supported: %s", strerror(errno));
+        return false;
+    }
+
+    struct tpacket_req request;
+    memset(&request, 0, sizeof(request));
+    request.tp_block_size = BLOCK_SIZE;
+    request.tp_block_nr = frames < FRAMES_PER_BLOCK ? 1 : (frames + FRAMES_PER_BLOCK - 1) / FRAMES_PER_BLOCK;
+    request.tp_frame_size = FRAME_SIZE;
+    request.tp_frame_nr = request.tp_block_nr * FRAMES_PER_BLOCK;
+    if (setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0 ||
+        setsockopt(sock, SOL_PACKET, PACKET_TX_RING, &request, sizeof(request)) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "packet ring setup failed: %s", strerror(errno));
+        return false;
+    }
+
+    // One mapping, the TX ring follows the RX ring
+    frame_count = request.tp_frame_nr;
+    ring_size = 2 * static_cast<size_t>(request.tp_block_size) * request.tp_block_nr;
+    void* mapping = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sock, 0);
+    if (mapping == MAP_FAILED) {
+        EventLog::instance().message(LogLevel::Error, 0, "packet ring mapping failed: %s", strerror(errno));
+        ring_size = 0;
+        return false;
+    }
+    ring = static_cast<uint8_t*>(mapping);
+    return true;
+}
+
+bool PacketTransport::attach_filter() {
+    // IPv4, UDP, not a fragment, from the board's address and port to local_port
+    const uint32_t board_ip = ntohl(remote_addr.sin_addr.s_addr);
+    const uint16_t board_port = ntohs(remote_addr.sin_port);
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 10),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 8),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 26),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, board_ip, 0, 6),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+        BPF_STMT(BPF_LD | BPF_W | BPF_IND, 14),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(board_port) << 16 | local_port, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xffff),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog program;
+    program.len = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "packet filter failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void PacketTransport::build_header_template() {
+    uint8_t* eth = header_template;
+    memcpy(eth, remote_mac, 6);
+    memcpy(eth + 6, local_mac, 6);
+    put16(eth + 12, ETH_P_IP);
+
+    // No fragmentation, so the identification field stays 0 (RFC 6864)
+    uint8_t* ip = eth + ETH_HEADER;
+    ip[0] = 0x45;
+    ip[1] = 0;
+    put16(ip + 6, 0x4000); // Don't fragment
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    memcpy(ip + 12, &local_ip.s_addr, 4);
+    memcpy(ip + 16, &remote_addr.sin_addr.s_addr, 4);
+
+    // The UDP checksum is optional over IPv4 and left 0
+    uint8_t* udp = ip + IP_HEADER;
+    put16(udp, local_port);
+    put16(udp + 2, ntohs(remote_addr.sin_port));
+}
+
+bool PacketTransport::send(const void* payload, size_t len) {
+    if (!ring || HEADERS + len > frame_size - TX_DATA_OFFSET) {
+        errno = EINVAL;
+        return false;
+    }
+    uint8_t* slot = ring + static_cast<size_t>(frame_count + tx_index) * frame_size;
+    struct tpacket2_hdr* header = reinterpret_cast<struct tpacket2_hdr*>(slot);
+    if (__atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+        errno = ENOBUFS; // The kernel has not sent this slot yet
+        return false;
+    }
+
+    uint8_t* frame = slot + TX_DATA_OFFSET;
+    memcpy(frame, header_template, HEADERS);
+    uint8_t* ip = frame + ETH_HEADER;
+    put16(ip + 2, static_cast<uint16_t>(IP_HEADER + UDP_HEADER + len));
+    put16(ip + 10, ip_checksum(ip));
+    put16(ip + IP_HEADER + 4, static_cast<uint16_t>(UDP_HEADER + len));
+    memcpy(frame + HEADERS, payload, len);
+    size_t frame_len = HEADERS + len;
+    if (frame_len < MIN_FRAME) {
+        memset(frame + frame_len, 0, MIN_FRAME - frame_len);
+        frame_len = MIN_FRAME;
+    }
+    header->tp_len = static_cast<uint32_t>(frame_len);
+    __atomic_store_n(&header->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    tx_index = (tx_index + 1) % frame_count;
+
+    return ::send(sock, nullptr, 0, MSG_DONTWAIT) >= 0;
+}
+
+const uint8_t* PacketTransport::receive(int* len) {
+    if (rx_held) {
+        release();
+    }
+    while (ring) {
+        uint8_t* slot = ring + static_cast<size_t>(rx_index) * frame_size;
+        struct tpacket2_hdr* header = reinterpret_cast<struct tpacket2_hdr*>(slot);
+        if (!(__atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            return nullptr;
+        }
+        rx_held = true;
+
+        // The filter passed IPv4/UDP from the board, only the lengths are left to check
+        const uint8_t* frame = slot + header->tp_mac;
+        size_t captured = header->tp_snaplen;
+        size_t ip_len = (frame[ETH_HEADER] & 0x0f) * 4u;
+        if (captured >= ETH_HEADER + ip_len + UDP_HEADER && ip_len >= IP_HEADER) {
+            const uint8_t* udp = frame + ETH_HEADER + ip_len;
+            size_t udp_len = get16(udp + 4);
+            if (udp_len >= UDP_HEADER && ETH_HEADER + ip_len + udp_len <= captured) {
+                *len = static_cast<int>(udp_len - UDP_HEADER);
+                return udp + UDP_HEADER;
+            }
+        }
+        release(); // Truncated or malformed, skip it
+    }
+    return nullptr;
+}
+
+void PacketTransport::release() {
+    if (!rx_held) {
+        return;
+    }
+    struct tpacket2_hdr* header = reinterpret_cast<struct tpacket2_hdr*>(ring + static_cast<size_t>(rx_index) * frame_size);
+    __atomic_store_n(&header->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    rx_index = (rx_index + 1) % frame_count;
+    rx_held = false;
+}
+
+uint64_t PacketTransport::dropped_count() {
+    // The kernel clears its counters on every read, so they are summed up here
+    struct tpacket_stats stats;
+    socklen_t stats_len = sizeof(stats);
+    if (sock >= 0 && getsockopt(sock, SOL_PACKET, PACKET_STATISTICS, &stats, &stats_len) == 0) {
+        drops += stats.tp_drops;
+    }
+    return drops;
+}
+
+bool PacketTransport::reserve_port(int sockfd) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog program;
+    program.len = 1;
+    program.filter = code;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "socket filter failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
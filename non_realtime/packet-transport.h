@@ -0,0 +1,94 @@
+#ifndef PACKET_TRANSPORT_H
+#define PACKET_TRANSPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <netinet/in.h>
+
+// AF_PACKET options
+struct PacketConfig {
+    std::string interface;        // Interface to the board, empty = the one the route to the board uses
+    unsigned ring_frames = 64;    // Frames in each of the RX and TX rings (multiple of 16)
+    bool qdisc_bypass = true;     // Hand frames straight to the driver (PACKET_QDISC_BYPASS)
+    int resolve_timeout_ms = 1000; // Time to wait for the board's MAC address (ARP)
+};
+
+// UDP to one board over an AF_PACKET socket with memory-mapped RX and TX rings.
+// The Ethernet, IPv4 and UDP headers are built and checked here, so sending is
+// a header template plus the payload and receiving reads the payload in place
+// from the ring, without the UDP socket layer or a copy.
+// The board must be on a directly connected network (no router in between).
+// Not thread safe, one thread drives it.
+class PacketTransport {
+public:
+    PacketTransport();
+    ~PacketTransport();
+
+    PacketTransport(const PacketTransport&) = delete;
+    PacketTransport& operator=(const PacketTransport&) = delete;
+
+    // Open the rings for traffic between local_port and the board at remote.
+    // The caller keeps a UDP socket bound to local_port (see reserve_port()).
+    bool init(const struct sockaddr_in& remote, int local_port, const PacketConfig& config = PacketConfig());
+
+    // Release the socket and the rings
+    void close();
+
+    // Check if the rings are set up
+    bool is_open() const;
+
+    // Descriptor to wait on with poll() for received frames
+    int fd() const;
+
+    // Send one datagram to the board, false if the TX ring is full or the send failed
+    bool send(const void* payload, size_t len);
+
+    // Next datagram from the board without blocking, nullptr if none arrived.
+    // The payload stays valid until the next call to receive() or release().
+    const uint8_t* receive(int* len);
+
+    // Give the frame returned by receive() back to the kernel
+    void release();
+
+    // Frames the kernel dropped because the RX ring was full
+    uint64_t dropped_count();
+
+    // Make the kernel discard the UDP datagrams arriving on sockfd (the port stays
+    // bound, so the replies get no ICMP port unreachable)
+    static bool reserve_port(int sockfd);
+
+private:
+    // Find the interface, the addresses and the board's MAC address
+    bool resolve(const struct sockaddr_in& remote, const PacketConfig& config);
+
+    // Create and map both rings
+    bool setup_rings(unsigned frames);
+
+    // Only pass UDP from the board's address and port to local_port
+    bool attach_filter();
+
+    // Precompute the Ethernet, IPv4 and UDP headers of outgoing frames
+    void build_header_template();
+
+    int sock;
+    int ifindex;
+    std::string ifname;
+    uint8_t local_mac[6];
+    uint8_t remote_mac[6];
+    struct in_addr local_ip;
+    struct sockaddr_in remote_addr;
+    uint16_t local_port;
+    uint8_t header_template[42]; // Ethernet (14) + IPv4 (20) + UDP (8)
+
+    uint8_t* ring;
+    size_t ring_size;
+    unsigned frame_size;
+    unsigned frame_count;        // Frames per ring, TX follows RX in the mapping
+    unsigned rx_index;
+    unsigned tx_index;
+    bool rx_held;                // Frame rx_index is owned by the caller
+    uint64_t drops;
+};
+
+#endif // PACKET_TRANSPORT_H
@@ -0,0 +1,179 @@
+#include "packet-transport.h"
+#include "latency-histogram.h"
+#include "event-log.h"
+#include "io_samurai_proto.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+// Host-side cost of one request and one reply over the UDP socket and over the
+// AF_PACKET rings, against one board (or ../utility/virtual_board in the namespace
+// of ../utility/virtual_board_netns.sh). Needs CAP_NET_RAW for the packet path.
+//   send   time spent in sendto() or PacketTransport::send()
+//   recv   time from the reply being readable to its checksum being verified
+//   rtt    send to verified reply
+// On a veth pair the send also includes the delivery to the other end.
+// Usage: packet_benchmark [--address A] [--port P] [--cycles N] [--period-us N]
+
+static int64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+struct PathResult {
+    LatencyHistogram send;
+    LatencyHistogram recv;
+    LatencyHistogram rtt;
+    uint64_t replies = 0;
+    uint64_t errors = 0;
+};
+
+static void run(const char* name, const struct sockaddr_in& remote, int cycles, int64_t period_us, bool use_packet,
+                PathResult& result) {
+    // Give the board's failsafe timeout time to reset its checksum chains after an earlier run
+    usleep(250000);
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = remote.sin_port;
+    if (sockfd < 0 || bind(sockfd, reinterpret_cast<struct sockaddr*>(&local), sizeof(local)) < 0) {
+        std::cout << std::left << std::setw(8) << name << " cannot bind the local port: " << strerror(errno)
+                  << std::endl;
+        if (sockfd >= 0) {
+            close(sockfd);
+        }
+        return;
+    }
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+
+    PacketTransport packet;
+    if (use_packet && (!packet.init(remote, ntohs(remote.sin_port)) || !PacketTransport::reserve_port(sockfd))) {
+        EventLog::instance().flush();
+        std::cout << std::left << std::setw(8) << name << " not available" << std::endl;
+        close(sockfd);
+        return;
+    }
+
+    ios_link_t link;
+    ios_link_reset(&link);
+    ios_tx_frame_t request;
+    ios_rx_frame_t copy;
+    struct pollfd pfd;
+    pfd.fd = use_packet ? packet.fd() : sockfd;
+    pfd.events = POLLIN;
+
+    for (int i = 0; i < cycles; i++) {
+        ios_encode_tx(&link.tx, &request, static_cast<uint8_t>(i), 0);
+        int64_t start = monotonic_ns();
+        bool sent = use_packet ? packet.send(&request, sizeof(request))
+                               : sendto(sockfd, &request, sizeof(request), 0,
+                                        reinterpret_cast<const struct sockaddr*>(&remote), sizeof(remote)) >= 0;
+        int64_t sent_at = monotonic_ns();
+        if (sent) {
+            result.send.record(sent_at - start);
+        }
+
+        if (poll(&pfd, 1, 10) == 1) {
+            int64_t ready = monotonic_ns();
+            const ios_rx_frame_t* reply = nullptr;
+            int len = -1;
+            if (use_packet) {
+                reply = reinterpret_cast<const ios_rx_frame_t*>(packet.receive(&len));
+            } else {
+                len = recvfrom(sockfd, &copy, sizeof(copy), MSG_DONTWAIT, nullptr, nullptr);
+                reply = &copy;
+            }
+            if (reply && len == IOS_RX_FRAME_SIZE) {
+                bool ok = ios_verify_rx(&link.rx, reply);
+                int64_t done = monotonic_ns();
+                result.recv.record(done - ready);
+                result.rtt.record(done - start);
+                if (ok) {
+                    result.replies++;
+                } else {
+                    result.errors++;
+                }
+            }
+            if (use_packet) {
+                packet.release();
+            }
+        }
+        usleep(static_cast<useconds_t>(period_us));
+    }
+    close(sockfd);
+}
+
+static void print(const char* name, const PathResult& result) {
+    HistogramSummary send = result.send.summary();
+    HistogramSummary recv = result.recv.summary();
+    HistogramSummary rtt = result.rtt.summary();
+    std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << send.p50 / 1000.0 << std::setw(12) << send.p99 / 1000.0 << std::setw(12)
+              << recv.p50 / 1000.0 << std::setw(12) << recv.p99 / 1000.0 << std::setw(12) << rtt.p50 / 1000.0
+              << std::setw(12) << rtt.p99 / 1000.0 << std::setw(10) << result.replies << std::setw(8)
+              << result.errors << std::endl;
+}
+
+static void usage() {
+    std::cerr << "usage: packet_benchmark [--address A] [--port P] [--cycles N] [--period-us N]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string address = "10.77.1.1";
+    int port = 8888;
+    int cycles = 5000;
+    int64_t period_us = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--address") && i + 1 < argc) {
+            address = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+            cycles = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--period-us") && i + 1 < argc) {
+            period_us = atoll(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    struct sockaddr_in remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(port);
+    if (cycles < 1 || period_us < 0 || inet_pton(AF_INET, address.c_str(), &remote.sin_addr) <= 0) {
+        usage();
+        return 1;
+    }
+
+    std::cout << cycles << " round trips to " << address << ":" << port << ", microseconds" << std::endl;
+    std::cout << std::left << std::setw(8) << "path" << std::right << std::setw(12) << "send p50" << std::setw(12)
+              << "send p99" << std::setw(12) << "recv p50" << std::setw(12) << "recv p99" << std::setw(12)
+              << "rtt p50" << std::setw(12) << "rtt p99" << std::setw(10) << "replies" << std::setw(8) << "errors"
+              << std::endl;
+
+    PathResult udp;
+    run("udp", remote, cycles, period_us, false, udp);
+    if (udp.replies + udp.errors > 0) {
+        print("udp", udp);
+    }
+
+    PathResult packet;
+    run("packet", remote, cycles, period_us, true, packet);
+    if (packet.replies + packet.errors > 0) {
+        print("packet", packet);
+    }
+    EventLog::instance().flush();
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "io-samurai.h"
+#include "packet-capture.h"
+#include "event-log.h"
+#include <iostream>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+// Replays a capture file through the IoSamurai decoder as fast as possible.
+// Usage: replay_capture <file> [--board N] [--range MIN MAX] [--rounding] [--loops N] [--print]
+
+static int64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+static void usage() {
+    std::cerr << "usage: replay_capture <file> [--board N] [--range MIN MAX] [--rounding] [--loops N] [--print]"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    const char* path = argv[1];
+    uint32_t board_filter = 0;
+    float range_min = 0.0f;
+    float range_max = 1.0f;
+    bool rounding = false;
+    bool print = false;
+    int loops = 1;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--board") && i + 1 < argc) {
+            board_filter = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--range") && i + 2 < argc) {
+            range_min = static_cast<float>(atof(argv[++i]));
+            range_max = static_cast<float>(atof(argv[++i]));
+        } else if (!strcmp(argv[i], "--rounding")) {
+            rounding = true;
+        } else if (!strcmp(argv[i], "--loops") && i + 1 < argc) {
+            loops = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--print")) {
+            print = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    CaptureReader reader;
+    if (!reader.open(path)) {
+        EventLog::instance().flush();
+        return 1;
+    }
+    if (reader.size() == 0) {
+        std::cerr << "empty capture" << std::endl;
+        return 1;
+    }
+    if (board_filter == 0) {
+        board_filter = reader[0].board; // Default to the first board in the file
+    }
+
+    uint64_t frames = 0;
+    uint64_t cycles = 0;
+    int64_t elapsed_ns = 0;
+    IoStats stats = IoStats();
+    uint64_t tx_mismatches = 0;
+    ProcessImage last = ProcessImage();
+
+    for (int loop = 0; loop < loops; loop++) {
+        // Fresh decoder state for every pass, the checksum chains start at the beginning of the file
+        std::unique_ptr<IoSamurai> board(new IoSamurai());
+        board->set_analog_range(range_min, range_max);
+        board->set_analog_rounding(rounding);
+        CaptureReplay replay(*board);
+
+        int64_t start = monotonic_ns();
+        for (const CaptureRecord& record : reader) {
+            if (record.board != board_filter) {
+                continue;
+            }
+            frames++;
+            if (replay.apply(record)) {
+                cycles++;
+                if (print && loop == 0) {
+                    ProcessImage image = board->snapshot();
+                    std::cout << record.timestamp_ns << " " << image.connected << " 0x" << std::hex
+                              << image.inputs << " 0x" << static_cast<int>(image.outputs) << std::dec
+                              << " " << image.adc_raw << " " << image.analog_in << std::endl;
+                }
+            }
+        }
+        elapsed_ns += monotonic_ns() - start;
+
+        stats = board->stats();
+        tx_mismatches = replay.tx_mismatch_count();
+        last = board->snapshot();
+    }
+
+    std::cout << "board " << board_filter << ": " << frames << " frames, " << cycles << " cycles in "
+              << elapsed_ns / 1000 << " us (" << (frames ? elapsed_ns / static_cast<int64_t>(frames) : 0)
+              << " ns/frame)" << std::endl;
+    std::cout << "last pass: replies " << stats.replies << ", checksum errors " << stats.checksum_errors
+              << ", short packets " << stats.short_packets << ", reconnects " << stats.reconnects
+              << ", tx checksum mismatches " << tx_mismatches << std::endl;
+    std::cout << "final image: connected " << last.connected << ", inputs 0x" << std::hex << last.inputs
+              << ", outputs 0x" << static_cast<int>(last.outputs) << std::dec << ", adc " << last.adc_raw
+              << ", analog " << last.analog_in << std::endl;
+    EventLog::instance().flush();
+    return 0;
+}
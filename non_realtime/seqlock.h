@@ -0,0 +1,181 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+// Single-writer, multi-reader sequence lock for small trivially copyable values.
+// The value is stored as relaxed atomic words, so readers never block the writer
+// and a torn copy is detected by the sequence counter and retried.
+template <typename T>
+class alignas(64) Seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock value must be trivially copyable");
+
+public:
+    Seqlock() : seq(0) {
+        for (size_t i = 0; i < WORDS; i++) {
+            data[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Publish a new value (only one thread may call this)
+    void store(const T& value) {
+        uint64_t buf[WORDS] = {};
+        memcpy(buf, &value, sizeof(T));
+
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++) {
+            data[i].store(buf[i], std::memory_order_relaxed);
+        }
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    // Read a consistent copy of the last published value
+    T load() const {
+        uint64_t buf[WORDS];
+        uint32_t s0, s1;
+        do {
+            s0 = seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++) {
+                buf[i] = data[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s1 = seq.load(std::memory_order_relaxed);
+        } while ((s0 & 1) || s0 != s1);
+
+        T value;
+        memcpy(&value, buf, sizeof(T));
+        return value;
+    }
+
+    // Like load(), but gives up after attempts torn reads (for readers in another
+    // process, where a writer that died mid-store leaves the sequence odd forever)
+    bool try_load(T& value, int attempts) const {
+        uint64_t buf[WORDS];
+        for (int i = 0; i < attempts; i++) {
+            uint32_t s0 = seq.load(std::memory_order_acquire);
+            for (size_t w = 0; w < WORDS; w++) {
+                buf[w] = data[w].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (!(s0 & 1) && s0 == seq.load(std::memory_order_relaxed)) {
+                memcpy(&value, buf, sizeof(T));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Number of values published so far
+    uint32_t version() const {
+        return seq.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> seq;
+    std::atomic<uint64_t> data[WORDS];
+};
+
+// Sequence lock for a header plus an array whose length is set at run time, so a
+// reader gets the header and every item of the same store (for example one process
+// image per board of a group). Same single-writer rules as Seqlock.
+template <typename Header, typename Item>
+class SeqlockArray {
+    static_assert(std::is_trivially_copyable<Header>::value, "SeqlockArray header must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Item>::value, "SeqlockArray items must be trivially copyable");
+
+public:
+    SeqlockArray() : seq(0), count(0) {}
+
+    // Make room for items entries and clear everything (not while other threads use it)
+    void resize(size_t items) {
+        count = items;
+        data.reset(new std::atomic<uint64_t>[HEADER_WORDS + items * ITEM_WORDS]);
+        for (size_t i = 0; i < HEADER_WORDS + items * ITEM_WORDS; i++) {
+            data[i].store(0, std::memory_order_relaxed);
+        }
+        seq.store(0, std::memory_order_relaxed);
+    }
+
+    // Number of items
+    size_t size() const {
+        return count;
+    }
+
+    // Publish a header and size() items (only one thread may call this)
+    void store(const Header& header, const Item* items) {
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        store_words(0, &header, sizeof(Header), HEADER_WORDS);
+        for (size_t i = 0; i < count; i++) {
+            store_words(HEADER_WORDS + i * ITEM_WORDS, &items[i], sizeof(Item), ITEM_WORDS);
+        }
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    // Read a consistent copy of the last store, items must have room for size() entries
+    void load(Header& header, Item* items) const {
+        uint32_t s0, s1;
+        do {
+            s0 = seq.load(std::memory_order_acquire);
+            load_words(0, &header, sizeof(Header), HEADER_WORDS);
+            for (size_t i = 0; i < count; i++) {
+                load_words(HEADER_WORDS + i * ITEM_WORDS, &items[i], sizeof(Item), ITEM_WORDS);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s1 = seq.load(std::memory_order_relaxed);
+        } while ((s0 & 1) || s0 != s1);
+    }
+
+    // Read a consistent copy of item index of the last store (index < size())
+    void load_item(size_t index, Item& item) const {
+        uint32_t s0, s1;
+        do {
+            s0 = seq.load(std::memory_order_acquire);
+            load_words(HEADER_WORDS + index * ITEM_WORDS, &item, sizeof(Item), ITEM_WORDS);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s1 = seq.load(std::memory_order_relaxed);
+        } while ((s0 & 1) || s0 != s1);
+    }
+
+    // Number of stores so far
+    uint32_t version() const {
+        return seq.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    static constexpr size_t HEADER_WORDS = (sizeof(Header) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    static constexpr size_t ITEM_WORDS = (sizeof(Item) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    static constexpr size_t MAX_WORDS = HEADER_WORDS > ITEM_WORDS ? HEADER_WORDS : ITEM_WORDS;
+
+    void store_words(size_t offset, const void* value, size_t bytes, size_t words) {
+        uint64_t buf[MAX_WORDS] = {};
+        memcpy(buf, value, bytes);
+        for (size_t i = 0; i < words; i++) {
+            data[offset + i].store(buf[i], std::memory_order_relaxed);
+        }
+    }
+
+    void load_words(size_t offset, void* value, size_t bytes, size_t words) const {
+        uint64_t buf[MAX_WORDS];
+        for (size_t i = 0; i < words; i++) {
+            buf[i] = data[offset + i].load(std::memory_order_relaxed);
+        }
+        memcpy(value, buf, bytes);
+    }
+
+    std::atomic<uint32_t> seq;
+    size_t count;
+    std::unique_ptr<std::atomic<uint64_t>[]> data;
+};
+
+#endif // SEQLOCK_H
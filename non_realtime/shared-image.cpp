@@ -0,0 +1,437 @@
+#include "shared-image.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <new>
+#include "event-log.h"
+#include "io-samurai.h"
+#include "seqlock.h"
+
+static const char SHARED_MAGIC[8] = {'I', 'O', 'S', 'S', 'H', 'M', '0', '1'};
+static constexpr uint32_t SHARED_VERSION = 2;
+
+// Attempts of a reader before it gives up on a torn entry
+static constexpr int READ_ATTEMPTS = 1000;
+
+// Per-board block: description and newest cycle, the ring of images follows
+struct alignas(64) SharedBoard {
+    SharedBoardInfo info;
+    std::atomic<uint64_t> head;  // Newest published cycle, 0 = none yet
+};
+
+// Start of the command area, the command ring of every board follows
+struct alignas(64) SharedCommandHeader {
+    std::atomic<int32_t> writer_pid; // Process that owns the command area, 0 = none
+};
+
+// Output commands of one board, the command writer moves head and the owner moves tail,
+// so several commands written within one owner cycle are all applied, in order
+struct alignas(64) SharedCommandRing {
+    std::atomic<uint32_t> head;      // Commands written
+    alignas(64) std::atomic<uint32_t> tail; // Commands applied by the owner
+    alignas(64) OutputCommand entries[SharedImage::COMMAND_QUEUE];
+};
+
+using ImageEntry = Seqlock<ProcessImage>;
+
+static_assert(sizeof(SharedImageHeader) == 64, "shared image header must stay 64 bytes");
+static_assert(sizeof(SharedBoard) == 64, "shared board block header must stay 64 bytes");
+static_assert(sizeof(ImageEntry) == 64, "a ring entry must fit one cache line");
+static_assert((SharedImage::COMMAND_QUEUE & (SharedImage::COMMAND_QUEUE - 1)) == 0,
+              "the command queue must be a power of two");
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "shared memory needs lock-free atomics");
+
+static size_t page_align(size_t size) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (size + page - 1) / page * page;
+}
+
+static std::string segment_name(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+static bool process_alive(int32_t pid) {
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+static SharedBoard* board_block(uint8_t* boards, size_t board_size, size_t slot) {
+    return reinterpret_cast<SharedBoard*>(boards + slot * board_size);
+}
+
+static ImageEntry* board_ring(SharedBoard* board) {
+    return reinterpret_cast<ImageEntry*>(board + 1);
+}
+
+// ---------------------------------------------------------------------------
+// SharedImage
+// ---------------------------------------------------------------------------
+
+SharedImage::SharedImage() : fd(-1), header(nullptr), boards(nullptr), commands(nullptr) {
+}
+
+SharedImage::~SharedImage() {
+    close();
+}
+
+bool SharedImage::create(const std::string& name, size_t board_count, size_t history, mode_t mode) {
+    if (is_open()) {
+        EventLog::instance().message(LogLevel::Error, 0, "shared image already created");
+        return false;
+    }
+    if (board_count == 0 || board_count > UINT16_MAX || history == 0 || history > (1u << 20)) {
+        EventLog::instance().message(LogLevel::Error, 0, "shared image: bad board count or history");
+        return false;
+    }
+    size_t ring = 1;
+    while (ring < history) {
+        ring <<= 1;
+    }
+    this->name = segment_name(name);
+
+    fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL, mode);
+    if (fd < 0 && errno == EEXIST) {
+        // Replace the segment only if its owner is gone
+        SharedImageReader stale;
+        if (stale.open(this->name) && stale.owner_alive()) {
+            EventLog::instance().message(LogLevel::Error, 0, "shared image %s is in use by a running process",
+                                         this->name.c_str());
+            return false;
+        }
+        stale.close();
+        shm_unlink(this->name.c_str());
+        fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL, mode);
+    }
+    if (fd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot create shared image %s: %s", this->name.c_str(),
+                                     strerror(errno));
+        return false;
+    }
+    // shm_open() applies the umask, readers of other users need the requested mode
+    fchmod(fd, mode);
+
+    size_t board_size = sizeof(SharedBoard) + ring * sizeof(ImageEntry);
+    size_t command_offset = page_align(sizeof(SharedImageHeader) + board_count * board_size);
+    size_t size = command_offset + page_align(sizeof(SharedCommandHeader) + board_count * sizeof(SharedCommandRing));
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot size shared image %s: %s", this->name.c_str(),
+                                     strerror(errno));
+        close();
+        return false;
+    }
+
+    // Populate the whole mapping now so publishing never takes a page fault
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot map shared image %s: %s", this->name.c_str(),
+                                     strerror(errno));
+        close();
+        return false;
+    }
+
+    uint8_t* base = static_cast<uint8_t*>(mapping);
+    header = new (base) SharedImageHeader();
+    memcpy(header->magic, SHARED_MAGIC, sizeof(header->magic));
+    header->board_count = static_cast<uint32_t>(board_count);
+    header->history = static_cast<uint32_t>(ring);
+    header->board_size = static_cast<uint32_t>(board_size);
+    header->command_offset = command_offset;
+    header->size = size;
+    header->owner_pid = getpid();
+    boards = base + sizeof(SharedImageHeader);
+    for (size_t i = 0; i < board_count; i++) {
+        SharedBoard* board = new (board_block(boards, board_size, i)) SharedBoard();
+        board->head.store(0, std::memory_order_relaxed);
+        ImageEntry* entries = board_ring(board);
+        for (size_t j = 0; j < ring; j++) {
+            new (&entries[j]) ImageEntry();
+        }
+    }
+    SharedCommandHeader* command_header = new (base + command_offset) SharedCommandHeader();
+    command_header->writer_pid.store(0, std::memory_order_relaxed);
+    SharedCommandRing* rings = reinterpret_cast<SharedCommandRing*>(command_header + 1);
+    for (size_t i = 0; i < board_count; i++) {
+        SharedCommandRing* ring = new (&rings[i]) SharedCommandRing();
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->tail.store(0, std::memory_order_relaxed);
+    }
+    commands = rings;
+    header->version.store(SHARED_VERSION, std::memory_order_release);
+    return true;
+}
+
+void SharedImage::close() {
+    if (header) {
+        munmap(header, header->size);
+        header = nullptr;
+        boards = nullptr;
+        commands = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        fd = -1;
+    }
+}
+
+bool SharedImage::is_open() const {
+    return header != nullptr;
+}
+
+size_t SharedImage::size() const {
+    return header ? header->board_count : 0;
+}
+
+void SharedImage::describe(size_t slot, uint32_t board_id, const std::string& address, int port) {
+    if (slot >= size()) {
+        return;
+    }
+    SharedBoardInfo& info = board_block(boards, header->board_size, slot)->info;
+    info.board_id = board_id;
+    info.port = static_cast<uint16_t>(port);
+    strncpy(info.address, address.c_str(), sizeof(info.address) - 1);
+    info.address[sizeof(info.address) - 1] = '\0';
+}
+
+void SharedImage::publish(size_t slot, const ProcessImage& image) {
+    if (slot >= size()) {
+        return;
+    }
+    SharedBoard* board = board_block(boards, header->board_size, slot);
+    board_ring(board)[image.cycle & (header->history - 1)].store(image);
+    board->head.store(image.cycle, std::memory_order_release);
+}
+
+bool SharedImage::pop_command(size_t slot, OutputCommand& command) {
+    if (slot >= size()) {
+        return false;
+    }
+    SharedCommandRing& ring = commands[slot];
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (ring.head.load(std::memory_order_acquire) == tail) {
+        return false;
+    }
+    command = ring.entries[tail & (COMMAND_QUEUE - 1)];
+    // Hands the entry back to the writer
+    ring.tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void SharedImage::discard_commands(size_t slot) {
+    if (slot < size()) {
+        commands[slot].tail.store(commands[slot].head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// SharedImageReader
+// ---------------------------------------------------------------------------
+
+SharedImageReader::SharedImageReader()
+    : fd(-1),
+      header(nullptr),
+      mapped_size(0),
+      commands(nullptr),
+      writer_pid(nullptr),
+      command_size(0) {
+}
+
+SharedImageReader::~SharedImageReader() {
+    close();
+}
+
+bool SharedImageReader::open(const std::string& name, bool command_writer) {
+    if (is_open()) {
+        EventLog::instance().message(LogLevel::Error, 0, "shared image reader already open");
+        return false;
+    }
+    std::string path = segment_name(name);
+    fd = shm_open(path.c_str(), command_writer ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot open shared image %s: %s", path.c_str(),
+                                     strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SharedImageHeader)) {
+        EventLog::instance().message(LogLevel::Error, 0, "shared image %s is not ready", path.c_str());
+        close();
+        return false;
+    }
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        EventLog::instance().message(LogLevel::Error, 0, "cannot map shared image %s: %s", path.c_str(),
+                                     strerror(errno));
+        close();
+        return false;
+    }
+    header = static_cast<const SharedImageHeader*>(mapping);
+    mapped_size = static_cast<size_t>(st.st_size);
+    if (memcmp(header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0 ||
+        header->version.load(std::memory_order_acquire) != SHARED_VERSION || header->size != mapped_size) {
+        EventLog::instance().message(LogLevel::Error, 0, "%s is not a shared image of this version or not ready",
+                                     path.c_str());
+        close();
+        return false;
+    }
+
+    if (command_writer) {
+        command_size = header->size - header->command_offset;
+        mapping = mmap(nullptr, command_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                       static_cast<off_t>(header->command_offset));
+        if (mapping == MAP_FAILED) {
+            EventLog::instance().message(LogLevel::Error, 0, "cannot map the commands of %s: %s", path.c_str(),
+                                         strerror(errno));
+            command_size = 0;
+            close();
+            return false;
+        }
+        SharedCommandHeader* command_header = static_cast<SharedCommandHeader*>(mapping);
+        // One writer at a time, a writer that died without closing is replaced
+        int32_t pid = getpid();
+        int32_t current = command_header->writer_pid.load(std::memory_order_acquire);
+        do {
+            if (current != 0 && process_alive(current)) {
+                EventLog::instance().message(LogLevel::Error, 0, "commands of %s are owned by process %d",
+                                             path.c_str(), current);
+                munmap(mapping, command_size);
+                command_size = 0;
+                close();
+                return false;
+            }
+        } while (!command_header->writer_pid.compare_exchange_weak(current, pid, std::memory_order_acq_rel));
+        writer_pid = &command_header->writer_pid;
+        commands = reinterpret_cast<SharedCommandRing*>(command_header + 1);
+    }
+    return true;
+}
+
+void SharedImageReader::close() {
+    if (writer_pid) {
+        int32_t pid = getpid();
+        writer_pid->compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+        munmap(writer_pid, command_size);
+        writer_pid = nullptr;
+        commands = nullptr;
+        command_size = 0;
+    }
+    if (header) {
+        munmap(const_cast<SharedImageHeader*>(header), mapped_size);
+        header = nullptr;
+        mapped_size = 0;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool SharedImageReader::is_open() const {
+    return header != nullptr;
+}
+
+size_t SharedImageReader::size() const {
+    return header ? header->board_count : 0;
+}
+
+size_t SharedImageReader::history() const {
+    return header ? header->history : 0;
+}
+
+const SharedBoardInfo& SharedImageReader::info(size_t slot) const {
+    static const SharedBoardInfo none = {};
+    if (slot >= size()) {
+        return none;
+    }
+    uint8_t* boards = reinterpret_cast<uint8_t*>(const_cast<SharedImageHeader*>(header + 1));
+    return board_block(boards, header->board_size, slot)->info;
+}
+
+int SharedImageReader::find(const std::string& address, int port) const {
+    for (size_t i = 0; i < size(); i++) {
+        const SharedBoardInfo& board = info(i);
+        if (board.board_id != 0 && board.port == port && address == board.address) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+uint64_t SharedImageReader::latest_cycle(size_t slot) const {
+    if (slot >= size()) {
+        return 0;
+    }
+    uint8_t* boards = reinterpret_cast<uint8_t*>(const_cast<SharedImageHeader*>(header + 1));
+    return board_block(boards, header->board_size, slot)->head.load(std::memory_order_acquire);
+}
+
+bool SharedImageReader::load_entry(size_t slot, uint64_t cycle, ProcessImage& image) const {
+    uint8_t* boards = reinterpret_cast<uint8_t*>(const_cast<SharedImageHeader*>(header + 1));
+    const ImageEntry& entry = board_ring(board_block(boards, header->board_size, slot))[cycle & (header->history - 1)];
+    return entry.try_load(image, READ_ATTEMPTS) && image.cycle == cycle;
+}
+
+bool SharedImageReader::snapshot(size_t slot, ProcessImage& image) const {
+    // The newest entry can only be overwritten after history more cycles, retry if that happened
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        uint64_t cycle = latest_cycle(slot);
+        if (cycle == 0) {
+            return false;
+        }
+        if (load_entry(slot, cycle, image)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t SharedImageReader::read_history(size_t slot, uint64_t from_cycle, ProcessImage* images, size_t max) const {
+    uint64_t newest = latest_cycle(slot);
+    if (newest == 0 || max == 0) {
+        return 0;
+    }
+    uint64_t oldest = newest >= header->history ? newest - header->history + 1 : 1;
+    if (from_cycle < oldest) {
+        from_cycle = oldest;
+    }
+    size_t count = 0;
+    for (uint64_t cycle = from_cycle; cycle <= newest && count < max; cycle++) {
+        // Entries overwritten by the writer meanwhile are skipped
+        if (load_entry(slot, cycle, images[count])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool SharedImageReader::write_outputs(size_t slot, uint8_t value, uint8_t mask) {
+    if (!commands || slot >= size()) {
+        return false;
+    }
+    SharedCommandRing& ring = commands[slot];
+    uint32_t head = ring.head.load(std::memory_order_acquire);
+    if (head - ring.tail.load(std::memory_order_acquire) >= SharedImage::COMMAND_QUEUE) {
+        return false;
+    }
+    OutputCommand& command = ring.entries[head & (SharedImage::COMMAND_QUEUE - 1)];
+    command.sequence = head + 1;
+    command.value = value;
+    command.mask = mask;
+    ring.head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+size_t SharedImageReader::pending_commands(size_t slot) const {
+    if (!commands || slot >= size()) {
+        return 0;
+    }
+    return commands[slot].head.load(std::memory_order_acquire) - commands[slot].tail.load(std::memory_order_acquire);
+}
+
+bool SharedImageReader::owner_alive() const {
+    return header && process_alive(header->owner_pid);
+}
@@ -0,0 +1,155 @@
+#ifndef SHARED_IMAGE_H
+#define SHARED_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <sys/types.h>
+
+struct ProcessImage;
+struct SharedCommandRing;
+
+// Output change requested by another process, applied by the owner after the next cycle
+struct OutputCommand {
+    uint32_t sequence;           // Number of the command in its slot (1, 2, ...)
+    uint8_t value;               // New output bits
+    uint8_t mask;                // Output bits the command changes, the others keep their state
+};
+
+// Identification of one board in the segment
+struct SharedBoardInfo {
+    uint32_t board_id;           // IoSamurai::id() of the owner, 0 if the slot is not attached
+    uint16_t port;
+    char address[46];            // Board IP address, NUL terminated
+};
+
+// Segment header, the board blocks follow at offset sizeof(SharedImageHeader)
+struct SharedImageHeader {
+    char magic[8];               // "IOSSHM01"
+    std::atomic<uint32_t> version; // Written last by the owner, readers wait for it
+    uint32_t board_count;
+    uint32_t history;            // Cycles kept per board (power of two)
+    uint32_t board_size;         // Bytes per board block
+    uint64_t command_offset;     // Page-aligned offset of the command area
+    uint64_t size;               // Size of the whole segment
+    int32_t owner_pid;
+    uint8_t reserved[20];
+};
+
+// Publishes the process image of every cycle of one or more boards into a POSIX
+// shared memory segment (shm_open), so other processes can watch the boards
+// without a socket of their own (a second socket would break the checksum chain).
+// Every board has a ring of the last history cycles, each entry a seqlock, and the
+// number of its newest cycle. Readers map the images read-only; one process at a
+// time may map the command area and queue output changes (SharedImageReader).
+// Publishing is a 64-byte store per board and cycle, with no system call.
+class SharedImage {
+public:
+    static constexpr size_t DEFAULT_HISTORY = 1024; // 1 s at 1 kHz, 64 KiB per board
+    static constexpr size_t COMMAND_QUEUE = 32;     // Output commands waiting per board
+
+    SharedImage();
+    ~SharedImage();
+
+    SharedImage(const SharedImage&) = delete;
+    SharedImage& operator=(const SharedImage&) = delete;
+
+    // Create the segment /name for boards boards (history is rounded up to a power of two).
+    // A segment left behind by a process that no longer runs is replaced.
+    bool create(const std::string& name, size_t boards, size_t history = DEFAULT_HISTORY, mode_t mode = 0660);
+
+    // Unmap and remove the segment (readers keep their mapping until they close it)
+    void close();
+
+    // Check if the segment is created
+    bool is_open() const;
+
+    // Number of board slots
+    size_t size() const;
+
+    // Describe the board published in slot (done by IoSamurai::set_shared_image())
+    void describe(size_t slot, uint32_t board_id, const std::string& address, int port);
+
+    // Publish the image of one cycle (hot path, one thread per slot)
+    void publish(size_t slot, const ProcessImage& image);
+
+    // Take the oldest command of slot not applied yet, false if there is none (hot path, one atomic load)
+    bool pop_command(size_t slot, OutputCommand& command);
+
+    // Drop the commands queued for slot so far (done by IoSamurai::set_shared_image())
+    void discard_commands(size_t slot);
+
+private:
+    int fd;
+    std::string name;
+    SharedImageHeader* header;
+    uint8_t* boards;
+    SharedCommandRing* commands;
+};
+
+// Read-only view of a segment created by SharedImage, lock-free and zero-copy
+// (a read copies one 64-byte entry out of the mapping). Any number of processes
+// may read; one of them may also open the command area and change outputs.
+class SharedImageReader {
+public:
+    SharedImageReader();
+    ~SharedImageReader();
+
+    SharedImageReader(const SharedImageReader&) = delete;
+    SharedImageReader& operator=(const SharedImageReader&) = delete;
+
+    // Map the segment /name, with command_writer also the command area (only one writer at a time)
+    bool open(const std::string& name, bool command_writer = false);
+
+    // Unmap the segment and give up the command area
+    void close();
+
+    // Check if a segment is mapped
+    bool is_open() const;
+
+    // Number of board slots
+    size_t size() const;
+
+    // Cycles kept per board
+    size_t history() const;
+
+    // Owner description of slot
+    const SharedBoardInfo& info(size_t slot) const;
+
+    // Slot of the board at address:port, -1 if not found
+    int find(const std::string& address, int port) const;
+
+    // Newest published cycle of slot, 0 if none yet
+    uint64_t latest_cycle(size_t slot) const;
+
+    // Newest image of slot, false if none was published yet
+    bool snapshot(size_t slot, ProcessImage& image) const;
+
+    // Copy the images of cycles from_cycle and later that are still in the ring, oldest first.
+    // Returns the number copied (at most max); images[n - 1].cycle + 1 is the next from_cycle.
+    size_t read_history(size_t slot, uint64_t from_cycle, ProcessImage* images, size_t max) const;
+
+    // Queue new output bits (bits outside mask keep their state), needs the command area.
+    // The owner applies every queued command in order; false if COMMAND_QUEUE are still waiting.
+    bool write_outputs(size_t slot, uint8_t value, uint8_t mask = 0xFF);
+
+    // Number of commands of slot the owner has not applied yet
+    size_t pending_commands(size_t slot) const;
+
+    // Check if the owner process still runs
+    bool owner_alive() const;
+
+private:
+    // Load ring entry cycle of slot, false if it was overwritten or torn
+    bool load_entry(size_t slot, uint64_t cycle, ProcessImage& image) const;
+
+    int fd;
+    const SharedImageHeader* header;
+    size_t mapped_size;
+    SharedCommandRing* commands;
+    std::atomic<int32_t>* writer_pid;
+    size_t command_size;
+};
+
+#endif // SHARED_IMAGE_H
@@ -0,0 +1,140 @@
+#include "io-samurai.h"
+#include "shared-image.h"
+#include "event-log.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+// Watches the boards published by another process through a shared image (SharedImage).
+//   shm_monitor io-samurai                     one line per board, every --interval-ms
+//   shm_monitor io-samurai --history 0 20      last 20 cycles of slot 0
+//   shm_monitor io-samurai --follow 0          every cycle of slot 0, as it is published
+//   shm_monitor io-samurai --set 0 0x0f 0x0f   switch outputs 0-3 of slot 0 on (value, mask)
+// Usage: shm_monitor <name> [--interval-ms N] [--count N] [--history SLOT N] [--follow SLOT] [--set SLOT VALUE [MASK]]
+
+static void usage() {
+    std::cerr << "usage: shm_monitor <name> [--interval-ms N] [--count N] [--history SLOT N] [--follow SLOT]"
+                 " [--set SLOT VALUE [MASK]]" << std::endl;
+}
+
+static void print_image(const ProcessImage& image) {
+    std::cout << std::setw(10) << image.cycle << std::setw(16) << image.timestamp_ns
+              << (image.connected ? "  up  " : "  down") << "  in " << std::hex << std::setfill('0') << std::setw(4)
+              << image.inputs << "  out " << std::setw(2) << static_cast<int>(image.outputs) << std::dec
+              << std::setfill(' ') << "  adc " << std::setw(4) << image.adc_raw << "  analog " << std::fixed
+              << std::setprecision(3) << image.analog_in << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    const char* name = argv[1];
+    int interval_ms = 100;
+    long count = -1;
+    long history_slot = -1;
+    size_t history_count = 0;
+    long follow_slot = -1;
+    long set_slot = -1;
+    long set_value = 0;
+    long set_mask = 0xFF;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--interval-ms") && i + 1 < argc) {
+            interval_ms = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--history") && i + 2 < argc) {
+            history_slot = atol(argv[++i]);
+            history_count = static_cast<size_t>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--follow") && i + 1 < argc) {
+            follow_slot = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--set") && i + 2 < argc) {
+            set_slot = atol(argv[++i]);
+            set_value = strtol(argv[++i], nullptr, 0);
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                set_mask = strtol(argv[++i], nullptr, 0);
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (interval_ms < 1) {
+        usage();
+        return 1;
+    }
+
+    SharedImageReader reader;
+    if (!reader.open(name, set_slot >= 0)) {
+        EventLog::instance().flush();
+        return 1;
+    }
+    if (!reader.owner_alive()) {
+        std::cerr << "warning: the process that created " << name << " no longer runs" << std::endl;
+    }
+
+    if (set_slot >= 0) {
+        if (static_cast<size_t>(set_slot) >= reader.size()) {
+            std::cerr << "no slot " << set_slot << std::endl;
+            return 1;
+        }
+        if (!reader.write_outputs(static_cast<size_t>(set_slot), static_cast<uint8_t>(set_value),
+                                  static_cast<uint8_t>(set_mask))) {
+            std::cerr << "the command queue of slot " << set_slot << " is full, is the owner running?" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (history_slot >= 0) {
+        size_t slot = static_cast<size_t>(history_slot);
+        uint64_t newest = reader.latest_cycle(slot);
+        std::vector<ProcessImage> images(history_count);
+        uint64_t from = newest >= history_count ? newest - history_count + 1 : 1;
+        size_t n = reader.read_history(slot, from, images.data(), images.size());
+        for (size_t i = 0; i < n; i++) {
+            print_image(images[i]);
+        }
+        return 0;
+    }
+
+    if (follow_slot >= 0) {
+        // Poll often enough that the ring never laps the reader, skipped cycles show as gaps
+        size_t slot = static_cast<size_t>(follow_slot);
+        std::vector<ProcessImage> images(reader.history());
+        uint64_t next = reader.latest_cycle(slot) + 1;
+        for (long printed = 0; count < 0 || printed < count;) {
+            size_t n = reader.read_history(slot, next, images.data(), images.size());
+            for (size_t i = 0; i < n && (count < 0 || printed < count); i++, printed++) {
+                print_image(images[i]);
+            }
+            if (n > 0) {
+                next = images[n - 1].cycle + 1;
+            }
+            usleep(static_cast<useconds_t>(interval_ms) * 1000);
+        }
+        return 0;
+    }
+
+    for (long round = 0; count < 0 || round < count; round++) {
+        for (size_t slot = 0; slot < reader.size(); slot++) {
+            const SharedBoardInfo& info = reader.info(slot);
+            ProcessImage image;
+            std::cout << std::setw(3) << slot << "  " << std::left << std::setw(22)
+                      << (std::string(info.address) + ":" + std::to_string(info.port)) << std::right;
+            if (reader.snapshot(slot, image)) {
+                print_image(image);
+            } else {
+                std::cout << "  no data" << std::endl;
+            }
+        }
+        if (count < 0 || round + 1 < count) {
+            usleep(static_cast<useconds_t>(interval_ms) * 1000);
+        }
+    }
+    return 0;
+}
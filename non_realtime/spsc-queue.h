@@ -0,0 +1,56 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for one producer thread and one consumer thread.
+// Capacity must be a power of two; push() fails instead of blocking when full.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side, returns false if the queue is full
+    bool push(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots[t & (Capacity - 1)] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, returns false if the queue is empty
+    bool pop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Number of queued entries (approximate while the other side is active)
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head; // Next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail; // Next slot to push, written by the producer
+    alignas(64) T slots[Capacity];
+};
+
+#endif // SPSC_QUEUE_H
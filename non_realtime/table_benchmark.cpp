@@ -0,0 +1,230 @@
+#include "io-samurai.h"
+#include "io-samurai-group.h"
+#include "io-samurai-table.h"
+#include "event-log.h"
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+
+// Compares the per-board cost of one IoSamuraiGroup (an IoSamurai object per board) with the
+// IoSamuraiTable (struct of arrays) at several board counts:
+//   heap        bytes allocated per board for the boards and the batch buffers (mallinfo2)
+//   cpu         update() CPU time of the update thread per cycle and per board, system calls included
+//   read        time for another thread to read the latest state of every board once, per board
+// Board i is expected at address:port+i, for example
+//   ../utility/virtual_board -n 1000 -I -S
+// Both run in Immediate mode. The period must leave the boards time to answer all frames,
+// 1000 boards need several milliseconds when the emulator shares the CPU.
+// The group and the table send from --local-port (default --port), the port a real board latches on. With
+// the boards on loopback the emulator holds that port, pass --local-port 0 there and -S to
+// the emulator, which would otherwise only answer the free port of the first run.
+// Usage: table_benchmark [--boards N[,N...]] [--address A] [--port P] [--local-port P] [--cycles N]
+//                        [--period-us N] [--mode group|table]
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+// Runs body on absolute deadlines and returns the CPU time per cycle in microseconds,
+// the pacing sleep is included (see baseline)
+template <typename Body>
+static double measure(int cycles, int64_t period_ns, Body body) {
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    int64_t thread_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    for (int i = 0; i < cycles; i++) {
+        body();
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+    return (clock_ns(CLOCK_THREAD_CPUTIME_ID) - thread_cpu) / 1000.0 / cycles;
+}
+
+// Keeps the reads from being optimized away
+static volatile uint64_t read_sink;
+
+// Time per call of body in nanoseconds, best of a few rounds
+template <typename Body>
+static double time_reads(Body body) {
+    double best = 0;
+    for (int round = 0; round < 20; round++) {
+        int64_t start = clock_ns(CLOCK_MONOTONIC);
+        body();
+        double elapsed = static_cast<double>(clock_ns(CLOCK_MONOTONIC) - start);
+        best = round == 0 || elapsed < best ? elapsed : best;
+    }
+    return best;
+}
+
+static size_t heap_in_use() {
+    return mallinfo2().uordblks;
+}
+
+static void usage() {
+    std::cerr << "usage: table_benchmark [--boards N[,N...]] [--address A] [--port P] [--local-port P] [--cycles N]"
+                 " [--period-us N] [--mode group|table]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> board_counts = {10, 100, 1000};
+    std::string address = "127.0.0.2";
+    int port = 8888;
+    int local_port = -1;
+    int cycles = 2000;
+    int64_t period_us = 5000;
+    std::vector<std::string> modes = {"group", "table"};
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--boards") && i + 1 < argc) {
+            board_counts.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                board_counts.push_back(static_cast<size_t>(atol(item.c_str())));
+            }
+        } else if (!strcmp(argv[i], "--address") && i + 1 < argc) {
+            address = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--local-port") && i + 1 < argc) {
+            local_port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+            cycles = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--period-us") && i + 1 < argc) {
+            period_us = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--mode") && i + 1 < argc) {
+            modes = {argv[++i]};
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    for (size_t boards : board_counts) {
+        if (boards < 1) {
+            usage();
+            return 1;
+        }
+    }
+    if (cycles < 1 || period_us < 1) {
+        usage();
+        return 1;
+    }
+
+    // Start the log writer before measuring the heap
+    EventLog::instance();
+    const int64_t period_ns = period_us * 1000;
+    const int warmup = cycles / 10 + 10;
+
+    // Pacing only, subtracted from every run
+    double baseline = measure(cycles, period_ns, []() {});
+
+    std::cout << cycles << " cycles of " << period_us << " us" << std::endl;
+    std::cout << std::left << std::setw(8) << "mode" << std::right << std::setw(8) << "boards" << std::setw(12)
+              << "heap KiB" << std::setw(14) << "bytes/board" << std::setw(14) << "cpu us/cycle" << std::setw(14)
+              << "cpu ns/board" << std::setw(15) << "read ns/board" << std::setw(16) << "replies/cycle" << std::endl;
+
+    for (size_t boards : board_counts) {
+        for (const std::string& mode : modes) {
+            std::unique_ptr<IoSamuraiGroup> group;
+            std::unique_ptr<IoSamuraiTable> table;
+            bool ok = true;
+
+            size_t heap_before = heap_in_use();
+            if (mode == "group") {
+                group.reset(new IoSamuraiGroup());
+                ok = group->init(local_port < 0 ? port : local_port);
+                for (size_t i = 0; i < boards && ok; i++) {
+                    ok = group->add_board(address, port + static_cast<int>(i)) != nullptr;
+                }
+            } else if (mode == "table") {
+                table.reset(new IoSamuraiTable());
+                ok = table->init(boards, local_port < 0 ? port : local_port);
+                for (size_t i = 0; i < boards && ok; i++) {
+                    ok = table->add_board(address, port + static_cast<int>(i)) >= 0;
+                }
+            } else {
+                usage();
+                return 1;
+            }
+            size_t heap = heap_in_use() - heap_before;
+            if (!ok) {
+                EventLog::instance().flush();
+                std::cout << std::left << std::setw(8) << mode << " not available" << std::endl;
+                continue;
+            }
+
+            auto cycle = [&]() {
+                if (group) {
+                    group->update();
+                } else {
+                    table->update();
+                }
+            };
+            measure(warmup, period_ns, cycle);
+            if (group) {
+                for (size_t i = 0; i < boards; i++) {
+                    group->board(i).reset_stats();
+                }
+            } else {
+                table->reset_stats();
+            }
+            double cpu_us = measure(cycles, period_ns, cycle) - baseline;
+            uint64_t replies = 0;
+            if (group) {
+                for (size_t i = 0; i < boards; i++) {
+                    replies += group->board(i).stats().replies;
+                }
+            } else {
+                replies = table->stats().replies;
+            }
+
+            // What an HMI or logger thread pays to look at every board
+            double read_ns;
+            uint64_t checksum = 0;
+            if (group) {
+                read_ns = time_reads([&]() {
+                    for (size_t i = 0; i < boards; i++) {
+                        checksum += group->board(i).snapshot().inputs;
+                    }
+                });
+            } else {
+                read_ns = time_reads([&]() {
+                    for (size_t i = 0; i < boards; i++) {
+                        checksum += table->sample(i).inputs;
+                    }
+                });
+            }
+
+            read_sink = checksum;
+
+            std::cout << std::left << std::setw(8) << mode << std::right << std::setw(8) << boards << std::fixed
+                      << std::setprecision(1) << std::setw(12) << heap / 1024.0 << std::setw(14)
+                      << static_cast<double>(heap) / static_cast<double>(boards) << std::setprecision(2)
+                      << std::setw(14) << cpu_us << std::setprecision(1) << std::setw(14)
+                      << cpu_us * 1000.0 / static_cast<double>(boards) << std::setw(15)
+                      << read_ns / static_cast<double>(boards) << std::setprecision(2) << std::setw(16)
+                      << static_cast<double>(replies) / cycles << std::endl;
+
+            // Close the socket and give the boards' failsafe timeout time to reset their checksum chains
+            group.reset();
+            table.reset();
+            usleep(250000);
+        }
+    }
+    EventLog::instance().flush();
+    return 0;
+}
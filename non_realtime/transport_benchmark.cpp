@@ -0,0 +1,293 @@
+#include "io-samurai.h"
+#include "io-samurai-group.h"
+#include "event-log.h"
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Compares system calls, CPU time and round-trip time per cycle of the board I/O paths:
+//   single  one IoSamurai per board, sendto() + recvfrom() each
+//   packet  one IoSamurai per board over AF_PACKET rings (needs CAP_NET_RAW and an Ethernet interface)
+//   mmsg    IoSamuraiGroup with sendmmsg() + recvmmsg()
+//   uring   IoSamuraiGroup with io_uring
+//   sqpoll  IoSamuraiGroup with io_uring and a kernel submission poll thread
+// Board i is expected at address:port+i, for example
+//   ../utility/virtual_board -n 100 -I -S
+// The single and packet modes bind the board ports locally, so run the boards in the
+// namespace of ../utility/virtual_board_netns.sh (run 1 -n N -I) for them.
+// --round-trip poll|busy makes single and packet wait for each reply and report its round-trip time;
+// the group modes then fire all frames back to back and gather every board's reply of the same cycle.
+// The skew columns show the first to last reply arrival within a group cycle.
+// The group sends from --local-port (default --port), the port a real board latches on. With
+// the boards on loopback the emulator holds that port, pass --local-port 0 there and -S to
+// the emulator, which would otherwise only answer the free port of the first run.
+// Usage: transport_benchmark [--boards N] [--address A] [--port P] [--local-port P] [--cycles N] [--period-us N]
+//                            [--mode M] [--round-trip immediate|poll|busy]
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+// Counts system calls of the calling thread via the raw_syscalls:sys_enter tracepoint (needs tracefs and perf access)
+class SyscallCounter {
+public:
+    SyscallCounter() : fd(-1) {
+        const char* paths[] = {"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                               "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"};
+        for (const char* path : paths) {
+            FILE* file = fopen(path, "r");
+            if (!file) {
+                continue;
+            }
+            unsigned long long id = 0;
+            bool found = fscanf(file, "%llu", &id) == 1;
+            fclose(file);
+            if (!found) {
+                continue;
+            }
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.size = sizeof(attr);
+            attr.config = id;
+            fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fd >= 0) {
+                break;
+            }
+        }
+    }
+
+    ~SyscallCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool available() const {
+        return fd >= 0;
+    }
+
+    // Current count (the read itself is counted once per call)
+    uint64_t read_count() const {
+        uint64_t value = 0;
+        if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+            return 0;
+        }
+        return value;
+    }
+
+private:
+    int fd;
+};
+
+struct Result {
+    double syscalls;      // Per cycle, -1 if not available
+    double thread_cpu_us; // Per cycle, update thread only
+    double process_cpu_us; // Per cycle, including kernel poll threads
+    double replies;       // Valid replies per cycle, all boards
+    HistogramSummary rtt; // Round-trip time of the first board (with --round-trip)
+    HistogramSummary skew; // Inter-board reply skew (group modes)
+};
+
+// Runs body on absolute deadlines and measures it, the pacing sleep is included (see baseline)
+template <typename Body>
+static Result measure(const SyscallCounter& counter, int cycles, int64_t period_ns, Body body) {
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    uint64_t calls = counter.read_count();
+    int64_t thread_cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    int64_t process_cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    for (int i = 0; i < cycles; i++) {
+        body();
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+    Result result;
+    result.process_cpu_us = (clock_ns(CLOCK_PROCESS_CPUTIME_ID) - process_cpu) / 1000.0 / cycles;
+    result.thread_cpu_us = (clock_ns(CLOCK_THREAD_CPUTIME_ID) - thread_cpu) / 1000.0 / cycles;
+    result.syscalls = counter.available() ? static_cast<double>(counter.read_count() - calls) / cycles : -1.0;
+    result.replies = 0;
+    result.skew = HistogramSummary();
+    return result;
+}
+
+static uint64_t total_replies(IoSamurai* const* boards, size_t count) {
+    uint64_t replies = 0;
+    for (size_t i = 0; i < count; i++) {
+        replies += boards[i]->stats().replies;
+    }
+    return replies;
+}
+
+static void usage() {
+    std::cerr << "usage: transport_benchmark [--boards N] [--address A] [--port P] [--local-port P] [--cycles N] [--period-us N]"
+                 " [--mode single|packet|mmsg|uring|sqpoll] [--round-trip immediate|poll|busy]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int board_count = 10;
+    std::string address = "127.0.0.2";
+    int port = 8888;
+    int local_port = -1;
+    int cycles = 5000;
+    int64_t period_us = 1000;
+    std::vector<std::string> modes = {"single", "packet", "mmsg", "uring", "sqpoll"};
+    RoundTripMode round_trip = RoundTripMode::Immediate;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--boards") && i + 1 < argc) {
+            board_count = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--address") && i + 1 < argc) {
+            address = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--local-port") && i + 1 < argc) {
+            local_port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+            cycles = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--period-us") && i + 1 < argc) {
+            period_us = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--mode") && i + 1 < argc) {
+            modes = {argv[++i]};
+        } else if (!strcmp(argv[i], "--round-trip") && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (value == "poll") {
+                round_trip = RoundTripMode::Poll;
+            } else if (value == "busy") {
+                round_trip = RoundTripMode::BusyPoll;
+            } else if (value != "immediate") {
+                usage();
+                return 1;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (board_count < 1 || cycles < 1 || period_us < 1) {
+        usage();
+        return 1;
+    }
+
+    SyscallCounter counter;
+    if (!counter.available()) {
+        std::cerr << "syscall counting not available (needs tracefs and perf_event access)" << std::endl;
+    }
+    const int64_t period_ns = period_us * 1000;
+    const int warmup = cycles / 10 + 10;
+
+    // Pacing only, subtracted from every mode
+    Result baseline = measure(counter, cycles, period_ns, []() {});
+
+    std::cout << board_count << " boards, " << cycles << " cycles of " << period_us << " us" << std::endl;
+    std::cout << std::left << std::setw(8) << "mode" << std::right << std::setw(16) << "syscalls/cycle"
+              << std::setw(18) << "thread us/cycle" << std::setw(19) << "process us/cycle" << std::setw(16)
+              << "replies/cycle" << std::setw(14) << "rtt p50 us" << std::setw(14) << "rtt p99 us" << std::setw(14) << "skew p50 us"
+              << std::setw(14) << "skew p99 us" << std::endl;
+
+    for (const std::string& mode : modes) {
+        std::vector<std::unique_ptr<IoSamurai>> singles;
+        std::unique_ptr<IoSamuraiGroup> group;
+        std::vector<IoSamurai*> boards;
+        bool ok = true;
+
+        if (mode == "single" || mode == "packet") {
+            for (int i = 0; i < board_count && ok; i++) {
+                singles.emplace_back(new IoSamurai());
+                ok = singles.back()->init(address, port + i);
+                if (ok && mode == "packet") {
+                    ok = singles.back()->enable_packet_transport();
+                }
+                singles.back()->set_round_trip_mode(round_trip);
+                boards.push_back(singles.back().get());
+            }
+        } else if (mode == "mmsg" || mode == "uring" || mode == "sqpoll") {
+            group.reset(new IoSamuraiGroup());
+            ok = group->init(local_port < 0 ? port : local_port);
+            for (int i = 0; i < board_count && ok; i++) {
+                IoSamurai* board = group->add_board(address, port + i);
+                ok = board != nullptr;
+                boards.push_back(board);
+            }
+            if (ok && mode != "mmsg") {
+                UringConfig config;
+                config.sqpoll = mode == "sqpoll";
+                ok = group->enable_io_uring(config);
+            }
+            group->set_round_trip_mode(round_trip);
+        } else {
+            usage();
+            return 1;
+        }
+        if (!ok) {
+            EventLog::instance().flush();
+            std::cout << std::left << std::setw(8) << mode << " not available" << std::endl;
+            continue;
+        }
+
+        auto cycle = [&]() {
+            if (group) {
+                group->update();
+            } else {
+                for (auto& board : singles) {
+                    board->update();
+                }
+            }
+        };
+        measure(counter, warmup, period_ns, cycle);
+        for (IoSamurai* board : boards) {
+            board->reset_stats();
+        }
+        if (group) {
+            group->reset_stats();
+        }
+        Result result = measure(counter, cycles, period_ns, cycle);
+        result.replies = static_cast<double>(total_replies(boards.data(), boards.size())) / cycles;
+        result.rtt = boards[0]->stats().rtt;
+        if (group) {
+            result.skew = group->stats().reply_skew;
+        }
+
+        std::cout << std::left << std::setw(8) << mode << std::right << std::fixed << std::setprecision(2);
+        if (result.syscalls >= 0) {
+            std::cout << std::setw(16) << result.syscalls - baseline.syscalls;
+        } else {
+            std::cout << std::setw(16) << "-";
+        }
+        std::cout << std::setw(18) << result.thread_cpu_us - baseline.thread_cpu_us << std::setw(19)
+                  << result.process_cpu_us - baseline.process_cpu_us << std::setw(16) << result.replies;
+        if (result.rtt.count > 0) {
+            std::cout << std::setw(14) << result.rtt.p50 / 1000.0 << std::setw(14) << result.rtt.p99 / 1000.0;
+        } else {
+            std::cout << std::setw(14) << "-" << std::setw(14) << "-";
+        }
+        if (result.skew.count > 0) {
+            std::cout << std::setw(14) << result.skew.p50 / 1000.0 << std::setw(14) << result.skew.p99 / 1000.0;
+        } else {
+            std::cout << std::setw(14) << "-" << std::setw(14) << "-";
+        }
+        std::cout << std::endl;
+
+        // Close the sockets and give the boards' failsafe timeout time to reset their checksum chains
+        singles.clear();
+        group.reset();
+        usleep(250000);
+    }
+    EventLog::instance().flush();
+    return 0;
+}
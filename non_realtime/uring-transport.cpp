@@ -0,0 +1,547 @@
+#include "uring-transport.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include "event-log.h"
+
+// Kind of operation, kept in the upper bits of the user data
+static constexpr uint64_t USER_RECV = 1ULL << 63;
+static constexpr uint64_t USER_SEND = 1ULL << 62;
+static constexpr uint64_t USER_PROBE = 1ULL << 61;
+
+// Provided receive buffers: recvmsg header, source address, receive timestamp and up to 32 bytes of payload
+static constexpr size_t RECV_BUFFER_SIZE = 128;
+static constexpr size_t RECV_CONTROL_SIZE = CMSG_SPACE(sizeof(struct timespec));
+static constexpr uint16_t RECV_BUFFER_GROUP = 0;
+
+// Index of the socket in the registered file table
+static constexpr int SOCKET_INDEX = 0;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                              const void* arg = nullptr, size_t arg_size = 0) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+// Kernel receive time from the control data of one datagram, 0 if there is none
+static int64_t receive_stamp(const uint8_t* control, size_t len) {
+    size_t offset = 0;
+    while (offset + sizeof(struct cmsghdr) <= len) {
+        struct cmsghdr cmsg;
+        memcpy(&cmsg, control + offset, sizeof(cmsg));
+        if (cmsg.cmsg_len < sizeof(cmsg) || offset + cmsg.cmsg_len > len) {
+            break;
+        }
+        if (cmsg.cmsg_level == SOL_SOCKET && cmsg.cmsg_type == SCM_TIMESTAMPNS &&
+            cmsg.cmsg_len >= CMSG_LEN(sizeof(struct timespec))) {
+            struct timespec stamp;
+            memcpy(&stamp, control + offset + CMSG_LEN(0), sizeof(stamp));
+            return static_cast<int64_t>(stamp.tv_sec) * 1000000000LL + stamp.tv_nsec;
+        }
+        offset += CMSG_ALIGN(cmsg.cmsg_len);
+    }
+    return 0;
+}
+
+static unsigned round_up_pow2(size_t value) {
+    unsigned result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+UringTransport::UringTransport()
+    : ring_fd(-1),
+      sq_entries(0),
+      cq_entries(0),
+      sq_ring(nullptr),
+      sq_ring_size(0),
+      sq_head(nullptr),
+      sq_tail(nullptr),
+      sq_mask(nullptr),
+      sq_flags(nullptr),
+      sq_array(nullptr),
+      sqes(nullptr),
+      sqes_size(0),
+      sq_local_tail(0),
+      sq_submitted(0),
+      cq_ring(nullptr),
+      cq_head(nullptr),
+      cq_tail(nullptr),
+      cq_mask(nullptr),
+      cqes(nullptr),
+      buf_ring(nullptr),
+      buffers(nullptr),
+      buffers_size(0),
+      buf_count(0),
+      buf_tail(0),
+      recv_armed(false),
+      needs_enable(false),
+      active(false),
+      send_mode(SendMode::Message),
+      pending_sends(0),
+      enters(0),
+      recv_overruns(0) {
+    memset(&recv_msg, 0, sizeof(recv_msg));
+}
+
+UringTransport::~UringTransport() {
+    close();
+}
+
+bool UringTransport::init(int sockfd, size_t max_sends, const UringConfig& config) {
+    close();
+    this->config = config;
+
+    // Room for one cycle of sends plus the receive re-arm, completions for two cycles of sends and replies
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    unsigned entries = round_up_pow2(max_sends + 2 < 8 ? 8 : max_sends + 2);
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+    params.cq_entries = entries * 4;
+    if (config.sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = config.sqpoll_idle_ms;
+        if (config.sqpoll_cpu >= 0) {
+            params.flags |= IORING_SETUP_SQ_AFF;
+            params.sq_thread_cpu = static_cast<unsigned>(config.sqpoll_cpu);
+        }
+    } else {
+        // Completions are only run by our own io_uring_enter(), replies arriving while the
+        // update thread sleeps do not wake it. This needs a single submitting thread, so the
+        // ring starts disabled and is enabled by the first submit on the update thread.
+        params.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+    }
+
+    ring_fd = sys_io_uring_setup(entries, &params);
+    if (ring_fd < 0 && errno == EINVAL && !config.sqpoll) {
+        // Kernels before 6.1 have no deferred task work, cooperative task work is the next best
+        params.flags &= ~(IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED);
+        params.flags |= IORING_SETUP_COOP_TASKRUN;
+        ring_fd = sys_io_uring_setup(entries, &params);
+    }
+    if (ring_fd < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring_setup failed: %s", strerror(errno));
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring of this kernel is too old");
+        close();
+        return false;
+    }
+    if (!map_rings(params)) {
+        close();
+        return false;
+    }
+
+    if (sys_io_uring_register(ring_fd, IORING_REGISTER_FILES, &sockfd, 1) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring file registration failed: %s", strerror(errno));
+        close();
+        return false;
+    }
+    if (!setup_recv_buffers(entries * 2)) {
+        close();
+        return false;
+    }
+    needs_enable = (params.flags & IORING_SETUP_R_DISABLED) != 0;
+    return true;
+}
+
+bool UringTransport::activate() {
+    if (needs_enable && sys_io_uring_register(ring_fd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring enable failed: %s", strerror(errno));
+        return false;
+    }
+    needs_enable = false;
+    probe_send_support();
+    active = true;
+    return true;
+}
+
+bool UringTransport::map_rings(const struct io_uring_params& params) {
+    sq_entries = params.sq_entries;
+    cq_entries = params.cq_entries;
+
+    // Both rings share one mapping (IORING_FEAT_SINGLE_MMAP)
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > sq_ring_size) {
+        sq_ring_size = cq_size;
+    }
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                   IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring ring mapping failed: %s", strerror(errno));
+        sq_ring = nullptr;
+        return false;
+    }
+    cq_ring = sq_ring;
+
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqe_mapping = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                             IORING_OFF_SQES);
+    if (sqe_mapping == MAP_FAILED) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring sqe mapping failed: %s", strerror(errno));
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqe_mapping);
+
+    uint8_t* sq = static_cast<uint8_t*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_flags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    uint8_t* cq = static_cast<uint8_t*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Entry i of the submission ring always points at sqe i
+    for (unsigned i = 0; i < sq_entries; i++) {
+        sq_array[i] = i;
+    }
+    sq_local_tail = *sq_tail;
+    sq_submitted = sq_local_tail;
+
+    send_msgs.assign(sq_entries, msghdr());
+    send_iov.assign(sq_entries, iovec());
+    return true;
+}
+
+bool UringTransport::setup_recv_buffers(size_t count) {
+    buf_count = round_up_pow2(count);
+    if (buf_count > 32768) {
+        buf_count = 32768;
+    }
+
+    // The buffer ring must be page aligned, the buffers come from the same anonymous mapping
+    size_t ring_size = buf_count * sizeof(struct io_uring_buf);
+    ring_size = (ring_size + 4095) & ~static_cast<size_t>(4095);
+    buffers_size = ring_size + buf_count * RECV_BUFFER_SIZE;
+    void* mapping = mmap(nullptr, buffers_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+                         -1, 0);
+    if (mapping == MAP_FAILED) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring buffer allocation failed: %s", strerror(errno));
+        buffers_size = 0;
+        return false;
+    }
+    buf_ring = static_cast<struct io_uring_buf_ring*>(mapping);
+    buffers = static_cast<uint8_t*>(mapping) + ring_size;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = buf_count;
+    reg.bgid = RECV_BUFFER_GROUP;
+    if (sys_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring buffer ring registration failed: %s",
+                                     strerror(errno));
+        return false;
+    }
+
+    buf_tail = 0;
+    for (unsigned i = 0; i < buf_count; i++) {
+        recycle_buffer(static_cast<uint16_t>(i));
+    }
+
+    // The kernel writes the source address and the control data (SO_TIMESTAMPNS) behind the recvmsg header
+    recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    recv_msg.msg_controllen = RECV_CONTROL_SIZE;
+    recv_armed = false;
+    return true;
+}
+
+void UringTransport::probe_send_support() {
+    // Send to file index 1, which is not registered: a kernel that supports a
+    // destination address on IORING_OP_SEND fails the send with EBADF when it
+    // is issued, one that does not rejects it with EINVAL while preparing.
+    // No datagram leaves the host.
+    static const uint8_t probe_data[1] = {0};
+    struct sockaddr_in probe_addr;
+    memset(&probe_addr, 0, sizeof(probe_addr));
+    probe_addr.sin_family = AF_INET;
+
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = SOCKET_INDEX + 1;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = reinterpret_cast<uint64_t>(probe_data);
+    sqe->len = sizeof(probe_data);
+    sqe->addr2 = reinterpret_cast<uint64_t>(&probe_addr);
+    sqe->addr_len = sizeof(probe_addr);
+    sqe->user_data = USER_PROBE;
+
+    // Older kernels: one sendmsg per datagram, still batched into one submit
+    send_mode = wait_for(USER_PROBE) == -EINVAL ? SendMode::Message : SendMode::Address;
+}
+
+int UringTransport::wait_for(uint64_t user_data) {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = sq_local_tail - sq_submitted;
+    sq_submitted = sq_local_tail;
+    unsigned flags = IORING_ENTER_GETEVENTS | (config.sqpoll ? IORING_ENTER_SQ_WAKEUP : 0);
+    while (true) {
+        int r = sys_io_uring_enter(ring_fd, config.sqpoll ? 0 : to_submit, 1, flags);
+        if (r < 0 && errno != EINTR) {
+            EventLog::instance().message(LogLevel::Error, 0, "io_uring_enter failed: %s", strerror(errno));
+            return -errno;
+        }
+        to_submit = 0;
+
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const struct io_uring_cqe& cqe = cqes[head & *cq_mask];
+            head++;
+            if (cqe.user_data == user_data) {
+                int result = cqe.res;
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+                return result;
+            }
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+void UringTransport::close() {
+    if (ring_fd >= 0) {
+        ::close(ring_fd);
+    }
+    if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    if (sqes) {
+        munmap(sqes, sqes_size);
+    }
+    if (buf_ring) {
+        munmap(buf_ring, buffers_size);
+    }
+    ring_fd = -1;
+    sq_ring = nullptr;
+    cq_ring = nullptr;
+    sqes = nullptr;
+    buf_ring = nullptr;
+    buffers = nullptr;
+    buffers_size = 0;
+    recv_armed = false;
+    needs_enable = false;
+    active = false;
+    pending_sends = 0;
+}
+
+bool UringTransport::is_open() const {
+    return ring_fd >= 0;
+}
+
+size_t UringTransport::capacity() const {
+    return sq_entries > 2 ? sq_entries - 2 : 0;
+}
+
+struct io_uring_sqe* UringTransport::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sq_local_tail - head >= sq_entries) {
+        return nullptr;
+    }
+    struct io_uring_sqe* sqe = &sqes[sq_local_tail & *sq_mask];
+    sq_local_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool UringTransport::arm_recv() {
+    struct io_uring_sqe* sqe = get_sqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = SOCKET_INDEX;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->addr = reinterpret_cast<uint64_t>(&recv_msg);
+    sqe->len = 1;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->user_data = USER_RECV;
+    recv_armed = true;
+    return true;
+}
+
+void UringTransport::recycle_buffer(uint16_t id) {
+    // Indexed by hand: in C++ the flexible array of the uapi header does not start at offset 0
+    struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(buf_ring);
+    struct io_uring_buf& buf = bufs[buf_tail & (buf_count - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffers + static_cast<size_t>(id) * RECV_BUFFER_SIZE);
+    buf.len = RECV_BUFFER_SIZE;
+    buf.bid = id;
+    buf_tail++;
+    __atomic_store_n(&buf_ring->tail, static_cast<uint16_t>(buf_tail), __ATOMIC_RELEASE);
+}
+
+bool UringTransport::queue_send(const void* data, size_t len, const struct sockaddr_in* dest, uint32_t tag) {
+    if (!active && !activate()) {
+        return false;
+    }
+    struct io_uring_sqe* sqe = get_sqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->fd = SOCKET_INDEX;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->user_data = USER_SEND | tag;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (send_mode == SendMode::Message) {
+        unsigned slot = (sq_local_tail - 1) & *sq_mask;
+        send_iov[slot].iov_base = const_cast<uint8_t*>(bytes);
+        send_iov[slot].iov_len = len;
+        memset(&send_msgs[slot], 0, sizeof(send_msgs[slot]));
+        send_msgs[slot].msg_name = const_cast<struct sockaddr_in*>(dest);
+        send_msgs[slot].msg_namelen = sizeof(*dest);
+        send_msgs[slot].msg_iov = &send_iov[slot];
+        send_msgs[slot].msg_iovlen = 1;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = reinterpret_cast<uint64_t>(&send_msgs[slot]);
+        sqe->len = 1;
+    } else {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = reinterpret_cast<uint64_t>(bytes);
+        sqe->len = static_cast<uint32_t>(len);
+        sqe->addr2 = reinterpret_cast<uint64_t>(dest);
+        sqe->addr_len = sizeof(*dest);
+    }
+    pending_sends++;
+    return true;
+}
+
+bool UringTransport::submit() {
+    if (!active && !activate()) {
+        return false;
+    }
+    if (!recv_armed && !arm_recv()) {
+        EventLog::instance().message(LogLevel::Warning, 0, "io_uring queue full, receive not armed");
+    }
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    if (config.sqpoll) {
+        // The poll thread picks the entries up by itself unless it went to sleep
+        sq_submitted = sq_local_tail;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+            enters++;
+            if (sys_io_uring_enter(ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP) < 0) {
+                EventLog::instance().event(LogLevel::Error, 0, LogCode::SendFailed, errno);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Even with nothing to send, entering runs the task work that posts the received replies
+    unsigned to_submit = sq_local_tail - sq_submitted;
+    enters++;
+    int r = sys_io_uring_enter(ring_fd, to_submit, 0, IORING_ENTER_GETEVENTS);
+    if (r < 0) {
+        EventLog::instance().event(LogLevel::Error, 0, LogCode::SendFailed, errno);
+        return false;
+    }
+    sq_submitted += static_cast<unsigned>(r);
+    return true;
+}
+
+bool UringTransport::wait(int64_t timeout_ns) {
+    if (!active) {
+        return false;
+    }
+    enters++;
+    int r;
+    if (timeout_ns <= 0) {
+        r = sys_io_uring_enter(ring_fd, 0, 0, IORING_ENTER_GETEVENTS);
+    } else {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout_ns / 1000000000LL;
+        ts.tv_nsec = timeout_ns % 1000000000LL;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        r = sys_io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    if (r < 0 && errno != ETIME && errno != EINTR) {
+        EventLog::instance().message(LogLevel::Error, 0, "io_uring_enter failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+size_t UringTransport::reap(UringReply* replies, size_t max) {
+    size_t count = 0;
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail && count < max) {
+        const struct io_uring_cqe& cqe = cqes[head & *cq_mask];
+        head++;
+
+        if (cqe.user_data == USER_RECV) {
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                recv_armed = false; // Re-armed by the next submit()
+            }
+            if (cqe.res < 0) {
+                if (cqe.res == -ENOBUFS) {
+                    recv_overruns++;
+                } else {
+                    EventLog::instance().message(LogLevel::Warning, 0, "io_uring receive failed: %s",
+                                                 strerror(-cqe.res));
+                }
+                continue;
+            }
+            if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+                continue;
+            }
+            uint16_t id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            const uint8_t* buffer = buffers + static_cast<size_t>(id) * RECV_BUFFER_SIZE;
+            const struct io_uring_recvmsg_out* out = reinterpret_cast<const struct io_uring_recvmsg_out*>(buffer);
+            const uint8_t* name = buffer + sizeof(*out);
+            const uint8_t* payload = name + recv_msg.msg_namelen + recv_msg.msg_controllen;
+
+            UringReply& reply = replies[count++];
+            memset(&reply.addr, 0, sizeof(reply.addr));
+            memcpy(&reply.addr, name, out->namelen < sizeof(reply.addr) ? out->namelen : sizeof(reply.addr));
+            reply.len = static_cast<int>(out->payloadlen);
+            size_t copy = out->payloadlen < sizeof(reply.data) ? out->payloadlen : sizeof(reply.data);
+            memcpy(reply.data, payload, copy);
+            reply.stamp_ns = receive_stamp(name + recv_msg.msg_namelen, out->controllen);
+            recycle_buffer(id);
+        } else if (cqe.user_data & USER_SEND) {
+            pending_sends--;
+            if (cqe.res < 0) {
+                EventLog::instance().event(LogLevel::Error, static_cast<uint32_t>(cqe.user_data & 0xffffffff),
+                                           LogCode::SendFailed, -cqe.res);
+            }
+        }
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+size_t UringTransport::sends_in_flight() const {
+    return pending_sends;
+}
+
+uint64_t UringTransport::enter_count() const {
+    return enters;
+}
+
+uint64_t UringTransport::recv_overrun_count() const {
+    return recv_overruns;
+}
@@ -0,0 +1,153 @@
+#ifndef URING_TRANSPORT_H
+#define URING_TRANSPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+// io_uring options
+struct UringConfig {
+    bool sqpoll = false;          // A kernel thread polls the submission queue, no io_uring_enter() in steady state
+    int sqpoll_cpu = -1;          // CPU to pin the poll thread to, -1 disables pinning
+    unsigned sqpoll_idle_ms = 1000; // Idle time before the poll thread sleeps and needs a wakeup
+};
+
+// One received datagram, copied out of the kernel buffer
+struct UringReply {
+    struct sockaddr_in addr;      // Source address
+    int len;                      // Datagram length (data holds at most sizeof(data) bytes)
+    int64_t stamp_ns;             // Kernel receive time (CLOCK_REALTIME) with SO_TIMESTAMPNS on the socket, else 0
+    uint8_t data[16];
+};
+
+// Batched UDP I/O on one socket through io_uring, using the raw system calls (no liburing).
+// The socket is a registered file and one multishot recvmsg keeps receiving into
+// a registered ring of provided buffers.
+// A cycle queues all sends and submits them with a single io_uring_enter(), which
+// also flushes the replies that arrived since the last cycle; with SQPOLL the
+// steady state needs no system call at all. Not thread safe, one thread drives it.
+class UringTransport {
+public:
+    UringTransport();
+    ~UringTransport();
+
+    UringTransport(const UringTransport&) = delete;
+    UringTransport& operator=(const UringTransport&) = delete;
+
+    // Set up the ring for up to max_sends datagrams per submit on sockfd (the caller keeps owning it).
+    // The thread that submits first becomes the only one allowed to drive the ring.
+    bool init(int sockfd, size_t max_sends, const UringConfig& config = UringConfig());
+
+    // Release the ring and the buffers
+    void close();
+
+    // Check if the ring is set up
+    bool is_open() const;
+
+    // Number of datagrams that fit into one submit
+    size_t capacity() const;
+
+    // Queue one datagram, data and dest must stay valid until the send completes (see sends_in_flight()).
+    // tag identifies the datagram in the log. Returns false if the queue is full.
+    bool queue_send(const void* data, size_t len, const struct sockaddr_in* dest, uint32_t tag);
+
+    // Submit everything queued (one io_uring_enter(), or none with SQPOLL while the poll thread is awake)
+    bool submit();
+
+    // Wait up to timeout_ns for a completion; 0 only posts what already arrived (after the first submit())
+    bool wait(int64_t timeout_ns);
+
+    // Copy up to max received datagrams into replies, returns the number copied
+    size_t reap(UringReply* replies, size_t max);
+
+    // Number of sends whose completion has not been reaped yet
+    size_t sends_in_flight() const;
+
+    // Number of io_uring_enter() calls
+    uint64_t enter_count() const;
+
+    // Number of times receiving stopped because every provided buffer was full
+    uint64_t recv_overrun_count() const;
+
+private:
+    // How datagrams are sent, depends on what the kernel supports
+    enum class SendMode {
+        Address, // IORING_OP_SEND with a destination address (Linux 6.0 and later)
+        Message  // IORING_OP_SENDMSG
+    };
+
+    // Map the submission and completion rings
+    bool map_rings(const struct io_uring_params& params);
+
+    // Create and register the provided buffer ring for multishot receive
+    bool setup_recv_buffers(size_t count);
+
+    // Enable the ring on the calling thread and probe the send support (first submit)
+    bool activate();
+
+    // Find out whether the kernel supports sends with a destination address
+    void probe_send_support();
+
+    // Get a free submission queue entry, nullptr if the queue is full
+    struct io_uring_sqe* get_sqe();
+
+    // Queue the multishot recvmsg
+    bool arm_recv();
+
+    // Give a receive buffer back to the kernel
+    void recycle_buffer(uint16_t id);
+
+    // Wait for one completion with the given user data (setup only)
+    int wait_for(uint64_t user_data);
+
+    int ring_fd;
+    UringConfig config;
+    unsigned sq_entries;
+    unsigned cq_entries;
+
+    // Submission ring
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_flags;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned sq_local_tail;
+    unsigned sq_submitted;
+
+    // Completion ring
+    void* cq_ring;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    // Provided receive buffers
+    struct io_uring_buf_ring* buf_ring;
+    uint8_t* buffers;
+    size_t buffers_size;
+    unsigned buf_count;
+    unsigned buf_tail;
+    struct msghdr recv_msg;
+    bool recv_armed;
+
+    bool needs_enable;   // Ring created disabled, enabled by the submitting thread
+    bool active;
+
+    // Outgoing datagrams
+    SendMode send_mode;
+    std::vector<struct msghdr> send_msgs; // One per submission slot (SendMode::Message)
+    std::vector<struct iovec> send_iov;
+    size_t pending_sends;
+
+    uint64_t enters;
+    uint64_t recv_overruns;
+};
+
+#endif // URING_TRANSPORT_H
@@ -18,49 +18,44 @@ int main() {
     io.set_analog_rounding(true);
     io.set_oled_off(true);
 
-    // Timing parameters
-    using namespace std::chrono;
-    auto interval = milliseconds(1); // 1 ms interval
-    auto next_time = steady_clock::now();
+    // Set some outputs
+    io.set_output(0, true);
+    io.set_output(1, true);
+
+    // 1 ms cycle on absolute deadlines, SCHED_FIFO needs root or CAP_SYS_NICE
+    CyclicConfig cycle;
+    cycle.period_us = 1000;
+    cycle.priority = 80;
+    cycle.lock_memory = true;
+    cycle.prefault_stack = 64 * 1024;
+    if (!io.start_periodic_update(cycle)) {
+        std::cerr << "Real-time scheduling not available, using default policy" << std::endl;
+        if (!io.start_periodic_update(CyclicConfig())) {
+            return 1;
+        }
+    }
 
-    // Main loop
+    // Main loop, the I/O runs on its own thread so printing does not disturb the cycle
     while (true) {
-        // Current time
-        auto now = steady_clock::now();
-
-        // Check if it's time to update
-        if (now >= next_time) {
-            // Set some outputs
-            io.set_output(0, true);
-            io.set_output(1, true);
-
-            // Update communication
-            io.update();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
-            // Read inputs
-            for (int i = 0; i < 16; i++) {
-                std::cout << "I-" << i << ":" << io.get_input(i);
-            }
-            std::cout << std::endl;
-
-            // Read analog input
-            std::cout << "Analog In: " << io.get_analog_in() << std::endl;
-            std::cout << "Analog In (s32): " << io.get_analog_in_s32() << std::endl;
-            std::cout << "Connected: " << io.is_connected() << std::endl;
-
-            // Schedule next update
-            next_time += interval;
-
-            // If we're behind schedule, catch up to avoid drift
-            if (next_time < now) {
-                next_time = now + interval;
-                std::cerr << "Warning: Update loop falling behind schedule" << std::endl;
-            }
+        // Read inputs
+        for (int i = 0; i < 16; i++) {
+            std::cout << "I-" << i << ":" << io.get_input(i);
         }
-
-        // Sleep until the next update (non-blocking if possible)
-        std::this_thread::sleep_until(next_time);
+        std::cout << std::endl;
+
+        // Read analog input
+        std::cout << "Analog In: " << io.get_analog_in() << std::endl;
+        std::cout << "Analog In (s32): " << io.get_analog_in_s32() << std::endl;
+        std::cout << "Connected: " << io.is_connected() << std::endl;
+        std::cout << "Cycles: " << io.cycle_count() << " Overruns: " << io.overrun_count()
+                  << " Max latency: " << io.max_latency_ns() / 1000 << " us" << std::endl;
+        IoStats stats = io.stats();
+        std::cout << "Jitter p99: " << stats.jitter.p99 / 1000 << " us"
+                  << " Checksum errors: " << stats.checksum_errors
+                  << " Reconnects: " << stats.reconnects << std::endl;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,2 @@
+SRC=../non_realtime
+g++ -std=c++17 -O2 -pthread -shared -fPIC $(python3-config --includes) -I$SRC -o io_samurai_native$(python3-config --extension-suffix) io_samurai_native.cpp $SRC/io-samurai.cpp $SRC/io-samurai-group.cpp $SRC/uring-transport.cpp $SRC/packet-transport.cpp $SRC/cyclic-task.cpp $SRC/event-log.cpp $SRC/latency-histogram.cpp $SRC/packet-capture.cpp $SRC/shared-image.cpp
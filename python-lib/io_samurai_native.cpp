@@ -0,0 +1,981 @@
+// Python extension module wrapping the C++ client in ../non_realtime (CPython C API only).
+// The update thread of a Board or a Group is a plain C++ thread that never touches
+// the interpreter, so the board I/O runs at its own rate outside the GIL and Python
+// only reads the published process images (lock-free) whenever it wants to.
+// Build with build_native.sh.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "io-samurai.h"
+#include "io-samurai-group.h"
+#include "event-log.h"
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstring>
+
+static PyTypeObject* board_type = nullptr;
+static PyTypeObject* group_type = nullptr;
+static PyTypeObject* image_type = nullptr;
+
+struct GroupObject {
+    PyObject_HEAD
+    IoSamuraiGroup* group;                                 // nullptr after close()
+    std::vector<std::unique_ptr<InputEventQueue>>* events; // One per board, created by the first subscription
+    bool running;
+    int busy;                                              // Calls using group without the GIL
+};
+
+struct BoardObject {
+    PyObject_HEAD
+    IoSamurai* io;            // Owned for a standalone board, borrowed from the group otherwise
+    GroupObject* group;       // Group that owns io (strong reference), nullptr for a standalone board
+    Py_ssize_t index;         // Index in the group
+    InputEventQueue* events;  // Subscribed input events of a standalone board (group boards use the group's)
+    bool running;
+    int busy;                 // Calls using io without the GIL
+};
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+
+static PyStructSequence_Field image_fields[] = {
+    {"cycle", "Update cycle that produced this image"},
+    {"timestamp_ns", "CLOCK_MONOTONIC time of the last valid reply"},
+    {"analog_in", "Scaled (and optionally filtered/rounded) analog input"},
+    {"analog_in_s32", "Analog input as integer"},
+    {"inputs", "Input bits 0-15"},
+    {"adc_raw", "Raw 12-bit ADC value"},
+    {"outputs", "Output bits sent in this cycle"},
+    {"status", "Board status bits"},
+    {"connected", "Last reply arrived with a valid checksum"},
+    {nullptr, nullptr}};
+
+static PyStructSequence_Desc image_desc = {"io_samurai_native.ProcessImage", "Board state published after an update cycle",
+                                           image_fields, 9};
+
+static PyObject* image_to_python(const ProcessImage& image) {
+    PyObject* result = PyStructSequence_New(image_type);
+    if (!result) {
+        return nullptr;
+    }
+    PyObject* values[] = {PyLong_FromUnsignedLongLong(image.cycle), PyLong_FromLongLong(image.timestamp_ns),
+                          PyFloat_FromDouble(image.analog_in),      PyLong_FromLong(image.analog_in_s32),
+                          PyLong_FromLong(image.inputs),            PyLong_FromLong(image.adc_raw),
+                          PyLong_FromLong(image.outputs),           PyLong_FromLong(image.status),
+                          PyBool_FromLong(image.connected)};
+    for (Py_ssize_t i = 0; i < 9; i++) {
+        if (!values[i]) {
+            for (Py_ssize_t j = i + 1; j < 9; j++) {
+                Py_XDECREF(values[j]);
+            }
+            Py_DECREF(result);
+            return nullptr;
+        }
+        PyStructSequence_SetItem(result, i, values[i]);
+    }
+    return result;
+}
+
+static PyObject* summary_to_python(const HistogramSummary& summary) {
+    return Py_BuildValue("{s:K,s:L,s:L,s:L,s:L,s:L}", "count", static_cast<unsigned long long>(summary.count), "p50",
+                         static_cast<long long>(summary.p50), "p99", static_cast<long long>(summary.p99), "p999",
+                         static_cast<long long>(summary.p999), "max", static_cast<long long>(summary.max), "mean",
+                         static_cast<long long>(summary.mean));
+}
+
+static bool parse_cyclic_config(PyObject* args, PyObject* kwargs, CyclicConfig& config) {
+    static const char* keywords[] = {"period_us", "priority", "cpu", "lock_memory", "prefault_stack", nullptr};
+    long long period_us = config.period_us;
+    int lock_memory = config.lock_memory;
+    Py_ssize_t prefault_stack = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Liipn", const_cast<char**>(keywords), &period_us,
+                                     &config.priority, &config.cpu, &lock_memory, &prefault_stack)) {
+        return false;
+    }
+    if (period_us < 1 || prefault_stack < 0) {
+        PyErr_SetString(PyExc_ValueError, "period_us must be positive and prefault_stack not negative");
+        return false;
+    }
+    config.period_us = period_us;
+    config.lock_memory = lock_memory != 0;
+    config.prefault_stack = static_cast<size_t>(prefault_stack);
+    return true;
+}
+
+// Get a writable, contiguous buffer of at least count items in one of the struct formats in formats
+static bool get_array(PyObject* object, const char* formats, Py_ssize_t count, Py_buffer* view, const char* name) {
+    if (PyObject_GetBuffer(object, view, PyBUF_CONTIG | PyBUF_FORMAT) < 0) {
+        return false;
+    }
+    const char* format = view->format ? view->format : "B";
+    if (*format == '@' || *format == '=' || (*format == '<' && PY_LITTLE_ENDIAN) || (*format == '>' && PY_BIG_ENDIAN)) {
+        format++;
+    }
+    if (strlen(format) != 1 || !strchr(formats, *format) || view->len / view->itemsize < count) {
+        PyErr_Format(PyExc_ValueError, "%s must be a writable array of at least %zd items of type '%s'", name, count,
+                     formats);
+        PyBuffer_Release(view);
+        return false;
+    }
+    return true;
+}
+
+// Wait until the calls that use the client without the GIL have returned. busy only changes
+// with the GIL held, so a closed object (client pointer cleared) cannot become busy again.
+static void wait_idle(const int& busy) {
+    while (busy > 0) {
+        Py_BEGIN_ALLOW_THREADS
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        Py_END_ALLOW_THREADS
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Board
+// ---------------------------------------------------------------------------
+
+// The board's client, or nullptr with an exception set if the board or its group is closed
+static IoSamurai* board_io(BoardObject* self) {
+    if (!self->io || (self->group && !self->group->group)) {
+        PyErr_SetString(PyExc_ValueError, "board is closed");
+        return nullptr;
+    }
+    return self->io;
+}
+
+// Queue of the board's input events, created on request (several Board objects may wrap one group board)
+static InputEventQueue* board_events(BoardObject* self, bool create) {
+    if (self->group) {
+        std::unique_ptr<InputEventQueue>& slot = (*self->group->events)[static_cast<size_t>(self->index)];
+        if (!slot && create) {
+            slot.reset(new InputEventQueue());
+        }
+        return slot.get();
+    }
+    if (!self->events && create) {
+        self->events = new InputEventQueue();
+    }
+    return self->events;
+}
+
+static void board_release(BoardObject* self) {
+    if (!self->group) {
+        IoSamurai* io = self->io;
+        InputEventQueue* events = self->events;
+        self->io = nullptr;
+        self->events = nullptr;
+        wait_idle(self->busy);
+        self->running = false;
+        // Joins the update thread, which may be waiting for a reply
+        Py_BEGIN_ALLOW_THREADS
+        delete io;
+        delete events;
+        Py_END_ALLOW_THREADS
+    }
+}
+
+static PyObject* board_wrap(GroupObject* group, Py_ssize_t index) {
+    BoardObject* board = reinterpret_cast<BoardObject*>(board_type->tp_alloc(board_type, 0));
+    if (!board) {
+        return nullptr;
+    }
+    Py_INCREF(group);
+    board->group = group;
+    board->index = index;
+    board->io = &group->group->board(static_cast<size_t>(index));
+    return reinterpret_cast<PyObject*>(board);
+}
+
+static int board_init(PyObject* object, PyObject* args, PyObject* kwargs) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    static const char* keywords[] = {"ip_address", "port", nullptr};
+    const char* ip_address = "192.168.0.177";
+    int port = 8888;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|si", const_cast<char**>(keywords), &ip_address, &port)) {
+        return -1;
+    }
+    if (self->group) {
+        PyErr_SetString(PyExc_TypeError, "boards of a group are created with Group.add_board()");
+        return -1;
+    }
+    board_release(self);
+    std::unique_ptr<IoSamurai> io(new IoSamurai());
+    if (!io->init(ip_address, port)) {
+        PyErr_Format(PyExc_OSError, "cannot open the UDP socket for %s:%d (see the log)", ip_address, port);
+        return -1;
+    }
+    self->io = io.release();
+    return 0;
+}
+
+static void board_dealloc(PyObject* object) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    PyTypeObject* type = Py_TYPE(object);
+    board_release(self);
+    Py_XDECREF(self->group);
+    type->tp_free(object);
+    Py_DECREF(type);
+}
+
+static PyObject* board_close(PyObject* object, PyObject*) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    if (self->group) {
+        PyErr_SetString(PyExc_TypeError, "boards of a group are closed with Group.close()");
+        return nullptr;
+    }
+    board_release(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_update(PyObject* object, PyObject*) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    IoSamurai* io = board_io(self);
+    if (!io) {
+        return nullptr;
+    }
+    if (self->group || self->running) {
+        PyErr_SetString(PyExc_RuntimeError, "board is updated by its group or its update thread");
+        return nullptr;
+    }
+    self->busy++;
+    Py_BEGIN_ALLOW_THREADS
+    io->update();
+    Py_END_ALLOW_THREADS
+    self->busy--;
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_start(PyObject* object, PyObject* args, PyObject* kwargs) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    CyclicConfig config;
+    if (!parse_cyclic_config(args, kwargs, config)) {
+        return nullptr;
+    }
+    IoSamurai* io = board_io(self);
+    if (!io) {
+        return nullptr;
+    }
+    if (self->group) {
+        PyErr_SetString(PyExc_TypeError, "boards of a group are updated with Group.start()");
+        return nullptr;
+    }
+    bool started;
+    self->busy++;
+    Py_BEGIN_ALLOW_THREADS
+    started = io->start_periodic_update(config);
+    Py_END_ALLOW_THREADS
+    self->busy--;
+    if (!started) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot start the update thread (see the log)");
+        return nullptr;
+    }
+    self->running = true;
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_stop(PyObject* object, PyObject*) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    IoSamurai* io = board_io(self);
+    if (!io) {
+        return nullptr;
+    }
+    if (!self->group) {
+        self->busy++;
+        Py_BEGIN_ALLOW_THREADS
+        io->stop_periodic_update();
+        Py_END_ALLOW_THREADS
+        self->busy--;
+        self->running = false;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_set_output(PyObject* object, PyObject* args) {
+    int index;
+    int value;
+    if (!PyArg_ParseTuple(args, "ip", &index, &value)) {
+        return nullptr;
+    }
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return nullptr;
+    }
+    if (index < 0 || index > 7) {
+        PyErr_SetString(PyExc_IndexError, "output index must be 0 to 7");
+        return nullptr;
+    }
+    io->set_output(index, value != 0);
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_get_input(PyObject* object, PyObject* arg) {
+    long index = PyLong_AsLong(arg);
+    if (index == -1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return nullptr;
+    }
+    if (index < 0 || index > 15) {
+        PyErr_SetString(PyExc_IndexError, "input index must be 0 to 15");
+        return nullptr;
+    }
+    return PyBool_FromLong(io->get_input(static_cast<int>(index)));
+}
+
+static PyObject* board_snapshot(PyObject* object, PyObject*) {
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return nullptr;
+    }
+    return image_to_python(io->snapshot());
+}
+
+static PyObject* board_set_analog_range(PyObject* object, PyObject* args) {
+    float min_value;
+    float max_value;
+    if (!PyArg_ParseTuple(args, "ff", &min_value, &max_value)) {
+        return nullptr;
+    }
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return nullptr;
+    }
+    io->set_analog_range(min_value, max_value);
+    Py_RETURN_NONE;
+}
+
+// Setters taking one bool
+template <void (IoSamurai::*Setter)(bool)>
+static PyObject* board_set_flag(PyObject* object, PyObject* arg) {
+    int value = PyObject_IsTrue(arg);
+    if (value < 0) {
+        return nullptr;
+    }
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return nullptr;
+    }
+    (io->*Setter)(value != 0);
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_set_round_trip_mode(PyObject* object, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"mode", "timeout_us", nullptr};
+    const char* name;
+    int timeout_us = 500;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", const_cast<char**>(keywords), &name, &timeout_us)) {
+        return nullptr;
+    }
+    RoundTripMode mode;
+    if (!strcmp(name, "immediate")) {
+        mode = RoundTripMode::Immediate;
+    } else if (!strcmp(name, "poll")) {
+        mode = RoundTripMode::Poll;
+    } else if (!strcmp(name, "busy")) {
+        mode = RoundTripMode::BusyPoll;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "mode must be 'immediate', 'poll' or 'busy'");
+        return nullptr;
+    }
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    IoSamurai* io = board_io(self);
+    if (!io) {
+        return nullptr;
+    }
+    if (self->group) {
+        PyErr_SetString(PyExc_TypeError, "the round-trip mode only applies to standalone boards");
+        return nullptr;
+    }
+    io->set_round_trip_mode(mode, timeout_us);
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_subscribe_inputs(PyObject* object, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"mask", "edge", nullptr};
+    unsigned int mask;
+    const char* name = "any";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "I|s", const_cast<char**>(keywords), &mask, &name)) {
+        return nullptr;
+    }
+    Edge edge;
+    if (!strcmp(name, "rising")) {
+        edge = Edge::Rising;
+    } else if (!strcmp(name, "falling")) {
+        edge = Edge::Falling;
+    } else if (!strcmp(name, "any")) {
+        edge = Edge::Any;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "edge must be 'rising', 'falling' or 'any'");
+        return nullptr;
+    }
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    IoSamurai* io = board_io(self);
+    if (!io) {
+        return nullptr;
+    }
+    // All subscriptions of a board share one queue, they are all fed by the same update thread
+    int id = io->subscribe_inputs(static_cast<uint16_t>(mask), edge, board_events(self, true));
+    if (id < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "no free subscriber slot");
+        return nullptr;
+    }
+    return PyLong_FromLong(id);
+}
+
+static PyObject* board_unsubscribe_inputs(PyObject* object, PyObject* arg) {
+    long id = PyLong_AsLong(arg);
+    if (id == -1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return nullptr;
+    }
+    io->unsubscribe_inputs(static_cast<int>(id));
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_poll_events(PyObject* object, PyObject*) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    if (!board_io(self)) {
+        return nullptr;
+    }
+    InputEventQueue* events = board_events(self, false);
+    PyObject* list = PyList_New(0);
+    if (!list || !events) {
+        return list;
+    }
+    InputEvent event;
+    while (events->pop(event)) {
+        PyObject* item = Py_BuildValue("(KLiii)", static_cast<unsigned long long>(event.cycle),
+                                       static_cast<long long>(event.timestamp_ns), event.inputs, event.rising,
+                                       event.falling);
+        if (!item || PyList_Append(list, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(list);
+            return nullptr;
+        }
+        Py_DECREF(item);
+    }
+    return list;
+}
+
+static PyObject* board_stats(PyObject* object, PyObject*) {
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return nullptr;
+    }
+    IoStats stats = io->stats();
+    PyObject* rtt = summary_to_python(stats.rtt);
+    PyObject* jitter = summary_to_python(stats.jitter);
+    PyObject* result = nullptr;
+    if (rtt && jitter) {
+        result = Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:O,s:O}", "cycles",
+                               static_cast<unsigned long long>(stats.cycles), "replies",
+                               static_cast<unsigned long long>(stats.replies), "timeouts",
+                               static_cast<unsigned long long>(stats.timeouts), "checksum_errors",
+                               static_cast<unsigned long long>(stats.checksum_errors), "resyncs",
+                               static_cast<unsigned long long>(stats.resyncs), "short_packets",
+                               static_cast<unsigned long long>(stats.short_packets), "stale_drops",
+                               static_cast<unsigned long long>(stats.stale_drops), "reconnects",
+                               static_cast<unsigned long long>(stats.reconnects), "rtt", rtt, "jitter", jitter);
+    }
+    Py_XDECREF(rtt);
+    Py_XDECREF(jitter);
+    return result;
+}
+
+static PyObject* board_reset_stats(PyObject* object, PyObject*) {
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return nullptr;
+    }
+    io->reset_stats();
+    Py_RETURN_NONE;
+}
+
+static PyObject* board_get_inputs(PyObject* object, void*) {
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    return io ? PyLong_FromLong(io->inputs_mask()) : nullptr;
+}
+
+static PyObject* board_get_outputs(PyObject* object, void*) {
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    return io ? PyLong_FromLong(io->outputs_mask()) : nullptr;
+}
+
+static int board_set_outputs(PyObject* object, PyObject* value, void*) {
+    if (!value) {
+        PyErr_SetString(PyExc_AttributeError, "cannot delete outputs");
+        return -1;
+    }
+    long mask = PyLong_AsLong(value);
+    if (mask == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (mask < 0 || mask > 0xFF) {
+        PyErr_SetString(PyExc_ValueError, "outputs must be 0 to 255");
+        return -1;
+    }
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    if (!io) {
+        return -1;
+    }
+    io->set_outputs_mask(static_cast<uint8_t>(mask));
+    return 0;
+}
+
+static PyObject* board_get_analog(PyObject* object, void*) {
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    return io ? PyFloat_FromDouble(io->get_analog_in()) : nullptr;
+}
+
+static PyObject* board_get_analog_s32(PyObject* object, void*) {
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    return io ? PyLong_FromLong(io->get_analog_in_s32()) : nullptr;
+}
+
+static PyObject* board_get_connected(PyObject* object, void*) {
+    IoSamurai* io = board_io(reinterpret_cast<BoardObject*>(object));
+    return io ? PyBool_FromLong(io->is_connected()) : nullptr;
+}
+
+static PyObject* board_get_cycle_count(PyObject* object, void*) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    IoSamurai* io = board_io(self);
+    if (!io) {
+        return nullptr;
+    }
+    return PyLong_FromUnsignedLongLong(self->group ? self->group->group->cycle_count() : io->cycle_count());
+}
+
+static PyObject* board_get_overrun_count(PyObject* object, void*) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    IoSamurai* io = board_io(self);
+    if (!io) {
+        return nullptr;
+    }
+    return PyLong_FromUnsignedLongLong(self->group ? self->group->group->overrun_count() : io->overrun_count());
+}
+
+static PyObject* board_get_closed(PyObject* object, void*) {
+    BoardObject* self = reinterpret_cast<BoardObject*>(object);
+    return PyBool_FromLong(!self->io || (self->group && !self->group->group));
+}
+
+static PyMethodDef board_methods[] = {
+    {"close", board_close, METH_NOARGS, "close()\nStop the update thread and close the socket."},
+    {"update", board_update, METH_NOARGS,
+     "update()\nOne send and receive cycle, without the GIL (when no update thread is running)."},
+    {"start", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(board_start)),
+     METH_VARARGS | METH_KEYWORDS,
+     "start(period_us=1000, priority=0, cpu=-1, lock_memory=False, prefault_stack=0)\n"
+     "Run the update cycle in a C++ thread on absolute deadlines (priority > 0 selects SCHED_FIFO)."},
+    {"stop", board_stop, METH_NOARGS, "stop()\nStop the update thread."},
+    {"set_output", board_set_output, METH_VARARGS, "set_output(index, value)\nSet output bit 0 to 7."},
+    {"get_input", board_get_input, METH_O, "get_input(index) -> bool\nInput bit 0 to 15 of the last published cycle."},
+    {"snapshot", board_snapshot, METH_NOARGS,
+     "snapshot() -> ProcessImage\nConsistent copy of the last published board state (lock-free)."},
+    {"set_analog_range", board_set_analog_range, METH_VARARGS,
+     "set_analog_range(min_value, max_value)\nScale of the analog input."},
+    {"set_analog_lowpass", board_set_flag<&IoSamurai::set_analog_lowpass>, METH_O,
+     "set_analog_lowpass(enable)\nLow-pass filter of the analog input."},
+    {"set_analog_rounding", board_set_flag<&IoSamurai::set_analog_rounding>, METH_O,
+     "set_analog_rounding(enable)\nRound the scaled analog input."},
+    {"set_oled_off", board_set_flag<&IoSamurai::set_oled_off>, METH_O, "set_oled_off(off)\nSwitch the OLED off."},
+    {"set_round_trip_mode", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(board_set_round_trip_mode)),
+     METH_VARARGS | METH_KEYWORDS,
+     "set_round_trip_mode(mode, timeout_us=500)\n'immediate', 'poll' or 'busy' (set before start())."},
+    {"subscribe_inputs", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(board_subscribe_inputs)),
+     METH_VARARGS | METH_KEYWORDS,
+     "subscribe_inputs(mask, edge='any') -> id\nQueue the changes of the inputs in mask ('rising', 'falling' or "
+     "'any'), read them with poll_events()."},
+    {"unsubscribe_inputs", board_unsubscribe_inputs, METH_O, "unsubscribe_inputs(id)\nRemove a subscription."},
+    {"poll_events", board_poll_events, METH_NOARGS,
+     "poll_events() -> list\nQueued input changes as (cycle, timestamp_ns, inputs, rising, falling) tuples."},
+    {"stats", board_stats, METH_NOARGS, "stats() -> dict\nLink counters and latency percentiles in nanoseconds."},
+    {"reset_stats", board_reset_stats, METH_NOARGS, "reset_stats()\nClear counters and histograms."},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyGetSetDef board_getset[] = {
+    {"inputs", board_get_inputs, nullptr, "Input bits 0-15", nullptr},
+    {"outputs", board_get_outputs, board_set_outputs, "Output bits 0-7", nullptr},
+    {"analog", board_get_analog, nullptr, "Scaled analog input", nullptr},
+    {"analog_s32", board_get_analog_s32, nullptr, "Analog input as integer", nullptr},
+    {"connected", board_get_connected, nullptr, "Last reply arrived with a valid checksum", nullptr},
+    {"cycle_count", board_get_cycle_count, nullptr, "Cycles run by the update thread", nullptr},
+    {"overrun_count", board_get_overrun_count, nullptr, "Missed cycle deadlines", nullptr},
+    {"closed", board_get_closed, nullptr, "The board or its group is closed", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+static PyType_Slot board_slots[] = {
+    {Py_tp_doc, const_cast<char*>("Board(ip_address='192.168.0.177', port=8888)\n"
+                                  "One io-samurai board on its own UDP socket (binds the board port locally).")},
+    {Py_tp_new, reinterpret_cast<void*>(PyType_GenericNew)},
+    {Py_tp_init, reinterpret_cast<void*>(board_init)},
+    {Py_tp_dealloc, reinterpret_cast<void*>(board_dealloc)},
+    {Py_tp_methods, board_methods},
+    {Py_tp_getset, board_getset},
+    {0, nullptr}};
+
+static PyType_Spec board_spec = {"io_samurai_native.Board", sizeof(BoardObject), 0, Py_TPFLAGS_DEFAULT, board_slots};
+
+// ---------------------------------------------------------------------------
+// Group
+// ---------------------------------------------------------------------------
+
+static IoSamuraiGroup* group_io(GroupObject* self) {
+    if (!self->group) {
+        PyErr_SetString(PyExc_ValueError, "group is closed");
+    }
+    return self->group;
+}
+
+static void group_release(GroupObject* self) {
+    IoSamuraiGroup* group = self->group;
+    std::vector<std::unique_ptr<InputEventQueue>>* events = self->events;
+    self->group = nullptr;
+    self->events = nullptr;
+    wait_idle(self->busy);
+    self->running = false;
+    Py_BEGIN_ALLOW_THREADS
+    delete group;
+    delete events;
+    Py_END_ALLOW_THREADS
+}
+
+static int group_init(PyObject* object, PyObject* args, PyObject* kwargs) {
+    GroupObject* self = reinterpret_cast<GroupObject*>(object);
+    static const char* keywords[] = {"local_port", nullptr};
+    int local_port = IOS_DEFAULT_PORT;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", const_cast<char**>(keywords), &local_port)) {
+        return -1;
+    }
+    group_release(self);
+    std::unique_ptr<IoSamuraiGroup> group(new IoSamuraiGroup());
+    if (!group->init(local_port)) {
+        PyErr_Format(PyExc_OSError, "cannot open the UDP socket on port %d (see the log)", local_port);
+        return -1;
+    }
+    self->group = group.release();
+    self->events = new std::vector<std::unique_ptr<InputEventQueue>>();
+    return 0;
+}
+
+static void group_dealloc(PyObject* object) {
+    PyTypeObject* type = Py_TYPE(object);
+    group_release(reinterpret_cast<GroupObject*>(object));
+    type->tp_free(object);
+    Py_DECREF(type);
+}
+
+static PyObject* group_close(PyObject* object, PyObject*) {
+    group_release(reinterpret_cast<GroupObject*>(object));
+    Py_RETURN_NONE;
+}
+
+static PyObject* group_add_board(PyObject* object, PyObject* args, PyObject* kwargs) {
+    GroupObject* self = reinterpret_cast<GroupObject*>(object);
+    static const char* keywords[] = {"ip_address", "port", nullptr};
+    const char* ip_address;
+    int port = 8888;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", const_cast<char**>(keywords), &ip_address, &port)) {
+        return nullptr;
+    }
+    IoSamuraiGroup* group = group_io(self);
+    if (!group) {
+        return nullptr;
+    }
+    if (self->running) {
+        PyErr_SetString(PyExc_RuntimeError, "add all boards before starting the group");
+        return nullptr;
+    }
+    if (!group->add_board(ip_address, port)) {
+        PyErr_Format(PyExc_OSError, "cannot add the board %s:%d (see the log)", ip_address, port);
+        return nullptr;
+    }
+    self->events->emplace_back();
+    return board_wrap(self, static_cast<Py_ssize_t>(group->size() - 1));
+}
+
+static PyObject* group_enable_io_uring(PyObject* object, PyObject* args, PyObject* kwargs) {
+    GroupObject* self = reinterpret_cast<GroupObject*>(object);
+    static const char* keywords[] = {"sqpoll", "sqpoll_cpu", "sqpoll_idle_ms", nullptr};
+    UringConfig config;
+    int sqpoll = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|piI", const_cast<char**>(keywords), &sqpoll, &config.sqpoll_cpu,
+                                     &config.sqpoll_idle_ms)) {
+        return nullptr;
+    }
+    config.sqpoll = sqpoll != 0;
+    IoSamuraiGroup* group = group_io(self);
+    if (!group) {
+        return nullptr;
+    }
+    if (self->running) {
+        PyErr_SetString(PyExc_RuntimeError, "enable io_uring before starting the group");
+        return nullptr;
+    }
+    return PyBool_FromLong(group->enable_io_uring(config));
+}
+
+static PyObject* group_update(PyObject* object, PyObject*) {
+    GroupObject* self = reinterpret_cast<GroupObject*>(object);
+    IoSamuraiGroup* group = group_io(self);
+    if (!group) {
+        return nullptr;
+    }
+    if (self->running) {
+        PyErr_SetString(PyExc_RuntimeError, "group is updated by its update thread");
+        return nullptr;
+    }
+    self->busy++;
+    Py_BEGIN_ALLOW_THREADS
+    group->update();
+    Py_END_ALLOW_THREADS
+    self->busy--;
+    Py_RETURN_NONE;
+}
+
+static PyObject* group_start(PyObject* object, PyObject* args, PyObject* kwargs) {
+    GroupObject* self = reinterpret_cast<GroupObject*>(object);
+    CyclicConfig config;
+    if (!parse_cyclic_config(args, kwargs, config)) {
+        return nullptr;
+    }
+    IoSamuraiGroup* group = group_io(self);
+    if (!group) {
+        return nullptr;
+    }
+    bool started;
+    self->busy++;
+    Py_BEGIN_ALLOW_THREADS
+    started = group->start_periodic_update(config);
+    Py_END_ALLOW_THREADS
+    self->busy--;
+    if (!started) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot start the update thread (see the log)");
+        return nullptr;
+    }
+    self->running = true;
+    Py_RETURN_NONE;
+}
+
+static PyObject* group_stop(PyObject* object, PyObject*) {
+    GroupObject* self = reinterpret_cast<GroupObject*>(object);
+    IoSamuraiGroup* group = group_io(self);
+    if (!group) {
+        return nullptr;
+    }
+    self->busy++;
+    Py_BEGIN_ALLOW_THREADS
+    group->stop_periodic_update();
+    Py_END_ALLOW_THREADS
+    self->busy--;
+    self->running = false;
+    Py_RETURN_NONE;
+}
+
+static PyObject* group_snapshot(PyObject* object, PyObject*) {
+    IoSamuraiGroup* group = group_io(reinterpret_cast<GroupObject*>(object));
+    if (!group) {
+        return nullptr;
+    }
+    PyObject* list = PyList_New(static_cast<Py_ssize_t>(group->size()));
+    if (!list) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < group->size(); i++) {
+        PyObject* image = image_to_python(group->board(i).snapshot());
+        if (!image) {
+            Py_DECREF(list);
+            return nullptr;
+        }
+        PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), image);
+    }
+    return list;
+}
+
+static PyObject* group_read(PyObject* object, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"inputs", "analog", "connected", nullptr};
+    PyObject* objects[3] = {Py_None, Py_None, Py_None};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OOO", const_cast<char**>(keywords), &objects[0], &objects[1],
+                                     &objects[2])) {
+        return nullptr;
+    }
+    IoSamuraiGroup* group = group_io(reinterpret_cast<GroupObject*>(object));
+    if (!group) {
+        return nullptr;
+    }
+    const Py_ssize_t count = static_cast<Py_ssize_t>(group->size());
+    const char* formats[3] = {"Hi", "fd", "?Bb"};
+    Py_buffer views[3];
+    bool used[3] = {false, false, false};
+    for (int i = 0; i < 3; i++) {
+        if (objects[i] == Py_None) {
+            continue;
+        }
+        if (!get_array(objects[i], formats[i], count, &views[i], keywords[i])) {
+            for (int j = 0; j < i; j++) {
+                if (used[j]) {
+                    PyBuffer_Release(&views[j]);
+                }
+            }
+            return nullptr;
+        }
+        used[i] = true;
+    }
+
+    long connected_count = 0;
+    for (Py_ssize_t i = 0; i < count; i++) {
+        ProcessImage image = group->board(static_cast<size_t>(i)).snapshot();
+        connected_count += image.connected;
+        if (used[0]) {
+            if (views[0].itemsize == 2) {
+                static_cast<uint16_t*>(views[0].buf)[i] = image.inputs;
+            } else {
+                static_cast<int32_t*>(views[0].buf)[i] = image.inputs;
+            }
+        }
+        if (used[1]) {
+            if (views[1].itemsize == 4) {
+                static_cast<float*>(views[1].buf)[i] = image.analog_in;
+            } else {
+                static_cast<double*>(views[1].buf)[i] = image.analog_in;
+            }
+        }
+        if (used[2]) {
+            static_cast<uint8_t*>(views[2].buf)[i] = image.connected;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (used[i]) {
+            PyBuffer_Release(&views[i]);
+        }
+    }
+    return PyLong_FromLong(connected_count);
+}
+
+static PyObject* group_jitter(PyObject* object, PyObject*) {
+    IoSamuraiGroup* group = group_io(reinterpret_cast<GroupObject*>(object));
+    return group ? summary_to_python(group->jitter()) : nullptr;
+}
+
+static PyObject* group_get_cycle_count(PyObject* object, void*) {
+    IoSamuraiGroup* group = group_io(reinterpret_cast<GroupObject*>(object));
+    return group ? PyLong_FromUnsignedLongLong(group->cycle_count()) : nullptr;
+}
+
+static PyObject* group_get_overrun_count(PyObject* object, void*) {
+    IoSamuraiGroup* group = group_io(reinterpret_cast<GroupObject*>(object));
+    return group ? PyLong_FromUnsignedLongLong(group->overrun_count()) : nullptr;
+}
+
+static Py_ssize_t group_length(PyObject* object) {
+    IoSamuraiGroup* group = group_io(reinterpret_cast<GroupObject*>(object));
+    return group ? static_cast<Py_ssize_t>(group->size()) : -1;
+}
+
+static PyObject* group_item(PyObject* object, Py_ssize_t index) {
+    GroupObject* self = reinterpret_cast<GroupObject*>(object);
+    IoSamuraiGroup* group = group_io(self);
+    if (!group) {
+        return nullptr;
+    }
+    if (index < 0 || index >= static_cast<Py_ssize_t>(group->size())) {
+        PyErr_SetString(PyExc_IndexError, "board index out of range");
+        return nullptr;
+    }
+    return board_wrap(self, index);
+}
+
+static PyMethodDef group_methods[] = {
+    {"close", group_close, METH_NOARGS, "close()\nStop the update thread and close the socket (and all its boards)."},
+    {"add_board", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(group_add_board)),
+     METH_VARARGS | METH_KEYWORDS, "add_board(ip_address, port=8888) -> Board\nAdd a board before starting the group."},
+    {"enable_io_uring", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(group_enable_io_uring)),
+     METH_VARARGS | METH_KEYWORDS,
+     "enable_io_uring(sqpoll=False, sqpoll_cpu=-1, sqpoll_idle_ms=1000) -> bool\n"
+     "Use io_uring instead of sendmmsg()/recvmmsg(), False if the kernel does not support it."},
+    {"update", group_update, METH_NOARGS,
+     "update()\nOne cycle for all boards, without the GIL (when no update thread is running)."},
+    {"start", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(group_start)),
+     METH_VARARGS | METH_KEYWORDS,
+     "start(period_us=1000, priority=0, cpu=-1, lock_memory=False, prefault_stack=0)\n"
+     "Run the cycle of all boards in a C++ thread on absolute deadlines."},
+    {"stop", group_stop, METH_NOARGS, "stop()\nStop the update thread."},
+    {"snapshot", group_snapshot, METH_NOARGS, "snapshot() -> list\nProcessImage of every board."},
+    {"read", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(group_read)),
+     METH_VARARGS | METH_KEYWORDS,
+     "read(inputs=None, analog=None, connected=None) -> int\n"
+     "Copy the last published state of every board into arrays (NumPy, array.array, any writable buffer):\n"
+     "inputs uint16/int32, analog float32/float64, connected bool/uint8. Returns the number of connected boards."},
+    {"jitter", group_jitter, METH_NOARGS, "jitter() -> dict\nWake-up latency percentiles of the update thread."},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyGetSetDef group_getset[] = {
+    {"cycle_count", group_get_cycle_count, nullptr, "Cycles run by the update thread", nullptr},
+    {"overrun_count", group_get_overrun_count, nullptr, "Missed cycle deadlines", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+static PyType_Slot group_slots[] = {
+    {Py_tp_doc, const_cast<char*>("Group(local_port=8888)\nAny number of boards on one UDP socket, one update thread.")},
+    {Py_tp_new, reinterpret_cast<void*>(PyType_GenericNew)},
+    {Py_tp_init, reinterpret_cast<void*>(group_init)},
+    {Py_tp_dealloc, reinterpret_cast<void*>(group_dealloc)},
+    {Py_tp_methods, group_methods},
+    {Py_tp_getset, group_getset},
+    {Py_sq_length, reinterpret_cast<void*>(group_length)},
+    {Py_sq_item, reinterpret_cast<void*>(group_item)},
+    {0, nullptr}};
+
+static PyType_Spec group_spec = {"io_samurai_native.Group", sizeof(GroupObject), 0, Py_TPFLAGS_DEFAULT, group_slots};
+
+// ---------------------------------------------------------------------------
+// Module
+// ---------------------------------------------------------------------------
+
+static PyObject* module_flush_log(PyObject*, PyObject*) {
+    Py_BEGIN_ALLOW_THREADS
+    EventLog::instance().flush();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef module_methods[] = {
+    {"flush_log", module_flush_log, METH_NOARGS, "flush_log()\nWait until the queued log entries are written."},
+    {nullptr, nullptr, 0, nullptr}};
+
+static PyModuleDef module_def = {PyModuleDef_HEAD_INIT,
+                                 "io_samurai_native",
+                                 "io-samurai boards driven by the C++ client, with the I/O thread outside the GIL.",
+                                 -1,
+                                 module_methods,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr};
+
+PyMODINIT_FUNC PyInit_io_samurai_native(void) {
+    PyObject* module = PyModule_Create(&module_def);
+    if (!module) {
+        return nullptr;
+    }
+    board_type = reinterpret_cast<PyTypeObject*>(PyType_FromSpec(&board_spec));
+    group_type = reinterpret_cast<PyTypeObject*>(PyType_FromSpec(&group_spec));
+    image_type = PyStructSequence_NewType(&image_desc);
+    if (!board_type || !group_type || !image_type ||
+        PyModule_AddObjectRef(module, "Board", reinterpret_cast<PyObject*>(board_type)) < 0 ||
+        PyModule_AddObjectRef(module, "Group", reinterpret_cast<PyObject*>(group_type)) < 0 ||
+        PyModule_AddObjectRef(module, "ProcessImage", reinterpret_cast<PyObject*>(image_type)) < 0) {
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
@@ -0,0 +1,98 @@
+# Cost of cyclic board I/O for the Python thread: the pure Python io_samurai class
+# against the native module, N boards at a fixed period.
+#   cycles/s       completed cycles per second (pure Python: one update() of every board)
+#   replies/s      valid replies per second and board
+#   python us      CPU time of the Python thread per cycle
+#   io us          CPU time of the C++ update thread per cycle (native only)
+# Board i is expected at address:port+i, for example in the namespace of
+# ../utility/virtual_board_netns.sh (up 1, run 1 -n 10 -I) with the default address.
+# Usage: python3 native_benchmark.py [--address A] [--port P] [--boards N] [--seconds S] [--period-us N]
+
+import argparse
+import array
+import time
+
+import io_samurai_native
+from io_samurai import io_samurai
+
+
+def pure_python(address, port, boards, seconds, period_us):
+    """What update() does for every board, from the Python loop, paced on absolute deadlines."""
+    samurais = [io_samurai(pico_ip=address, port=port + i, timeout=0.01) for i in range(boards)]
+    period = period_us / 1e6
+    cycles = 0
+    replies = [0] * boards
+    cpu = time.thread_time()
+    start = next_cycle = time.monotonic()
+    while next_cycle - start < seconds:
+        for i, samurai in enumerate(samurais):
+            samurai.send_request()
+            inputs, _ = samurai.receive_inputs()
+            if inputs is not None:
+                replies[i] += 1
+        cycles += 1
+        next_cycle += period
+        delay = next_cycle - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+    elapsed = time.monotonic() - start
+    cpu = time.thread_time() - cpu
+    for samurai in samurais:
+        samurai.close()
+    return cycles / elapsed, min(replies) / elapsed, cpu / cycles * 1e6, None
+
+
+def native_group(address, port, boards, seconds, period_us):
+    """All boards on the group's update thread, Python copies every board's state once per period."""
+    group = io_samurai_native.Group()
+    for i in range(boards):
+        group.add_board(address, port + i)
+    inputs = array.array('H', bytes(2 * boards))
+    analog = array.array('f', bytes(4 * boards))
+    group.start(period_us=period_us)
+    time.sleep(0.1)
+    for board in group:
+        board.reset_stats()
+    period = period_us / 1e6
+    first_cycle = group.cycle_count
+    cpu = time.thread_time()
+    process_cpu = time.process_time()
+    start = next_cycle = time.monotonic()
+    while next_cycle - start < seconds:
+        group.read(inputs, analog)
+        next_cycle += period
+        delay = next_cycle - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+    elapsed = time.monotonic() - start
+    cpu = time.thread_time() - cpu
+    process_cpu = time.process_time() - process_cpu
+    cycles = group.cycle_count - first_cycle
+    group.stop()
+    replies = min(board.stats()['replies'] for board in group)
+    group.close()
+    return cycles / elapsed, replies / elapsed, cpu / cycles * 1e6, (process_cpu - cpu) / cycles * 1e6
+
+
+def main():
+    parser = argparse.ArgumentParser(description="io_samurai pure Python against the native module")
+    parser.add_argument('--address', default='10.77.1.1')
+    parser.add_argument('--port', type=int, default=8888)
+    parser.add_argument('--boards', type=int, default=10)
+    parser.add_argument('--seconds', type=float, default=3.0)
+    parser.add_argument('--period-us', type=int, default=1000)
+    args = parser.parse_args()
+
+    print(f"{args.boards} boards, period {args.period_us} us")
+    print(f"{'path':8}{'cycles/s':>12}{'replies/s':>12}{'python us':>12}{'io us':>10}")
+    for name, run in (("python", pure_python), ("native", native_group)):
+        cycles, replies, python_us, io_us = run(args.address, args.port, args.boards, args.seconds, args.period_us)
+        io = f"{io_us:10.1f}" if io_us is not None else f"{'-':>10}"
+        print(f"{name:8}{cycles:12.0f}{replies:12.0f}{python_us:12.1f}{io}")
+        # Let the boards' failsafe timeout reset their checksum chains
+        time.sleep(0.25)
+    io_samurai_native.flush_log()
+
+
+if __name__ == '__main__':
+    main()
@@ -8,12 +8,12 @@
 
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include "jump_table.h"
+#include "io_samurai_proto.h"
 #include <arpa/inet.h>
 
 #define NUM_CYCLES 100000
-#define SEND_PACKET_SIZE 3
-#define RECV_PACKET_SIZE 5
+#define SEND_PACKET_SIZE IOS_TX_FRAME_SIZE
+#define RECV_PACKET_SIZE IOS_RX_FRAME_SIZE
 #define TIMEOUT_SEC 2  // Increased timeout
 
 static int sockfd;
@@ -21,7 +21,8 @@ static struct sockaddr_in local_addr, remote_addr;
 char *ip_addr = "192.168.0.178";
 uint16_t port = 8888;
 uint8_t counter = 0;
-char send_buffer[SEND_PACKET_SIZE] = {0x00,};
+ios_link_t board_link;
+ios_tx_frame_t send_frame;
 
 long long get_time_ms() {
     struct timeval tv;
@@ -44,13 +45,9 @@ static void init_socket(void) {
     inet_pton(AF_INET, ip_addr, &remote_addr.sin_addr);
 }
 
-void jump_table_checksum_in() {
-    checksum_index_in += (uint8_t)(send_buffer[0] + send_buffer[1] + 1);
-    send_buffer[2] = jump_table[checksum_index_in];
-}
-
 int main() {
-    char recv_buffer[RECV_PACKET_SIZE];
+    ios_rx_frame_t recv_frame;
+    int checksum_errors = 0;
     long long start_time, end_time, elapsed_time;
     int cycles_completed = 0;
     long long total_latency = 0;
@@ -62,6 +59,7 @@ int main() {
     }
 
     init_socket();
+    ios_link_reset(&board_link);
     printf("UDP socket created (%s:%d), connected to target.\n", ip_addr, port);
 
     // Benchmark loop
@@ -74,13 +72,11 @@ int main() {
         counter ++;
         // DO NOT MODIFY THE DATA IF THE CARD IS CONNECTED TO YOUR MACHINE
         // DO NOT MODIFY THE DATA IF THE CARD IS CONNECTED TO YOUR MACHINE
-        send_buffer[0] = 0;
-        send_buffer[1] = 0;
+        ios_encode_tx(&board_link.tx, &send_frame, 0, 0);
         // DO NOT MODIFY THE DATA IF THE CARD IS CONNECTED TO YOUR MACHINE
         // DO NOT MODIFY THE DATA IF THE CARD IS CONNECTED TO YOUR MACHINE
-        jump_table_checksum_in();
         // Send packet
-        if (sendto(sockfd, send_buffer, SEND_PACKET_SIZE, 0, (struct sockaddr*)&remote_addr, sizeof(remote_addr)) < 0) {
+        if (sendto(sockfd, &send_frame, SEND_PACKET_SIZE, 0, (struct sockaddr*)&remote_addr, sizeof(remote_addr)) < 0) {
             perror("Send failed");
             break;
         }
@@ -88,7 +84,10 @@ int main() {
         // Receive response
         socklen_t addr_len = sizeof(ip_addr);
         int recv_len = -1;
-        while (recv_len < 0) {recv_len = recvfrom(sockfd, recv_buffer, RECV_PACKET_SIZE, 0, NULL, NULL);}
+        while (recv_len < 0) {recv_len = recvfrom(sockfd, &recv_frame, RECV_PACKET_SIZE, 0, NULL, NULL);}
+        if (recv_len != RECV_PACKET_SIZE || !ios_verify_rx(&board_link.rx, &recv_frame)) {
+            checksum_errors++;
+        }
         long long cycle_end = get_time_ms();
         total_latency += (cycle_end - cycle_start);
         cycles_completed++;
@@ -101,6 +100,7 @@ int main() {
     printf("\nBenchmark results:\n");
     printf("Cycles attempted: %d\n", NUM_CYCLES);
     printf("Cycles completed: %d\n", cycles_completed);
+    printf("Checksum errors: %d\n", checksum_errors);
     printf("Total time: %lld ms\n", elapsed_time);
     printf("Average cycle time (write + read): %.2f ms\n", (double)total_latency / cycles_completed);
     printf("Throughput: %.2f cycles/s\n", (cycles_completed / (elapsed_time / 1000.0)));
@@ -1 +1,2 @@
 gcc -o benchmark_udp benchmark.c -lpthread -O3
+gcc -o virtual_board virtual_board.c -O2
@@ -0,0 +1,486 @@
+/*
+ * virtual_board - io-samurai board emulator for testing without hardware
+ *
+ * Emulates the board side of the UDP protocol as implemented in handle_udp()
+ * of the firmware: output frame checksum validation with the jump table
+ * (outputs off until the chain relocks), reply generation with the input checksum chain,
+ * the TIMEOUT_US failsafe that resets both chains and clears the outputs,
+ * the status bits in byte 3 of the reply, and the reply address latch of _sendto():
+ * the first reply goes to the sender of its request and every later one to that
+ * same address and port, whoever sent the request, until the emulator restarts.
+ * A host that changes its source port is therefore not answered, as on hardware.
+ *
+ * Every virtual board has its own UDP socket on consecutive IP addresses
+ * starting at the base address (127.0.0.0/8 works on loopback, other ranges
+ * need the addresses on an interface, see virtual_board_netns.sh), or with -I
+ * on consecutive ports of the base address.
+ * One thread serves all boards with epoll, so hundreds of boards are fine.
+ *
+ * Usage: virtual_board [options]
+ *   -n count     number of boards (default 1)
+ *   -a address   IP address of the first board (default 127.0.0.2)
+ *   -p port      UDP port (default 8888)
+ *   -I           consecutive ports on the first address instead of consecutive addresses
+ *   -d delay     reply delay in microseconds (default 0)
+ *   -j jitter    additional random reply delay 0..jitter microseconds (default 0)
+ *   -l percent   percentage of requests left unanswered (default 0)
+ *   -T percent   percentage of requests lost before the board sees them, puts the output chain out of step (default 0)
+ *   -R percent   percentage of replies lost after sealing, puts the host's input chain out of step (default 0)
+ *   -i pattern   input pattern: const, counter, walk, random, echo (default const)
+ *   -v value     input value for the const pattern (default 0x0000)
+ *   -P period    pattern step period in milliseconds (default 100)
+ *   -A adc       ADC value 0-4095, or -1 for a ramp (default 2048)
+ *   -s status    status bits in byte 3 (default 0xe0, all peripherals present)
+ *   -t timeout   failsafe timeout in microseconds (default 100000, as TIMEOUT_US)
+ *   -r seconds   print statistics every n seconds (default 0, only at exit)
+ *   -S           reply to the sender of each request instead of latching the first one (not like the firmware)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "io_samurai_proto.h"
+
+#define MAX_BOARDS 4096
+#define MAX_PENDING 65536
+#define MAX_EVENTS 256
+
+enum input_pattern {
+    PATTERN_CONST,
+    PATTERN_COUNTER,
+    PATTERN_WALK,
+    PATTERN_RANDOM,
+    PATTERN_ECHO
+};
+
+typedef struct {
+    int sockfd;
+    struct sockaddr_in addr;
+    struct sockaddr_in host;        // Reply address latched by the first reply (DIPR/DPORT)
+    int host_latched;
+    ios_link_t link;                // Checksum chains, as in the firmware
+    uint8_t checksum_error;         // Until the chain relocks or the timeout, like the firmware
+    uint8_t timeout_error;
+    uint8_t outputs;                // What the MCP23008 would drive
+    uint8_t flags;                  // Byte 1 of the last output frame
+    long long last_packet_us;
+    long long last_due_us;          // Replies leave in request order
+    unsigned long long requests;
+    unsigned long long replies;
+    unsigned long long checksum_errors;
+    unsigned long long resyncs;
+    unsigned long long timeouts;
+    unsigned long long dropped;
+    unsigned long long foreign;     // Requests from another address than the latched one
+} vboard_t;
+
+typedef struct {
+    long long due_us;
+    int board;
+    struct sockaddr_in dest;
+    ios_rx_frame_t frame;
+} pending_reply_t;
+
+static vboard_t *boards;
+static int board_count = 1;
+static pending_reply_t *pending;       // Min-heap on due_us
+static int pending_count = 0;
+static volatile sig_atomic_t running = 1;
+
+static char *base_ip = "127.0.0.2";
+static uint16_t port = 8888;
+static int port_per_board = 0;
+static long long delay_us = 0;
+static long long jitter_us = 0;
+static int loss_percent = 0;
+static int request_loss_percent = 0;
+static int reply_loss_percent = 0;
+static enum input_pattern pattern = PATTERN_CONST;
+static uint16_t const_inputs = 0;
+static long long pattern_period_us = 100000;
+static int adc_value = 2048;
+static uint8_t status_bits = 0xe0;
+static long long timeout_us = 100000;
+static int report_seconds = 0;
+static int reply_to_sender = 0;
+static uint32_t rng_state = 0x12345678;
+
+static long long get_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000LL;
+}
+
+static uint32_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void sigint_handler(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-n count] [-a address] [-p port] [-I] [-d delay_us] [-j jitter_us] [-l loss_percent]\n"
+                    "          [-T request_loss_percent] [-R reply_loss_percent] [-i const|counter|walk|random|echo] [-v inputs] [-P period_ms] [-A adc|-1]\n"
+                    "          [-s status] [-t timeout_us] [-r report_seconds] [-S]\n", name);
+}
+
+static uint16_t board_inputs(const vboard_t *b, int index, long long now_us) {
+    long long step = now_us / pattern_period_us;
+    switch (pattern) {
+    case PATTERN_COUNTER:
+        return (uint16_t)(step + index);
+    case PATTERN_WALK:
+        return (uint16_t)(1u << ((step + index) % 16));
+    case PATTERN_RANDOM: {
+        // Same value for the whole step, different per board
+        uint32_t x = (uint32_t)step * 2654435761u ^ (uint32_t)index * 40503u ^ rng_state;
+        x ^= x >> 15;
+        x *= 0x2c1b3c6du;
+        x ^= x >> 12;
+        return (uint16_t)x;
+    }
+    case PATTERN_ECHO:
+        return (uint16_t)(b->outputs | b->outputs << 8);
+    case PATTERN_CONST:
+    default:
+        return const_inputs;
+    }
+}
+
+static uint16_t board_adc(long long now_us) {
+    if (adc_value >= 0) {
+        return (uint16_t)adc_value;
+    }
+    return (uint16_t)((now_us / 1000) % 4096);
+}
+
+static void heap_push(const pending_reply_t *reply) {
+    int i = pending_count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (pending[parent].due_us <= reply->due_us) {
+            break;
+        }
+        pending[i] = pending[parent];
+        i = parent;
+    }
+    pending[i] = *reply;
+}
+
+static void heap_pop(void) {
+    pending_reply_t last = pending[--pending_count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= pending_count) {
+            break;
+        }
+        if (child + 1 < pending_count && pending[child + 1].due_us < pending[child].due_us) {
+            child++;
+        }
+        if (last.due_us <= pending[child].due_us) {
+            break;
+        }
+        pending[i] = pending[child];
+        i = child;
+    }
+    if (pending_count > 0) {
+        pending[i] = last;
+    }
+}
+
+static void send_reply(int index, const struct sockaddr_in *dest, const ios_rx_frame_t *frame) {
+    vboard_t *b = &boards[index];
+    if (sendto(b->sockfd, frame, IOS_RX_FRAME_SIZE, 0, (const struct sockaddr *)dest, sizeof(*dest)) < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr, "board %d: send failed: %s\n", index, strerror(errno));
+        }
+        return;
+    }
+    b->replies++;
+}
+
+static void flush_due_replies(long long now_us) {
+    while (pending_count > 0 && pending[0].due_us <= now_us) {
+        pending_reply_t reply = pending[0];
+        heap_pop();
+        send_reply(reply.board, &reply.dest, &reply.frame);
+    }
+}
+
+static void handle_packet(int index, long long now_us) {
+    vboard_t *b = &boards[index];
+    uint8_t rx_buffer[16];
+    struct sockaddr_in src;
+    socklen_t src_len = sizeof(src);
+
+    int len = recvfrom(b->sockfd, rx_buffer, sizeof(rx_buffer), 0, (struct sockaddr *)&src, &src_len);
+    if (len < 0) {
+        return;
+    }
+    if (request_loss_percent > 0 && (int)(next_random() % 100) < request_loss_percent) {
+        b->dropped++;
+        return;
+    }
+    b->requests++;
+    if (!reply_to_sender && b->host_latched &&
+        (src.sin_addr.s_addr != b->host.sin_addr.s_addr || src.sin_port != b->host.sin_port)) {
+        b->foreign++;
+    }
+
+    // Failsafe: after TIMEOUT_US without a frame both chains restart and the error clears
+    if (b->last_packet_us != 0 && now_us - b->last_packet_us > timeout_us) {
+        ios_link_reset(&b->link);
+        b->checksum_error = 0;
+        b->timeout_error = 1;
+        b->timeouts++;
+    }
+
+    // jump_table_checksum(): a mismatch resynchronizes the chain, the next good frame clears the error
+    if (len > 0) {
+        int check = ios_check_tx(&b->link.tx, (const ios_tx_frame_t *)rx_buffer);
+        if (check == IOS_CHAIN_MISMATCH) {
+            b->checksum_errors++;
+        } else if (check == IOS_CHAIN_RELOCKED) {
+            b->resyncs++;
+        }
+        b->checksum_error = check == IOS_CHAIN_MISMATCH;
+        b->last_packet_us = now_us;
+        b->timeout_error = 0;
+        b->flags = rx_buffer[1];
+        b->outputs = b->checksum_error ? 0x00 : rx_buffer[0];
+    }
+
+    if (loss_percent > 0 && (int)(next_random() % 100) < loss_percent) {
+        b->dropped++;
+        return;
+    }
+
+    // Reply with the current inputs, ADC and status, then jump_table_checksum_in()
+    pending_reply_t reply;
+    ios_encode_rx(&b->link.rx, &reply.frame, board_inputs(b, index, now_us), board_adc(now_us), status_bits);
+
+    // _sendto() sets the destination on its first call only
+    if (reply_to_sender || !b->host_latched) {
+        b->host = src;
+        b->host_latched = 1;
+    }
+    if (reply_loss_percent > 0 && (int)(next_random() % 100) < reply_loss_percent) {
+        b->dropped++;
+        return;
+    }
+
+    long long due = now_us + delay_us;
+    if (jitter_us > 0) {
+        due += next_random() % (uint32_t)(jitter_us + 1);
+    }
+    if (due < b->last_due_us) {
+        due = b->last_due_us;
+    }
+    b->last_due_us = due;
+
+    if (due <= now_us) {
+        send_reply(index, &b->host, &reply.frame);
+    } else if (pending_count < MAX_PENDING) {
+        reply.due_us = due;
+        reply.board = index;
+        reply.dest = b->host;
+        heap_push(&reply);
+    } else {
+        b->dropped++;
+    }
+}
+
+static void print_stats(void) {
+    unsigned long long requests = 0, replies = 0, checksum_errors = 0, resyncs = 0, timeouts = 0, dropped = 0;
+    unsigned long long foreign = 0;
+    int connected = 0;
+    long long now_us = get_time_us();
+    for (int i = 0; i < board_count; i++) {
+        vboard_t *b = &boards[i];
+        requests += b->requests;
+        replies += b->replies;
+        checksum_errors += b->checksum_errors;
+        resyncs += b->resyncs;
+        timeouts += b->timeouts;
+        dropped += b->dropped;
+        foreign += b->foreign;
+        if (b->last_packet_us != 0 && now_us - b->last_packet_us <= timeout_us && !b->checksum_error) {
+            connected++;
+        }
+    }
+    printf("boards: %d connected: %d requests: %llu replies: %llu checksum errors: %llu resyncs: %llu timeouts: %llu "
+           "dropped: %llu foreign: %llu\n", board_count, connected, requests, replies, checksum_errors, resyncs, timeouts,
+           dropped, foreign);
+    fflush(stdout);
+}
+
+static int init_boards(void) {
+    struct in_addr base;
+    if (inet_pton(AF_INET, base_ip, &base) <= 0) {
+        fprintf(stderr, "invalid IP address: %s\n", base_ip);
+        return -1;
+    }
+
+    for (int i = 0; i < board_count; i++) {
+        vboard_t *b = &boards[i];
+        memset(b, 0, sizeof(*b));
+        ios_link_reset(&b->link);
+        b->timeout_error = 1;
+        b->addr.sin_family = AF_INET;
+        if (port_per_board) {
+            b->addr.sin_port = htons((uint16_t)(port + i));
+            b->addr.sin_addr = base;
+        } else {
+            b->addr.sin_port = htons(port);
+            b->addr.sin_addr.s_addr = htonl(ntohl(base.s_addr) + (uint32_t)i);
+        }
+
+        b->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (b->sockfd < 0) {
+            perror("Socket creation failed");
+            return -1;
+        }
+        int one = 1;
+        setsockopt(b->sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(b->sockfd, (struct sockaddr *)&b->addr, sizeof(b->addr)) < 0) {
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &b->addr.sin_addr, ip, sizeof(ip));
+            fprintf(stderr, "board %d: bind to %s:%d failed: %s\n", i, ip, ntohs(b->addr.sin_port), strerror(errno));
+            return -1;
+        }
+        int flags = fcntl(b->sockfd, F_GETFL, 0);
+        fcntl(b->sockfd, F_SETFL, flags | O_NONBLOCK);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:a:p:Id:j:l:T:R:i:v:P:A:s:t:r:Sh")) != -1) {
+        switch (opt) {
+        case 'n': board_count = atoi(optarg); break;
+        case 'a': base_ip = optarg; break;
+        case 'p': port = (uint16_t)atoi(optarg); break;
+        case 'I': port_per_board = 1; break;
+        case 'd': delay_us = atoll(optarg); break;
+        case 'j': jitter_us = atoll(optarg); break;
+        case 'l': loss_percent = atoi(optarg); break;
+        case 'T': request_loss_percent = atoi(optarg); break;
+        case 'R': reply_loss_percent = atoi(optarg); break;
+        case 'v': const_inputs = (uint16_t)strtol(optarg, NULL, 0); break;
+        case 'P': pattern_period_us = atoll(optarg) * 1000; break;
+        case 'A': adc_value = atoi(optarg); break;
+        case 's': status_bits = (uint8_t)(strtol(optarg, NULL, 0) & IOS_STATUS_MASK); break;
+        case 't': timeout_us = atoll(optarg); break;
+        case 'r': report_seconds = atoi(optarg); break;
+        case 'S': reply_to_sender = 1; break;
+        case 'i':
+            if (!strcmp(optarg, "const")) pattern = PATTERN_CONST;
+            else if (!strcmp(optarg, "counter")) pattern = PATTERN_COUNTER;
+            else if (!strcmp(optarg, "walk")) pattern = PATTERN_WALK;
+            else if (!strcmp(optarg, "random")) pattern = PATTERN_RANDOM;
+            else if (!strcmp(optarg, "echo")) pattern = PATTERN_ECHO;
+            else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (board_count < 1 || board_count > MAX_BOARDS || pattern_period_us <= 0 || adc_value > 4095 ||
+        delay_us < 0 || jitter_us < 0 || loss_percent < 0 || loss_percent > 100 ||
+        request_loss_percent < 0 || request_loss_percent > 100 || reply_loss_percent < 0 || reply_loss_percent > 100) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    boards = calloc(board_count, sizeof(vboard_t));
+    pending = calloc(MAX_PENDING, sizeof(pending_reply_t));
+    if (!boards || !pending) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    rng_state ^= (uint32_t)get_time_us();
+    if (init_boards() < 0) {
+        return EXIT_FAILURE;
+    }
+
+    int epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < board_count; i++) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)i;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, boards[i].sockfd, &ev) < 0) {
+            perror("epoll_ctl");
+            return EXIT_FAILURE;
+        }
+    }
+
+    signal(SIGINT, sigint_handler);
+    signal(SIGTERM, sigint_handler);
+    printf("%d virtual board(s) from %s:%d, delay %lld us, jitter %lld us, loss %d%%, timeout %lld us, replies to %s\n",
+           board_count, base_ip, port, delay_us, jitter_us, loss_percent, timeout_us,
+           reply_to_sender ? "each sender" : "the first host");
+    fflush(stdout);
+
+    struct epoll_event events[MAX_EVENTS];
+    long long next_report_us = get_time_us() + report_seconds * 1000000LL;
+    while (running) {
+        long long now_us = get_time_us();
+        int wait_ms = 100;
+        if (pending_count > 0) {
+            long long until = pending[0].due_us - now_us;
+            // epoll_wait has millisecond resolution, spin for short delays
+            wait_ms = until <= 0 ? 0 : (until < 1000 ? 0 : (int)(until / 1000));
+        }
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, wait_ms);
+        now_us = get_time_us();
+        for (int i = 0; i < n; i++) {
+            int index = (int)events[i].data.u32;
+            // Drain the socket, several requests may be queued
+            unsigned long long before;
+            do {
+                before = boards[index].requests;
+                handle_packet(index, now_us);
+            } while (boards[index].requests != before);
+        }
+        flush_due_replies(now_us);
+
+        if (report_seconds > 0 && now_us >= next_report_us) {
+            print_stats();
+            next_report_us = now_us + report_seconds * 1000000LL;
+        }
+    }
+
+    print_stats();
+    for (int i = 0; i < board_count; i++) {
+        close(boards[i].sockfd);
+    }
+    close(epfd);
+    free(pending);
+    free(boards);
+    return 0;
+}
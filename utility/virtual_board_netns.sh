@@ -0,0 +1,48 @@
+#!/bin/bash
+# Run virtual boards in their own network namespace behind a veth pair, so
+# clients that bind the board port on the host (HAL driver, IoSamurai, benchmark)
+# can talk to them like to real hardware. Needs root.
+#
+#   ./virtual_board_netns.sh up [count]          create namespace, veth and board addresses
+#   ./virtual_board_netns.sh run [count] [opts]  start virtual_board inside (extra options are passed on)
+#   ./virtual_board_netns.sh down                remove everything
+#
+# The host side is 10.77.0.1/16, the boards are 10.77.1.1, 10.77.1.2, ...
+
+NS=iosamurai
+HOST_IF=vb-host
+NS_IF=vb-board
+COUNT=${2:-1}
+
+board_ip() {
+    local n=$((257 + $1))
+    echo "10.77.$((n / 256)).$((n % 256))"
+}
+
+case "$1" in
+up)
+    ip netns add $NS
+    ip link add $HOST_IF type veth peer name $NS_IF
+    ip link set $NS_IF netns $NS
+    ip addr add 10.77.0.1/16 dev $HOST_IF
+    ip link set $HOST_IF up
+    ip netns exec $NS ip link set lo up
+    ip netns exec $NS ip link set $NS_IF up
+    for ((i = 0; i < COUNT; i++)); do
+        ip netns exec $NS ip addr add "$(board_ip $i)/16" dev $NS_IF
+    done
+    echo "boards: $(board_ip 0) .. $(board_ip $((COUNT - 1))) port 8888"
+    ;;
+run)
+    shift 2
+    exec ip netns exec $NS "$(dirname "$0")/virtual_board" -n "$COUNT" -a "$(board_ip 0)" "$@"
+    ;;
+down)
+    ip link del $HOST_IF 2>/dev/null
+    ip netns del $NS
+    ;;
+*)
+    echo "usage: $0 up|run|down [count] [virtual_board options]"
+    exit 1
+    ;;
+esac